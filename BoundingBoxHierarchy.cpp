@@ -0,0 +1,196 @@
+#include <algorithm>
+#include "BoundingBoxHierarchy.h"
+
+namespace {
+
+// nodes with at most this many boxes are not split
+const unsigned int MaxLeafSize = 4;
+
+// compares boxes by their center along one axis
+struct CenterLess {
+
+	CenterLess(const std::vector<float>& centers_, int axis_) :
+		centers(centers_),
+		axis(axis_) {}
+
+	bool operator()(unsigned int a, unsigned int b) const {
+
+		return centers[3*a + axis] < centers[3*b + axis];
+	}
+
+	const std::vector<float>& centers;
+	int axis;
+};
+
+} // anonymous namespace
+
+const unsigned int BoundingBoxHierarchy::NotInHierarchy = static_cast<unsigned int>(-1);
+
+void
+BoundingBoxHierarchy::build(const std::vector<BoundingBox>& boxes) {
+
+	_nodes.clear();
+	_boxIndices.clear();
+	_boxes.clear();
+	_positions.assign(boxes.size(), NotInHierarchy);
+
+	std::vector<float> centers(3*boxes.size());
+
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+
+		if (!boxes[i].isValid())
+			continue;
+
+		_boxIndices.push_back(i);
+
+		centers[3*i    ] = 0.5f*(boxes[i].getMinX() + boxes[i].getMaxX());
+		centers[3*i + 1] = 0.5f*(boxes[i].getMinY() + boxes[i].getMaxY());
+		centers[3*i + 2] = 0.5f*(boxes[i].getMinZ() + boxes[i].getMaxZ());
+	}
+
+	if (_boxIndices.empty())
+		return;
+
+	// a binary tree with at least one box per leaf
+	_nodes.reserve(2*_boxIndices.size());
+
+	buildNode(boxes, centers, 0, _boxIndices.size());
+
+	for (unsigned int i = 0; i < _boxIndices.size(); i++) {
+
+		_boxes.push_back(boxes[_boxIndices[i]]);
+		_positions[_boxIndices[i]] = i;
+	}
+}
+
+bool
+BoundingBoxHierarchy::update(unsigned int index, const BoundingBox& box) {
+
+	if (index >= _positions.size() || _positions[index] == NotInHierarchy || !box.isValid())
+		return false;
+
+	unsigned int position = _positions[index];
+
+	_boxes[position] = box;
+
+	// find the path from the root to the leaf of the box
+	std::vector<unsigned int> path;
+	unsigned int node = 0;
+
+	while (true) {
+
+		path.push_back(node);
+
+		if (_nodes[node].right == 0)
+			break;
+
+		node = (position < _nodes[node + 1].end ? node + 1 : _nodes[node].right);
+	}
+
+	// refit the nodes bottom up
+	for (int i = path.size() - 1; i >= 0; i--) {
+
+		Node& n = _nodes[path[i]];
+
+		BoundingBox boundingBox;
+
+		if (n.right == 0) {
+
+			for (unsigned int j = n.begin; j < n.end; j++)
+				boundingBox += _boxes[j];
+
+		} else {
+
+			boundingBox += _nodes[path[i] + 1].boundingBox;
+			boundingBox += _nodes[n.right].boundingBox;
+		}
+
+		n.boundingBox = boundingBox;
+	}
+
+	return true;
+}
+
+unsigned int
+BoundingBoxHierarchy::buildNode(
+		const std::vector<BoundingBox>& boxes,
+		const std::vector<float>& centers,
+		unsigned int begin,
+		unsigned int end) {
+
+	unsigned int index = _nodes.size();
+	_nodes.push_back(Node());
+
+	BoundingBox boundingBox;
+	for (unsigned int i = begin; i < end; i++)
+		boundingBox += boxes[_boxIndices[i]];
+
+	_nodes[index].boundingBox = boundingBox;
+	_nodes[index].begin       = begin;
+	_nodes[index].end         = end;
+	_nodes[index].right       = 0;
+
+	if (end - begin <= MaxLeafSize)
+		return index;
+
+	// split along the longest axis
+	int axis = 0;
+	if (boundingBox.height() > boundingBox.width())
+		axis = 1;
+	if (boundingBox.depth() > std::max(boundingBox.width(), boundingBox.height()))
+		axis = 2;
+
+	unsigned int middle = begin + (end - begin)/2;
+
+	std::nth_element(
+			_boxIndices.begin() + begin,
+			_boxIndices.begin() + middle,
+			_boxIndices.begin() + end,
+			CenterLess(centers, axis));
+
+	buildNode(boxes, centers, begin, middle);
+	unsigned int right = buildNode(boxes, centers, middle, end);
+
+	_nodes[index].right = right;
+
+	return index;
+}
+
+void
+BoundingBoxHierarchy::getVisible(const Frustum& frustum, std::vector<unsigned int>& visible) const {
+
+	if (_nodes.empty())
+		return;
+
+	getVisible(0, frustum, visible);
+}
+
+void
+BoundingBoxHierarchy::getVisible(unsigned int node, const Frustum& frustum, std::vector<unsigned int>& visible) const {
+
+	const Node& n = _nodes[node];
+
+	Frustum::Classification classification = frustum.classify(n.boundingBox);
+
+	if (classification == Frustum::Outside)
+		return;
+
+	// the whole subtree is visible
+	if (classification == Frustum::Inside) {
+
+		visible.insert(visible.end(), _boxIndices.begin() + n.begin, _boxIndices.begin() + n.end);
+		return;
+	}
+
+	if (n.right == 0) {
+
+		for (unsigned int i = n.begin; i < n.end; i++)
+			if (frustum.classify(_boxes[i]) != Frustum::Outside)
+				visible.push_back(_boxIndices[i]);
+
+		return;
+	}
+
+	getVisible(node + 1,  frustum, visible);
+	getVisible(n.right,   frustum, visible);
+}
@@ -0,0 +1,86 @@
+#ifndef GUI_BOUNDING_BOX_HIERARCHY_H__
+#define GUI_BOUNDING_BOX_HIERARCHY_H__
+
+#include <vector>
+#include <imageprocessing/Volume.h>
+#include "Frustum.h"
+
+/**
+ * A bounding volume hierarchy over a set of axis aligned boxes, to quickly
+ * find the boxes that intersect a view frustum.
+ *
+ * The hierarchy is built top down, by splitting the boxes of each node at
+ * the median of their centers along the longest axis of the node.
+ */
+class BoundingBoxHierarchy {
+
+public:
+
+	/**
+	 * (Re)build the hierarchy for the given boxes. Invalid boxes are left
+	 * out.
+	 */
+	void build(const std::vector<BoundingBox>& boxes);
+
+	/**
+	 * Change one of the boxes the hierarchy was built for, without
+	 * rebuilding it. Only the nodes on the path to the box are refitted, such
+	 * that the hierarchy gets less efficient if boxes move far.
+	 *
+	 * @return false, if the box was left out of the hierarchy or the new
+	 *         box is invalid. In this case, the hierarchy has to be rebuilt.
+	 */
+	bool update(unsigned int index, const BoundingBox& box);
+
+	/**
+	 * Find the indices of the boxes that are not completely outside of the
+	 * given frustum. The indices are appended to the given vector.
+	 */
+	void getVisible(const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	/**
+	 * The number of boxes in the hierarchy.
+	 */
+	unsigned int size() const { return _boxIndices.size(); }
+
+private:
+
+	struct Node {
+
+		BoundingBox boundingBox;
+
+		// the boxes of the subtree, as a range of _boxIndices
+		unsigned int begin;
+		unsigned int end;
+
+		// the right child (the left one follows the node directly), 0 for
+		// leaves
+		unsigned int right;
+	};
+
+	// build the subtree for the boxes [begin, end) of _boxIndices, returns
+	// the index of its root node
+	unsigned int buildNode(
+			const std::vector<BoundingBox>& boxes,
+			const std::vector<float>& centers,
+			unsigned int begin,
+			unsigned int end);
+
+	void getVisible(unsigned int node, const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	std::vector<Node> _nodes;
+
+	// the indices of the boxes, in the order of the leaves
+	std::vector<unsigned int> _boxIndices;
+
+	// the boxes, in the same order
+	std::vector<BoundingBox> _boxes;
+
+	// the position of each box in _boxIndices, or NotInHierarchy
+	std::vector<unsigned int> _positions;
+
+	static const unsigned int NotInHierarchy;
+};
+
+#endif // GUI_BOUNDING_BOX_HIERARCHY_H__
+
@@ -80,6 +80,14 @@ public:
 	template <typename PixelType>
 	PixelType* map();
 
+	/**
+	 * Map the buffer's content for reading, after it was filled through
+	 * GL_PIXEL_PACK_BUFFER (e.g., by glReadPixels()). Don't forget to call
+	 * unmap() when done.
+	 */
+	template <typename PixelType>
+	const PixelType* mapRead();
+
 	/**
 	 * Unmap this buffer.
 	 */
@@ -124,6 +132,22 @@ Buffer::map() {
 	return (PixelType*)_mapped;
 }
 
+template <typename PixelType>
+const PixelType*
+Buffer::mapRead() {
+
+	// bind buffer
+	glCheck(glBindBuffer(GL_PIXEL_PACK_BUFFER, _buf));
+
+	// map the pixel buffer object
+	_mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+	// unbind buffer (the mapping stays valid)
+	glCheck(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+	return (const PixelType*)_mapped;
+}
+
 } // namespace gui
 
 #endif // GUI_BUFFER_H__
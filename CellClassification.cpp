@@ -0,0 +1,467 @@
+#include <util/Logger.h>
+#include "CellClassification.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GUI_CELL_CLASSIFICATION_X86
+#include <immintrin.h>
+#endif
+
+static logger::LogChannel cellclassificationlog("cellclassificationlog", "[CellClassification] ");
+
+namespace {
+
+/*******************
+ * RUNTIME DISPATCH *
+ *******************/
+
+enum InstructionSet { Scalar, Sse2, Avx2 };
+
+InstructionSet detectInstructionSet() {
+
+	InstructionSet instructionSet = Scalar;
+
+#ifdef GUI_CELL_CLASSIFICATION_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		instructionSet = Avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		instructionSet = Sse2;
+#endif
+
+	LOG_DEBUG(cellclassificationlog)
+			<< "using "
+			<< (instructionSet == Avx2 ? "AVX2" : (instructionSet == Sse2 ? "SSE2" : "scalar"))
+			<< " kernels" << std::endl;
+
+	return instructionSet;
+}
+
+InstructionSet instructionSet() {
+
+	static const InstructionSet instructionSet = detectInstructionSet();
+
+	return instructionSet;
+}
+
+#ifdef GUI_CELL_CLASSIFICATION_X86
+
+/****************
+ * SSE2 KERNELS *
+ ****************/
+
+// Each kernel processes as many values as fit into its registers and returns
+// the number of processed values. The rest is left to the scalar code.
+
+// combine 16 exterior masks of 32 bit each into 16 bytes
+__attribute__((target("sse2")))
+inline __m128i packMasks(__m128i a, __m128i b, __m128i c, __m128i d) {
+
+	return _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyAboveSse2(const float* values, unsigned int n, float threshold, unsigned char* exterior) {
+
+	const __m128 t = _mm_set1_ps(threshold);
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		__m128i a = _mm_castps_si128(_mm_cmpngt_ps(_mm_loadu_ps(values + i),      t));
+		__m128i b = _mm_castps_si128(_mm_cmpngt_ps(_mm_loadu_ps(values + i + 4),  t));
+		__m128i c = _mm_castps_si128(_mm_cmpngt_ps(_mm_loadu_ps(values + i + 8),  t));
+		__m128i d = _mm_castps_si128(_mm_cmpngt_ps(_mm_loadu_ps(values + i + 12), t));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), packMasks(a, b, c, d));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyExactlySse2(const float* values, unsigned int n, float reference, unsigned char* exterior) {
+
+	const __m128 r = _mm_set1_ps(reference);
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		__m128i a = _mm_castps_si128(_mm_cmpneq_ps(_mm_loadu_ps(values + i),      r));
+		__m128i b = _mm_castps_si128(_mm_cmpneq_ps(_mm_loadu_ps(values + i + 4),  r));
+		__m128i c = _mm_castps_si128(_mm_cmpneq_ps(_mm_loadu_ps(values + i + 8),  r));
+		__m128i d = _mm_castps_si128(_mm_cmpneq_ps(_mm_loadu_ps(values + i + 12), r));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), packMasks(a, b, c, d));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyAboveSse2(const unsigned char* values, unsigned int n, unsigned char threshold, unsigned char* exterior) {
+
+	const __m128i t = _mm_set1_epi8(threshold);
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		// v <= t  <=>  min(v, t) == v
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), _mm_cmpeq_epi8(_mm_min_epu8(v, t), v));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyExactlySse2(const unsigned char* values, unsigned int n, unsigned char reference, unsigned char* exterior) {
+
+	const __m128i r   = _mm_set1_epi8(reference);
+	const __m128i all = _mm_set1_epi8(-1);
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), _mm_xor_si128(_mm_cmpeq_epi8(v, r), all));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyAboveSse2(const unsigned short* values, unsigned int n, unsigned short threshold, unsigned char* exterior) {
+
+	const __m128i t    = _mm_set1_epi16(threshold);
+	const __m128i zero = _mm_setzero_si128();
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		// v <= t  <=>  saturate(v - t) == 0
+		__m128i a = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)),     t), zero);
+		__m128i b = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 8)), t), zero);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), _mm_packs_epi16(a, b));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int classifyExactlySse2(const unsigned short* values, unsigned int n, unsigned short reference, unsigned char* exterior) {
+
+	const __m128i r   = _mm_set1_epi16(reference);
+	const __m128i all = _mm_set1_epi8(-1);
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+		__m128i a = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)),     r);
+		__m128i b = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 8)), r);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(exterior + i), _mm_xor_si128(_mm_packs_epi16(a, b), all));
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+unsigned int combineCaseCodesSse2(
+		const unsigned char* e00,
+		const unsigned char* e10,
+		const unsigned char* e01,
+		const unsigned char* e11,
+		unsigned int n,
+		unsigned char* codes,
+		bool& mixed) {
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i all  = _mm_set1_epi8(-1);
+
+	__m128i uniform = all;
+
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+
+#define LOAD(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+#define BIT(b) _mm_set1_epi8(static_cast<char>(b))
+
+		__m128i code =
+				_mm_or_si128(
+						_mm_or_si128(
+								_mm_or_si128(
+										_mm_and_si128(LOAD(e00 + i),     BIT(1)),
+										_mm_and_si128(LOAD(e10 + i),     BIT(2))),
+								_mm_or_si128(
+										_mm_and_si128(LOAD(e10 + i + 1), BIT(4)),
+										_mm_and_si128(LOAD(e00 + i + 1), BIT(8)))),
+						_mm_or_si128(
+								_mm_or_si128(
+										_mm_and_si128(LOAD(e01 + i),     BIT(16)),
+										_mm_and_si128(LOAD(e11 + i),     BIT(32))),
+								_mm_or_si128(
+										_mm_and_si128(LOAD(e11 + i + 1), BIT(64)),
+										_mm_and_si128(LOAD(e01 + i + 1), BIT(128)))));
+
+#undef LOAD
+#undef BIT
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(codes + i), code);
+
+		uniform = _mm_and_si128(
+				uniform,
+				_mm_or_si128(_mm_cmpeq_epi8(code, zero), _mm_cmpeq_epi8(code, all)));
+	}
+
+	if (_mm_movemask_epi8(uniform) != 0xffff)
+		mixed = true;
+
+	return i;
+}
+
+/****************
+ * AVX2 KERNELS *
+ ****************/
+
+// combine 32 exterior masks of 32 bit each into 32 bytes
+__attribute__((target("avx2")))
+inline __m256i packMasks(__m256i a, __m256i b, __m256i c, __m256i d) {
+
+	// the packs work per 128 bit lane, restore the order of the 32 bit groups
+	// afterwards
+	return _mm256_permutevar8x32_epi32(
+			_mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)),
+			_mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+// combine 32 exterior masks of 16 bit each into 32 bytes
+__attribute__((target("avx2")))
+inline __m256i packMasks(__m256i a, __m256i b) {
+
+	return _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xd8);
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyAboveAvx2(const float* values, unsigned int n, float threshold, unsigned char* exterior) {
+
+	const __m256 t = _mm256_set1_ps(threshold);
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i a = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i),      t, _CMP_NGT_UQ));
+		__m256i b = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 8),  t, _CMP_NGT_UQ));
+		__m256i c = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 16), t, _CMP_NGT_UQ));
+		__m256i d = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 24), t, _CMP_NGT_UQ));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), packMasks(a, b, c, d));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyExactlyAvx2(const float* values, unsigned int n, float reference, unsigned char* exterior) {
+
+	const __m256 r = _mm256_set1_ps(reference);
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i a = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i),      r, _CMP_NEQ_UQ));
+		__m256i b = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 8),  r, _CMP_NEQ_UQ));
+		__m256i c = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 16), r, _CMP_NEQ_UQ));
+		__m256i d = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i + 24), r, _CMP_NEQ_UQ));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), packMasks(a, b, c, d));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyAboveAvx2(const unsigned char* values, unsigned int n, unsigned char threshold, unsigned char* exterior) {
+
+	const __m256i t = _mm256_set1_epi8(threshold);
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), _mm256_cmpeq_epi8(_mm256_min_epu8(v, t), v));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyExactlyAvx2(const unsigned char* values, unsigned int n, unsigned char reference, unsigned char* exterior) {
+
+	const __m256i r   = _mm256_set1_epi8(reference);
+	const __m256i all = _mm256_set1_epi8(-1);
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), _mm256_xor_si256(_mm256_cmpeq_epi8(v, r), all));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyAboveAvx2(const unsigned short* values, unsigned int n, unsigned short threshold, unsigned char* exterior) {
+
+	const __m256i t    = _mm256_set1_epi16(threshold);
+	const __m256i zero = _mm256_setzero_si256();
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i a = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)),      t), zero);
+		__m256i b = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 16)), t), zero);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), packMasks(a, b));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int classifyExactlyAvx2(const unsigned short* values, unsigned int n, unsigned short reference, unsigned char* exterior) {
+
+	const __m256i r   = _mm256_set1_epi16(reference);
+	const __m256i all = _mm256_set1_epi8(-1);
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+		__m256i a = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)),      r);
+		__m256i b = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 16)), r);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(exterior + i), _mm256_xor_si256(packMasks(a, b), all));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+unsigned int combineCaseCodesAvx2(
+		const unsigned char* e00,
+		const unsigned char* e10,
+		const unsigned char* e01,
+		const unsigned char* e11,
+		unsigned int n,
+		unsigned char* codes,
+		bool& mixed) {
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i all  = _mm256_set1_epi8(-1);
+
+	__m256i uniform = all;
+
+	unsigned int i = 0;
+	for (; i + 32 <= n; i += 32) {
+
+#define LOAD(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define BIT(b) _mm256_set1_epi8(static_cast<char>(b))
+
+		__m256i code =
+				_mm256_or_si256(
+						_mm256_or_si256(
+								_mm256_or_si256(
+										_mm256_and_si256(LOAD(e00 + i),     BIT(1)),
+										_mm256_and_si256(LOAD(e10 + i),     BIT(2))),
+								_mm256_or_si256(
+										_mm256_and_si256(LOAD(e10 + i + 1), BIT(4)),
+										_mm256_and_si256(LOAD(e00 + i + 1), BIT(8)))),
+						_mm256_or_si256(
+								_mm256_or_si256(
+										_mm256_and_si256(LOAD(e01 + i),     BIT(16)),
+										_mm256_and_si256(LOAD(e11 + i),     BIT(32))),
+								_mm256_or_si256(
+										_mm256_and_si256(LOAD(e11 + i + 1), BIT(64)),
+										_mm256_and_si256(LOAD(e01 + i + 1), BIT(128)))));
+
+#undef LOAD
+#undef BIT
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(codes + i), code);
+
+		uniform = _mm256_and_si256(
+				uniform,
+				_mm256_or_si256(_mm256_cmpeq_epi8(code, zero), _mm256_cmpeq_epi8(code, all)));
+	}
+
+	if (_mm256_movemask_epi8(uniform) != -1)
+		mixed = true;
+
+	return i;
+}
+
+#endif // GUI_CELL_CLASSIFICATION_X86
+
+// pick the best kernel for the current CPU, returns the number of values
+// processed by the kernel
+#ifdef GUI_CELL_CLASSIFICATION_X86
+#define DISPATCH(kernel, args) \
+	(instructionSet() == Avx2 ? kernel##Avx2 args : (instructionSet() == Sse2 ? kernel##Sse2 args : 0))
+#else
+#define DISPATCH(kernel, args) 0
+#endif
+
+} // anonymous namespace
+
+#define CLASSIFY(name, type, op)                                                                                  \
+void                                                                                                              \
+name(const type* values, unsigned int n, type reference, unsigned char* exterior) {                               \
+                                                                                                                  \
+	unsigned int i = DISPATCH(name, (values, n, reference, exterior));                                            \
+                                                                                                                  \
+	for (; i < n; i++)                                                                                            \
+		exterior[i] = (values[i] op reference ? 0x00 : 0xff);                                                     \
+}
+
+CLASSIFY(classifyAbove,   float,          >)
+CLASSIFY(classifyAbove,   unsigned char,  >)
+CLASSIFY(classifyAbove,   unsigned short, >)
+CLASSIFY(classifyExactly, float,          ==)
+CLASSIFY(classifyExactly, unsigned char,  ==)
+CLASSIFY(classifyExactly, unsigned short, ==)
+
+#undef CLASSIFY
+
+bool
+combineCaseCodes(
+		const unsigned char* e00,
+		const unsigned char* e10,
+		const unsigned char* e01,
+		const unsigned char* e11,
+		unsigned int n,
+		unsigned char* codes) {
+
+	bool mixed = false;
+
+	unsigned int i = DISPATCH(combineCaseCodes, (e00, e10, e01, e11, n, codes, mixed));
+
+	for (; i < n; i++) {
+
+		codes[i] =
+				(e00[i]     & 1)  |
+				(e10[i]     & 2)  |
+				(e10[i + 1] & 4)  |
+				(e00[i + 1] & 8)  |
+				(e01[i]     & 16) |
+				(e11[i]     & 32) |
+				(e11[i + 1] & 64) |
+				(e01[i + 1] & 128);
+
+		if (codes[i] != 0 && codes[i] != 255)
+			mixed = true;
+	}
+
+	return mixed;
+}
@@ -0,0 +1,59 @@
+#ifndef GUI_CELL_CLASSIFICATION_H__
+#define GUI_CELL_CLASSIFICATION_H__
+
+/**
+ * Row kernels to classify the cells of marching cubes. Values are first
+ * classified into exterior masks (0xff for exterior, 0x00 for interior), four
+ * rows of masks are then combined into the case codes of a row of cells.
+ *
+ * The kernels for float, unsigned char, and unsigned short values use AVX2 or
+ * SSE2, depending on what the CPU supports. All other value types use the
+ * scalar templates.
+ */
+
+/**
+ * Mark all values that are not above the threshold as exterior.
+ */
+void classifyAbove(const float*          values, unsigned int n, float          threshold, unsigned char* exterior);
+void classifyAbove(const unsigned char*  values, unsigned int n, unsigned char  threshold, unsigned char* exterior);
+void classifyAbove(const unsigned short* values, unsigned int n, unsigned short threshold, unsigned char* exterior);
+
+template <typename ValueType>
+void classifyAbove(const ValueType* values, unsigned int n, ValueType threshold, unsigned char* exterior) {
+
+	for (unsigned int i = 0; i < n; i++)
+		exterior[i] = (values[i] > threshold ? 0x00 : 0xff);
+}
+
+/**
+ * Mark all values that are not equal to the reference as exterior.
+ */
+void classifyExactly(const float*          values, unsigned int n, float          reference, unsigned char* exterior);
+void classifyExactly(const unsigned char*  values, unsigned int n, unsigned char  reference, unsigned char* exterior);
+void classifyExactly(const unsigned short* values, unsigned int n, unsigned short reference, unsigned char* exterior);
+
+template <typename ValueType>
+void classifyExactly(const ValueType* values, unsigned int n, ValueType reference, unsigned char* exterior) {
+
+	for (unsigned int i = 0; i < n; i++)
+		exterior[i] = (values[i] == reference ? 0x00 : 0xff);
+}
+
+/**
+ * Combine the exterior masks of n+1 lattice points in four rows (y, z),
+ * (y+1, z), (y, z+1), and (y+1, z+1) into the case codes of the n cells
+ * between them.
+ *
+ * @return false, if all cells are completely inside or outside (i.e., all
+ *         case codes are 0 or 255).
+ */
+bool combineCaseCodes(
+		const unsigned char* exterior00,
+		const unsigned char* exterior10,
+		const unsigned char* exterior01,
+		const unsigned char* exterior11,
+		unsigned int n,
+		unsigned char* codes);
+
+#endif // GUI_CELL_CLASSIFICATION_H__
+
@@ -0,0 +1,35 @@
+#include <boost/make_shared.hpp>
+#include "QuadricDecimation.h"
+#include "CreateLevelsOfDetail.h"
+
+CreateLevelsOfDetail::CreateLevelsOfDetail() {
+
+	registerInput(_surfaces, "surfaces");
+	registerInput(_numLevels, "levels", pipeline::Optional);
+	registerInput(_ratio, "ratio", pipeline::Optional);
+	registerOutput(_surfacesWithLevels, "surfaces");
+}
+
+void
+CreateLevelsOfDetail::updateOutputs() {
+
+	// don't add the levels to the input meshes
+	boost::shared_ptr<Meshes> surfaces = boost::make_shared<Meshes>();
+
+	foreach (unsigned int id, _surfaces->getMeshIds()) {
+
+		boost::shared_ptr<Mesh> mesh = boost::make_shared<Mesh>(*_surfaces->get(id));
+		mesh->clearLevelsOfDetail();
+
+		surfaces->add(id, mesh);
+	}
+
+	QuadricDecimation decimation(_ratio.isSet() ? *_ratio : 0.25);
+
+	decimation.createLevelsOfDetail(
+			*surfaces,
+			_numLevels.isSet() ? *_numLevels : 4,
+			0);
+
+	_surfacesWithLevels = surfaces;
+}
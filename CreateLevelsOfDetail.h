@@ -0,0 +1,32 @@
+#ifndef GUI_CREATE_LEVELS_OF_DETAIL_H__
+#define GUI_CREATE_LEVELS_OF_DETAIL_H__
+
+#include <pipeline/SimpleProcessNode.h>
+#include "Meshes.h"
+
+/**
+ * Adds coarser versions of each mesh (see Mesh::addLevelOfDetail()), created 
+ * with QuadricDecimation, to copies of a set of meshes. MeshPainter draws 
+ * them for meshes that are small on the screen.
+ *
+ * Optional inputs are the number of levels (default 4) and the fraction of 
+ * triangles each level keeps from the previous one (default 0.25).
+ */
+class CreateLevelsOfDetail : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	CreateLevelsOfDetail();
+
+private:
+
+	void updateOutputs();
+
+	pipeline::Input<Meshes>       _surfaces;
+	pipeline::Input<unsigned int> _numLevels;
+	pipeline::Input<float>        _ratio;
+	pipeline::Output<Meshes>      _surfacesWithLevels;
+};
+
+#endif // GUI_CREATE_LEVELS_OF_DETAIL_H__
+
@@ -0,0 +1,31 @@
+#ifndef GUI_DECIMATE_SURFACE_H__
+#define GUI_DECIMATE_SURFACE_H__
+
+#include <pipeline/SimpleProcessNode.h>
+#include "Mesh.h"
+
+/**
+ * Simplifies a mesh with QuadricDecimation.
+ *
+ * Optional inputs are the fraction of triangles to keep (default 0.1) and 
+ * the maximal distance of the simplified surface to the original one 
+ * (default unbounded).
+ */
+class DecimateSurface : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	DecimateSurface();
+
+private:
+
+	void updateOutputs();
+
+	pipeline::Input<Mesh>  _surface;
+	pipeline::Input<float> _targetRatio;
+	pipeline::Input<float> _maxError;
+	pipeline::Output<Mesh> _decimated;
+};
+
+#endif // GUI_DECIMATE_SURFACE_H__
+
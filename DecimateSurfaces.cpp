@@ -0,0 +1,20 @@
+#include "QuadricDecimation.h"
+#include "DecimateSurfaces.h"
+
+DecimateSurfaces::DecimateSurfaces() {
+
+	registerInput(_surfaces, "surfaces");
+	registerInput(_targetRatio, "target ratio", pipeline::Optional);
+	registerInput(_maxError, "max error", pipeline::Optional);
+	registerOutput(_decimated, "decimated surfaces");
+}
+
+void
+DecimateSurfaces::updateOutputs() {
+
+	QuadricDecimation decimation(
+			_targetRatio.isSet() ? *_targetRatio : 0.1,
+			_maxError.isSet() ? *_maxError : std::numeric_limits<float>::max());
+
+	_decimated = decimation.decimate(*_surfaces, 0);
+}
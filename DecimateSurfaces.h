@@ -0,0 +1,33 @@
+#ifndef GUI_DECIMATE_SURFACES_H__
+#define GUI_DECIMATE_SURFACES_H__
+
+#include <pipeline/SimpleProcessNode.h>
+#include "Meshes.h"
+
+/**
+ * Simplifies a set of meshes with QuadricDecimation, using all available 
+ * cores. Vertices shared by several meshes (like the ones on the boundary 
+ * between adjacent labels) stay where they are.
+ *
+ * Optional inputs are the fraction of triangles to keep (default 0.1) and 
+ * the maximal distance of the simplified surfaces to the original ones 
+ * (default unbounded).
+ */
+class DecimateSurfaces : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	DecimateSurfaces();
+
+private:
+
+	void updateOutputs();
+
+	pipeline::Input<Meshes>  _surfaces;
+	pipeline::Input<float>   _targetRatio;
+	pipeline::Input<float>   _maxError;
+	pipeline::Output<Meshes> _decimated;
+};
+
+#endif // GUI_DECIMATE_SURFACES_H__
+
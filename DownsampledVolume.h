@@ -0,0 +1,202 @@
+#ifndef GUI_DOWNSAMPLED_VOLUME_H__
+#define GUI_DOWNSAMPLED_VOLUME_H__
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <imageprocessing/Volume.h>
+#include "Mesh.h"
+#include "VolumeSampler.h"
+
+/**
+ * A dense volume (see VolumeSampler) of the values of another volume,
+ * sampled every cellSize units, starting at the minimum of the other
+ * volume's bounding box. Voxel (i, j, k) of this volume is the value of the
+ * other volume at
+ *
+ *   min + (i, j, k)*cellSize.
+ *
+ * These are exactly the lattice points MarchingCubes uses for the other
+ * volume with the given cell size. Extracting a surface from this volume
+ * with a cell size of s (a positive integer) visits the same lattice points
+ * as extracting it from the other volume with a cell size of s*cellSize.
+ * With an edge placement that only uses the values at the corners of the
+ * cells (LinearInterpolation or Midpoint), the meshes are the same, once
+ * they are transformed with mapToVolume(). (For cell sizes that are not
+ * integers, lattice points close to a voxel border can end up in a
+ * different voxel due to rounding.)
+ *
+ * This is used to extract several levels of detail of a surface, while
+ * reading the other volume only once.
+ */
+template <typename ValueType>
+class DownsampledVolume : public Volume {
+
+public:
+
+	typedef ValueType value_type;
+
+	// mark this volume as dense, see VolumeSampler
+	typedef void dense_volume_tag;
+
+	/**
+	 * Sample the given volume every cellSize units.
+	 */
+	template <typename OtherVolume>
+	DownsampledVolume(const OtherVolume& volume, float cellSize);
+
+	/**
+	 * Sample the given volume again where it changed. The region is in the
+	 * coordinates of the given volume, like in MarchingCubes::
+	 * updateSurfaces().
+	 *
+	 * @return The voxels of this volume that have been sampled again (empty,
+	 *         if the region does not contain any lattice point).
+	 */
+	template <typename OtherVolume>
+	BoundingBox update(const OtherVolume& volume, const BoundingBox& region);
+
+	unsigned int getVoxelsX() const { return _width; }
+	unsigned int getVoxelsY() const { return _height; }
+	unsigned int getVoxelsZ() const { return _depth; }
+
+	const value_type* getSection(unsigned int z) const { return &_values[z*_width*_height]; }
+
+	value_type operator()(float x, float y, float z) const {
+
+		if (!getBoundingBox().contains(x, y, z))
+			return value_type(0);
+
+		return getSection(static_cast<unsigned int>(z))[
+				static_cast<unsigned int>(y)*_width +
+				static_cast<unsigned int>(x)];
+	}
+
+	/**
+	 * Transform a mesh extracted from this volume into the coordinates of
+	 * the original volume.
+	 */
+	void mapToVolume(Mesh& mesh) const {
+
+		for (unsigned int i = 0; i < mesh.getNumVertices(); i++) {
+
+			const Point3d& vertex = mesh.getVertex(i);
+
+			mesh.setVertex(i, Point3d(
+					_minX + vertex.x*_cellSize,
+					_minY + vertex.y*_cellSize,
+					_minZ + vertex.z*_cellSize));
+		}
+
+		// the normals keep their direction under a uniform scaling
+	}
+
+private:
+
+	// read the voxels [begin, end) from the given volume
+	template <typename OtherVolume>
+	void sample(
+			const OtherVolume& volume,
+			unsigned int beginX, unsigned int beginY, unsigned int beginZ,
+			unsigned int endX, unsigned int endY, unsigned int endZ);
+
+	// the voxels [begin, end) along one axis whose lattice points are in
+	// [min, max) of the other volume
+	void getVoxelRange(
+			float min, float max,
+			float volumeMin, unsigned int numVoxels,
+			unsigned int& begin, unsigned int& end) const;
+
+	BoundingBox computeBoundingBox() const {
+
+		return BoundingBox(0, 0, 0, _width, _height, _depth);
+	}
+
+	unsigned int _width, _height, _depth;
+
+	float _minX, _minY, _minZ;
+
+	float _cellSize;
+
+	std::vector<value_type> _values;
+};
+
+template <typename ValueType>
+template <typename OtherVolume>
+DownsampledVolume<ValueType>::DownsampledVolume(const OtherVolume& volume, float cellSize) :
+	_width(std::ceil(volume.getBoundingBox().width()/cellSize)),
+	_height(std::ceil(volume.getBoundingBox().height()/cellSize)),
+	_depth(std::ceil(volume.getBoundingBox().depth()/cellSize)),
+	_minX(volume.getBoundingBox().getMinX()),
+	_minY(volume.getBoundingBox().getMinY()),
+	_minZ(volume.getBoundingBox().getMinZ()),
+	_cellSize(cellSize),
+	_values(static_cast<std::size_t>(_width)*_height*_depth) {
+
+	sample(volume, 0, 0, 0, _width, _height, _depth);
+}
+
+template <typename ValueType>
+template <typename OtherVolume>
+BoundingBox
+DownsampledVolume<ValueType>::update(const OtherVolume& volume, const BoundingBox& region) {
+
+	unsigned int beginX, beginY, beginZ, endX, endY, endZ;
+
+	getVoxelRange(region.getMinX(), region.getMaxX(), _minX, _width,  beginX, endX);
+	getVoxelRange(region.getMinY(), region.getMaxY(), _minY, _height, beginY, endY);
+	getVoxelRange(region.getMinZ(), region.getMaxZ(), _minZ, _depth,  beginZ, endZ);
+
+	if (beginX >= endX || beginY >= endY || beginZ >= endZ)
+		return BoundingBox();
+
+	sample(volume, beginX, beginY, beginZ, endX, endY, endZ);
+
+	return BoundingBox(beginX, beginY, beginZ, endX, endY, endZ);
+}
+
+template <typename ValueType>
+template <typename OtherVolume>
+void
+DownsampledVolume<ValueType>::sample(
+		const OtherVolume& volume,
+		unsigned int beginX, unsigned int beginY, unsigned int beginZ,
+		unsigned int endX, unsigned int endY, unsigned int endZ) {
+
+	if (_values.empty())
+		return;
+
+	// lattice point i of the sampler is at min + (i-1)*cellSize, we want
+	// voxel i at min + i*cellSize
+	VolumeSampler<OtherVolume> sampler(
+			volume,
+			_minX + _cellSize, _minY + _cellSize, _minZ + _cellSize,
+			_cellSize, _cellSize, _cellSize,
+			_width, _height, _depth);
+
+	for (unsigned int z = beginZ; z < endZ; z++)
+		for (unsigned int y = beginY; y < endY; y++)
+			sampler.getRow(y, z).read(
+					beginX,
+					endX,
+					&_values[(static_cast<std::size_t>(z)*_height + y)*_width + beginX]);
+}
+
+template <typename ValueType>
+void
+DownsampledVolume<ValueType>::getVoxelRange(
+		float min, float max,
+		float volumeMin, unsigned int numVoxels,
+		unsigned int& begin, unsigned int& end) const {
+
+	// one more voxel on each side, for lattice points that end up in a
+	// neighboring voxel of the other volume due to rounding
+	float first = std::floor((min - volumeMin)/_cellSize);
+	float last  = std::ceil((max - volumeMin)/_cellSize) + 1;
+
+	begin = static_cast<unsigned int>(std::max(0.0f, std::min(static_cast<float>(numVoxels), first)));
+	end   = static_cast<unsigned int>(std::max(0.0f, std::min(static_cast<float>(numVoxels), last)));
+}
+
+#endif // GUI_DOWNSAMPLED_VOLUME_H__
+
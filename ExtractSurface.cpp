@@ -1,26 +1,104 @@
-#include <imageprocessing/ImageStackVolumeAdaptor.h>
+#include <boost/make_shared.hpp>
+#include "DownsampledVolume.h"
+#include "ImageStackVoxelAdaptor.h"
 #include "MarchingCubes.h"
 #include "ExtractSurface.h"
 
-ExtractSurface::ExtractSurface() {
+ExtractSurface::ExtractSurface(bool levelsOfDetail) :
+	_levelsOfDetail(levelsOfDetail),
+	_latticeCellSize(0) {
 
 	registerInput(_stack, "stack");
+	registerInput(_isoLevel, "iso level", pipeline::Optional);
+	registerInput(_cellSize, "cell size", pipeline::Optional);
 	registerOutput(_surface, "surface");
+
+	if (_levelsOfDetail) {
+
+		registerOutput(_coarseSurfaces[0], "surface 2x");
+		registerOutput(_coarseSurfaces[1], "surface 4x");
+		registerOutput(_coarseSurfaces[2], "surface 8x");
+	}
+
+	_stack.registerCallback(&ExtractSurface::onStackModified, this);
+	_stack.registerCallback(&ExtractSurface::onStackSet, this);
 }
 
 void
 ExtractSurface::updateOutputs() {
 
+	float isoLevel = (_isoLevel.isSet() ? *_isoLevel : 0.5);
+	float cellSize = (_cellSize.isSet() ? *_cellSize : 10.0);
+
 	// wrap the input stack into a volume adaptor
-	ImageStackVolumeAdaptor volume(*_stack);
+	ImageStackVoxelAdaptor volume(*_stack);
+
+	if (_levelsOfDetail) {
+
+		// Read the lattice of the finest level once. The coarser lattices are 
+		// subsets of it. Since the stack is not read again, the vertices are 
+		// interpolated between the corners of the cells.
+		if (!_lattice || cellSize != _latticeCellSize) {
+
+			_lattice.reset(new DownsampledVolume<float>(volume, cellSize));
+			_latticePyramid  = boost::make_shared<MinMaxPyramid<float> >(*_lattice);
+			_latticeCellSize = cellSize;
+		}
+
+		const DownsampledVolume<float>& lattice = *_lattice;
+
+		MarchingCubes<DownsampledVolume<float> > coarseMarchingCubes;
+		coarseMarchingCubes.setNumThreads(0);
+		coarseMarchingCubes.setMinMaxPyramid(_latticePyramid);
+
+		for (unsigned int level = 0; level < 3; level++) {
+
+			float scale = (2 << level);
+
+			boost::shared_ptr<Mesh> surface = coarseMarchingCubes.generateSurface(
+					lattice,
+					MarchingCubes<DownsampledVolume<float> >::AcceptAbove(isoLevel),
+					scale,
+					scale,
+					scale,
+					lattice.getBoundingBox(),
+					MarchingCubes<DownsampledVolume<float> >::LinearInterpolation());
 
-	// create a marching cubes instance
-	MarchingCubes<ImageStackVolumeAdaptor> marchingCubes;
+			lattice.mapToVolume(*surface);
+
+			_coarseSurfaces[level] = surface;
+		}
+	}
+
+	// create a marching cubes instance that uses all available cores
+	MarchingCubes<ImageStackVoxelAdaptor> marchingCubes;
+	marchingCubes.setNumThreads(0);
+
+	// skip blocks of cells without the surface
+	if (!_pyramid)
+		_pyramid = boost::make_shared<MinMaxPyramid<float> >(volume);
+	marchingCubes.setMinMaxPyramid(_pyramid);
 
 	_surface = marchingCubes.generateSurface(
 			volume,
-			MarchingCubes<ImageStackVolumeAdaptor>::AcceptAbove(0.5),
-			10.0,
-			10.0,
-			10.0);
+			MarchingCubes<ImageStackVoxelAdaptor>::AcceptAbove(isoLevel),
+			cellSize,
+			cellSize,
+			cellSize);
+}
+
+void
+ExtractSurface::onStackModified(const pipeline::Modified& /*signal*/) {
+
+	_pyramid.reset();
+	_lattice.reset();
+	_latticePyramid.reset();
+}
+
+void
+ExtractSurface::onStackSet(const pipeline::InputSetBase& /*signal*/) {
+
+	_pyramid.reset();
+	_lattice.reset();
+	_latticePyramid.reset();
 }
@@ -1,23 +1,64 @@
 #ifndef GUI_EXTRACT_SURFACE_H__
 #define GUI_EXTRACT_SURFACE_H__
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <pipeline/SimpleProcessNode.h>
 #include <imageprocessing/ImageStack.h>
+#include "DownsampledVolume.h"
 #include "Mesh.h"
+#include "MinMaxPyramid.h"
 
+/**
+ * Extracts the surface of all voxels above an iso level from an image stack.
+ *
+ * Optional inputs are the iso level (default 0.5) and the size of the 
+ * marching cubes cells (default 10). In level of detail mode, the node 
+ * additionally provides the surface extracted with 2, 4, and 8 times the 
+ * cell size on the outputs "surface 2x", "surface 4x", and "surface 8x".
+ *
+ * A min/max pyramid of the stack (and of the lattice of the coarser 
+ * surfaces) is kept until the stack changes, such that changing the iso 
+ * level only visits the cells around the new surface.
+ */
 class ExtractSurface : public pipeline::SimpleProcessNode<> {
 
 public:
 
-	ExtractSurface();
+	/**
+	 * Create a new surface extraction node.
+	 *
+	 * @param levelsOfDetail
+	 *              Whether to extract coarser surfaces as well.
+	 */
+	ExtractSurface(bool levelsOfDetail = false);
 
 private:
 
 	void updateOutputs();
 
+	// forget the pyramids and the lattice of the previous stack
+	void onStackModified(const pipeline::Modified& signal);
+	void onStackSet(const pipeline::InputSetBase& signal);
+
 	pipeline::Input<ImageStack> _stack;
+	pipeline::Input<float>      _isoLevel;
+	pipeline::Input<float>      _cellSize;
 	pipeline::Output<Mesh>      _surface;
 
+	// the coarser surfaces, if in level of detail mode
+	pipeline::Output<Mesh>      _coarseSurfaces[3];
+
+	bool _levelsOfDetail;
+
+	// the min/max pyramid of the current stack
+	boost::shared_ptr<const MinMaxPyramid<float> > _pyramid;
+
+	// the lattice of the coarser surfaces, its min/max pyramid, and the cell 
+	// size it was sampled with
+	boost::scoped_ptr<DownsampledVolume<float> >   _lattice;
+	boost::shared_ptr<const MinMaxPyramid<float> > _latticePyramid;
+	float                                          _latticeCellSize;
 };
 
 #endif // GUI_EXTRACT_SURFACE_H__
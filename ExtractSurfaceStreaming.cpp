@@ -0,0 +1,39 @@
+#include "MappedVolume.h"
+#include "MarchingCubes.h"
+#include "ExtractSurfaceStreaming.h"
+
+ExtractSurfaceStreaming::ExtractSurfaceStreaming(
+		const std::string& filename,
+		unsigned int width,
+		unsigned int height,
+		unsigned int depth) :
+	_filename(filename),
+	_width(width),
+	_height(height),
+	_depth(depth) {
+
+	registerInput(_isoLevel, "iso level", pipeline::Optional);
+	registerInput(_cellSize, "cell size", pipeline::Optional);
+	registerOutput(_surface, "surface");
+}
+
+void
+ExtractSurfaceStreaming::updateOutputs() {
+
+	float isoLevel = (_isoLevel.isSet() ? *_isoLevel : 0.5);
+	float cellSize = (_cellSize.isSet() ? *_cellSize : 10.0);
+
+	// map the file, sections are read on demand
+	MappedVolume<float> volume(_filename, _width, _height, _depth);
+
+	// create a marching cubes instance that uses all available cores
+	MarchingCubes<MappedVolume<float> > marchingCubes;
+	marchingCubes.setNumThreads(0);
+
+	_surface = marchingCubes.generateSurfaceStreaming(
+			volume,
+			MarchingCubes<MappedVolume<float> >::AcceptAbove(isoLevel),
+			cellSize,
+			cellSize,
+			cellSize);
+}
@@ -0,0 +1,44 @@
+#ifndef GUI_EXTRACT_SURFACE_STREAMING_H__
+#define GUI_EXTRACT_SURFACE_STREAMING_H__
+
+#include <string>
+#include <pipeline/SimpleProcessNode.h>
+#include "Mesh.h"
+
+/**
+ * Same as ExtractSurface, but reads the volume from a raw file of float 
+ * voxels (see MappedVolume) that does not have to fit into memory. Only a 
+ * window of a few sections of the volume is resident at a time.
+ *
+ * Like ExtractSurface, the node has the optional inputs "iso level" (default 
+ * 0.5) and "cell size" (default 10).
+ */
+class ExtractSurfaceStreaming : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	/**
+	 * Create a new surface extraction node for the given raw file of 
+	 * width*height*depth float voxels.
+	 */
+	ExtractSurfaceStreaming(
+			const std::string& filename,
+			unsigned int width,
+			unsigned int height,
+			unsigned int depth);
+
+private:
+
+	void updateOutputs();
+
+	pipeline::Input<float> _isoLevel;
+	pipeline::Input<float> _cellSize;
+	pipeline::Output<Mesh> _surface;
+
+	std::string _filename;
+
+	unsigned int _width, _height, _depth;
+};
+
+#endif // GUI_EXTRACT_SURFACE_STREAMING_H__
+
@@ -1,43 +1,268 @@
+#include <cmath>
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/timer/timer.hpp>
-#include <imageprocessing/ImageStackVolumeAdaptor.h>
+#include <util/Logger.h>
+#include "DownsampledVolume.h"
+#include "ImageStackVoxelAdaptor.h"
 #include "MarchingCubes.h"
 #include "ExtractSurfaces.h"
 
-ExtractSurfaces::ExtractSurfaces() {
+static logger::LogChannel extractsurfaceslog("extractsurfaceslog", "[ExtractSurfaces] ");
+
+ExtractSurfaces::ExtractSurfaces(bool levelsOfDetail) :
+	_levelsOfDetail(levelsOfDetail),
+	_dirtyRegionChanged(false),
+	_extractedCellSize(0) {
 
 	registerInput(_stack, "stack");
+	registerInput(_cellSize, "cell size", pipeline::Optional);
+	registerInput(_dirtyRegion, "dirty region", pipeline::Optional);
 	registerOutput(_surfaces, "surfaces");
+
+	_dirtyRegion.registerCallback(&ExtractSurfaces::onDirtyRegionModified, this);
+	_dirtyRegion.registerCallback(&ExtractSurfaces::onDirtyRegionSet, this);
+
+	if (_levelsOfDetail) {
+
+		registerOutput(_coarseSurfaces[0], "surfaces 2x");
+		registerOutput(_coarseSurfaces[1], "surfaces 4x");
+		registerOutput(_coarseSurfaces[2], "surfaces 8x");
+	}
 }
 
 void
 ExtractSurfaces::updateOutputs() {
 
+	float cellSize = (_cellSize.isSet() ? *_cellSize : 10.0);
+
 	// wrap the input stack into a volume adaptor
-	ImageStackVolumeAdaptor volume(*_stack);
+	ImageStackVoxelAdaptor volume(*_stack);
+
+	// create a marching cubes instance that uses all available cores
+	MarchingCubes<ImageStackVoxelAdaptor> marchingCubes;
+	marchingCubes.setNumThreads(0);
+
+	// the dirty region describes only the change of the stack it came with, 
+	// all other changes need a full extraction
+	bool useDirtyRegion = _dirtyRegionChanged;
+	_dirtyRegionChanged = false;
 
-	// create a marching cubes instance
-	MarchingCubes<ImageStackVolumeAdaptor> marchingCubes;
+	// after an edit of the stack, update only the surfaces in the edited 
+	// region
+	if (useDirtyRegion && _dirtyRegion.isSet() && _dirtyRegion->isValid() && _surfaces &&
+	    cellSize == _extractedCellSize &&
+	    volume.getBoundingBox().width()  == _extractedBoundingBox.width() &&
+	    volume.getBoundingBox().height() == _extractedBoundingBox.height() &&
+	    volume.getBoundingBox().depth()  == _extractedBoundingBox.depth()) {
 
-	// get all ids in the image stack
-	std::set<unsigned int> ids;
+		updateSurfaces(marchingCubes, volume, cellSize);
 
-	foreach (boost::shared_ptr<Image> image, *_stack)
-		foreach (Image::value_type value, *image)
-			if (value != 0)
-				ids.insert(value);
+		if (_levelsOfDetail)
+			updateCoarseSurfaces(volume);
+
+		return;
+	}
+
+	if (_levelsOfDetail)
+		extractCoarseSurfaces(volume, cellSize);
+
+	_extractedCellSize    = cellSize;
+	_extractedBoundingBox = volume.getBoundingBox();
+
+	// find all ids in the image stack and their bounding boxes
+	_labelIndex.build(*_stack);
+
+	// skip blocks of cells without a surface, for all of the following 
+	// extractions
+	marchingCubes.setMinMaxPyramid(boost::make_shared<MinMaxPyramid<float> >(volume));
+
+	std::vector<unsigned int> labels = _labelIndex.getLabels();
+
+	// compare the number of cells to visit for each label separately with 
+	// the number of cells of the whole stack
+	boost::uint64_t stackCells = numCells(_stack->width(), _stack->height(), _stack->size(), cellSize);
+	boost::uint64_t labelCells = 0;
+
+	foreach (unsigned int label, labels) {
+
+		BoundingBox box = _labelIndex.getBoundingBox(label);
+		labelCells += numCells(box.width(), box.height(), box.depth(), cellSize);
+
+		if (labelCells >= stackCells)
+			break;
+	}
+
+	LOG_DEBUG(extractsurfaceslog)
+			<< labels.size() << " labels cover " << (labelCells >= stackCells ? "at least " : "") << labelCells << " of "
+			<< stackCells << " cells" << std::endl;
+
+	if (labelCells >= stackCells) {
+
+		// extract the surfaces of all ids in the image stack in a single pass
+		_surfaces = marchingCubes.generateSurfaces(volume, cellSize, cellSize, cellSize);
+		return;
+	}
 
 	_surfaces = new Meshes;
 
-	foreach (unsigned int id, ids) {
+	foreach (unsigned int label, labels) {
 
 		_surfaces->add(
-				id,
+				label,
 				marchingCubes.generateSurface(
 					volume,
-					MarchingCubes<ImageStackVolumeAdaptor>::AcceptExactly(id),
-					10.0,
-					10.0,
-					10.0));
+					MarchingCubes<ImageStackVoxelAdaptor>::AcceptExactly(label),
+					cellSize,
+					cellSize,
+					cellSize,
+					_labelIndex.getBoundingBox(label)));
+	}
+}
+
+void
+ExtractSurfaces::onDirtyRegionModified(const pipeline::Modified& /*signal*/) {
+
+	_dirtyRegionChanged = true;
+}
+
+void
+ExtractSurfaces::onDirtyRegionSet(const pipeline::InputSetBase& /*signal*/) {
+
+	_dirtyRegionChanged = true;
+}
+
+void
+ExtractSurfaces::updateSurfaces(
+		MarchingCubes<ImageStackVoxelAdaptor>& marchingCubes,
+		const ImageStackVoxelAdaptor& volume,
+		float cellSize) {
+
+	const BoundingBox& region = *_dirtyRegion;
+
+	// keep the label index up-to-date for the next full extraction
+	unsigned int beginSection = std::max(0.0f, std::floor(region.getMinZ()));
+	unsigned int endSection   = std::min(static_cast<float>(_stack->size()), std::ceil(region.getMaxZ()));
+	for (unsigned int section = beginSection; section < endSection; section++)
+		_labelIndex.updateSection(*_stack, section);
+
+	marchingCubes.updateSurfaces(
+			volume,
+			cellSize,
+			cellSize,
+			cellSize,
+			region,
+			*_surfaces);
+
+	LOG_DEBUG(extractsurfaceslog)
+			<< "updated surfaces in region " << region.getMinX() << ", " << region.getMinY() << ", " << region.getMinZ()
+			<< " -- " << region.getMaxX() << ", " << region.getMaxY() << ", " << region.getMaxZ() << std::endl;
+}
+
+void
+ExtractSurfaces::extractCoarseSurfaces(const ImageStackVoxelAdaptor& volume, float cellSize) {
+
+	// Read the lattice of the finest level once. The coarser lattices are 
+	// subsets of it. Since the stack is not read again, the vertices are 
+	// placed in the middle of the edges of the cells.
+	_lattice.reset(new Lattice(volume, cellSize));
+
+	CoarseMarchingCubes marchingCubes;
+	marchingCubes.setNumThreads(0);
+
+	for (unsigned int level = 0; level < 3; level++) {
+
+		float scale = (2 << level);
+
+		_latticeSurfaces[level] = marchingCubes.generateSurfaces(
+				*_lattice,
+				scale,
+				scale,
+				scale,
+				0,
+				CoarseMarchingCubes::Midpoint());
+
+		_coarseSurfaces[level] = new Meshes;
+
+		foreach (unsigned int id, _latticeSurfaces[level]->getMeshIds())
+			_coarseSurfaces[level]->add(id, mapToVolume(*_latticeSurfaces[level]->get(id)));
 	}
+
+	LOG_DEBUG(extractsurfaceslog)
+			<< "extracted coarse surfaces from a lattice of "
+			<< _lattice->getVoxelsX() << "x" << _lattice->getVoxelsY() << "x" << _lattice->getVoxelsZ()
+			<< " values" << std::endl;
 }
 
+void
+ExtractSurfaces::updateCoarseSurfaces(const ImageStackVoxelAdaptor& volume) {
+
+	BoundingBox region = _lattice->update(volume, *_dirtyRegion);
+
+	if (!region.isValid())
+		return;
+
+	CoarseMarchingCubes marchingCubes;
+	marchingCubes.setNumThreads(0);
+
+	for (unsigned int level = 0; level < 3; level++) {
+
+		float   scale           = (2 << level);
+		Meshes& latticeSurfaces = *_latticeSurfaces[level];
+
+		// the meshes and their revisions before the update, to find the 
+		// changed ones
+		std::map<unsigned int, std::pair<const Mesh*, unsigned int> > previous;
+		foreach (unsigned int id, latticeSurfaces.getMeshIds()) {
+
+			boost::shared_ptr<Mesh> mesh = latticeSurfaces.get(id);
+			previous[id] = std::make_pair(mesh.get(), mesh->getRevision());
+		}
+
+		marchingCubes.updateSurfaces(
+				*_lattice,
+				scale,
+				scale,
+				scale,
+				region,
+				latticeSurfaces,
+				0,
+				CoarseMarchingCubes::Midpoint());
+
+		foreach (unsigned int id, latticeSurfaces.getMeshIds()) {
+
+			boost::shared_ptr<Mesh> mesh = latticeSurfaces.get(id);
+
+			std::map<unsigned int, std::pair<const Mesh*, unsigned int> >::const_iterator i = previous.find(id);
+			if (i != previous.end() && i->second.first == mesh.get() && i->second.second == mesh->getRevision())
+				continue;
+
+			_coarseSurfaces[level]->add(id, mapToVolume(*mesh));
+		}
+
+		for (std::map<unsigned int, std::pair<const Mesh*, unsigned int> >::const_iterator i = previous.begin(); i != previous.end(); i++)
+			if (!latticeSurfaces.contains(i->first))
+				_coarseSurfaces[level]->remove(i->first);
+	}
+}
+
+boost::shared_ptr<Mesh>
+ExtractSurfaces::mapToVolume(const Mesh& mesh) const {
+
+	boost::shared_ptr<Mesh> mapped = boost::make_shared<Mesh>(mesh);
+	_lattice->mapToVolume(*mapped);
+
+	return mapped;
+}
+
+boost::uint64_t
+ExtractSurfaces::numCells(float width, float height, float depth, float cellSize) {
+
+	// MarchingCubes adds one cell to the extent of the volume and up to three 
+	// to the extent of a region
+	return
+			static_cast<boost::uint64_t>(std::ceil(width /cellSize) + 3)*
+			static_cast<boost::uint64_t>(std::ceil(height/cellSize) + 3)*
+			static_cast<boost::uint64_t>(std::ceil(depth /cellSize) + 3);
+}
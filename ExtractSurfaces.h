@@ -1,27 +1,106 @@
 #ifndef GUI_EXTRACT_SURFACES_H__
 #define GUI_EXTRACT_SURFACES_H__
 
+#include <boost/cstdint.hpp>
 #include <pipeline/SimpleProcessNode.h>
+#include <boost/scoped_ptr.hpp>
 #include <imageprocessing/ImageStack.h>
+#include "DownsampledVolume.h"
+#include "ImageStackVoxelAdaptor.h"
+#include "LabelIndex.h"
+#include "MarchingCubes.h"
 #include "Meshes.h"
 
 /**
  * Extracts a set of meshes, one for each gray-level in the image stack.  
  * Intended for image stacks that contain multiple components with different 
  * ids.
+ *
+ * If the components are small compared to the stack, each surface is 
+ * extracted from the bounding box of its component only. Otherwise, all 
+ * surfaces are extracted in a single pass over the whole stack.
+ *
+ * An optional input is the size of the marching cubes cells (default 10). 
+ * In level of detail mode, the node additionally provides the surfaces 
+ * extracted with 2, 4, and 8 times the cell size on the outputs "surfaces 
+ * 2x", "surfaces 4x", and "surfaces 8x".
+ *
+ * If the optional input "dirty region" is set or modified together with the 
+ * stack, the stack is assumed to have changed in this region only (in voxel 
+ * coordinates) since the last update. In this case, only the cells around 
+ * the region are visited again, and the affected triangles are replaced in 
+ * the existing meshes (see MarchingCubes::updateSurfaces()). The coarser 
+ * surfaces are updated the same way, from a copy of the lattice of the 
+ * finest level that is kept for this. Each region is used for one update 
+ * only, later changes of the stack without a new region lead to a full 
+ * extraction.
  */
 class ExtractSurfaces : public pipeline::SimpleProcessNode<> {
 
 public:
 
-	ExtractSurfaces();
+	/**
+	 * Create a new surface extraction node.
+	 *
+	 * @param levelsOfDetail
+	 *              Whether to extract coarser surfaces as well.
+	 */
+	ExtractSurfaces(bool levelsOfDetail = false);
 
 private:
 
 	void updateOutputs();
 
-	pipeline::Input<ImageStack> _stack;
-	pipeline::Output<Meshes>    _surfaces;
+	// remember that the dirty region describes the next change of the stack
+	void onDirtyRegionModified(const pipeline::Modified& signal);
+	void onDirtyRegionSet(const pipeline::InputSetBase& signal);
+
+	// update the surfaces in the dirty region only
+	void updateSurfaces(
+			MarchingCubes<ImageStackVoxelAdaptor>& marchingCubes,
+			const ImageStackVoxelAdaptor& volume,
+			float cellSize);
+
+	typedef DownsampledVolume<ImageStackVoxelAdaptor::value_type> Lattice;
+	typedef MarchingCubes<Lattice>                                CoarseMarchingCubes;
+
+	// extract the coarser surfaces from the lattice of the given cell size
+	void extractCoarseSurfaces(const ImageStackVoxelAdaptor& volume, float cellSize);
+
+	// update the coarser surfaces in the dirty region only
+	void updateCoarseSurfaces(const ImageStackVoxelAdaptor& volume);
+
+	// copy a mesh extracted from the lattice into volume coordinates
+	boost::shared_ptr<Mesh> mapToVolume(const Mesh& mesh) const;
+
+	// the number of cells marching cubes will visit for the given extent
+	static boost::uint64_t numCells(float width, float height, float depth, float cellSize);
+
+	pipeline::Input<ImageStack>  _stack;
+	pipeline::Input<float>       _cellSize;
+	pipeline::Input<BoundingBox> _dirtyRegion;
+	pipeline::Output<Meshes>     _surfaces;
+
+	// the coarser surfaces, if in level of detail mode
+	pipeline::Output<Meshes>     _coarseSurfaces[3];
+
+	// the lattice of the finest level and the coarser surfaces in its 
+	// coordinates, to update them after edits
+	boost::scoped_ptr<Lattice> _lattice;
+	boost::shared_ptr<Meshes>  _latticeSurfaces[3];
+
+	bool _levelsOfDetail;
+
+	// the dirty region was set or modified since the last update, and can 
+	// be used once
+	bool _dirtyRegionChanged;
+
+	// the labels of the current stack and where to find them
+	LabelIndex _labelIndex;
+
+	// the cell size and extent of the volume of the current surfaces
+	float       _extractedCellSize;
+	BoundingBox _extractedBoundingBox;
 
 };
 
@@ -0,0 +1,79 @@
+#include <gui/OpenGl.h>
+#include "Frustum.h"
+
+Frustum::Frustum() {
+
+	// planes that contain everything
+	for (int i = 0; i < 6; i++) {
+
+		_planes[i][0] = _planes[i][1] = _planes[i][2] = 0;
+		_planes[i][3] = 1;
+	}
+}
+
+Frustum::Frustum(const float* projection, const float* modelview) {
+
+	// the matrix from object to clip coordinates
+	float clip[16];
+
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++) {
+
+			clip[4*column + row] = 0;
+			for (int k = 0; k < 4; k++)
+				clip[4*column + row] += projection[4*k + row]*modelview[4*column + k];
+		}
+
+	// A point p is inside, if -w <= x, y, z <= w for (x, y, z, w) = clip*p.
+	// Each of these inequalities is a plane (Gribb and Hartmann, "Fast
+	// Extraction of Viewing Frustum Planes from the World-View-Projection
+	// Matrix").
+	for (int i = 0; i < 6; i++) {
+
+		int   row  = i/2;
+		float sign = (i%2 == 0 ? 1.0f : -1.0f);
+
+		for (int column = 0; column < 4; column++)
+			_planes[i][column] = clip[4*column + 3] + sign*clip[4*column + row];
+	}
+}
+
+Frustum
+Frustum::fromOpenGl() {
+
+	float projection[16];
+	float modelview[16];
+
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+
+	return Frustum(projection, modelview);
+}
+
+Frustum::Classification
+Frustum::classify(const BoundingBox& box) const {
+
+	Classification classification = Inside;
+
+	for (int i = 0; i < 6; i++) {
+
+		const float* plane = _planes[i];
+
+		// the corners of the box that are farthest inside and outside of
+		// the plane
+		float insideX  = (plane[0] > 0 ? box.getMaxX() : box.getMinX());
+		float insideY  = (plane[1] > 0 ? box.getMaxY() : box.getMinY());
+		float insideZ  = (plane[2] > 0 ? box.getMaxZ() : box.getMinZ());
+		float outsideX = (plane[0] > 0 ? box.getMinX() : box.getMaxX());
+		float outsideY = (plane[1] > 0 ? box.getMinY() : box.getMaxY());
+		float outsideZ = (plane[2] > 0 ? box.getMinZ() : box.getMaxZ());
+
+		if (plane[0]*insideX + plane[1]*insideY + plane[2]*insideZ + plane[3] < 0)
+			return Outside;
+
+		if (plane[0]*outsideX + plane[1]*outsideY + plane[2]*outsideZ + plane[3] < 0)
+			classification = Intersecting;
+	}
+
+	return classification;
+}
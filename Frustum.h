@@ -0,0 +1,54 @@
+#ifndef GUI_FRUSTUM_H__
+#define GUI_FRUSTUM_H__
+
+#include <imageprocessing/Volume.h>
+
+/**
+ * The view frustum of a projection, as six planes in object coordinates.
+ * Used to find out which parts of a scene can be visible.
+ */
+class Frustum {
+
+public:
+
+	enum Classification {
+
+		Outside,
+		Intersecting,
+		Inside
+	};
+
+	/**
+	 * Create a frustum that contains everything.
+	 */
+	Frustum();
+
+	/**
+	 * Create the frustum of the given projection and modelview matrices (4x4,
+	 * column major, as returned by glGetFloatv()).
+	 */
+	Frustum(const float* projection, const float* modelview);
+
+	/**
+	 * Get the frustum of the current OpenGl projection and modelview
+	 * matrices.
+	 */
+	static Frustum fromOpenGl();
+
+	/**
+	 * Find out whether the given box is completely outside of the frustum,
+	 * completely inside, or (possibly) intersecting its border. Boxes close
+	 * to the corners of the frustum can be classified as intersecting,
+	 * although they are outside.
+	 */
+	Classification classify(const BoundingBox& box) const;
+
+private:
+
+	// the planes as (a, b, c, d), such that the inside of the frustum is
+	// where ax + by + cz + d >= 0
+	float _planes[6][4];
+};
+
+#endif // GUI_FRUSTUM_H__
+
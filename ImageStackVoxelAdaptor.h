@@ -0,0 +1,37 @@
+#ifndef GUI_IMAGE_STACK_VOXEL_ADAPTOR_H__
+#define GUI_IMAGE_STACK_VOXEL_ADAPTOR_H__
+
+#include <imageprocessing/ImageStack.h>
+#include <imageprocessing/ImageStackVolumeAdaptor.h>
+
+/**
+ * An ImageStackVolumeAdaptor that additionally gives access to the voxels of 
+ * the image stack in memory, such that it can be used as a dense volume in 
+ * MarchingCubes.
+ */
+class ImageStackVoxelAdaptor : public ImageStackVolumeAdaptor {
+
+public:
+
+	typedef ImageStackVolumeAdaptor::value_type value_type;
+
+	// mark this volume as dense, see VolumeSampler
+	typedef void dense_volume_tag;
+
+	ImageStackVoxelAdaptor(const ImageStack& stack) :
+		ImageStackVolumeAdaptor(stack),
+		_stack(stack) {}
+
+	unsigned int getVoxelsX() const { return _stack.width(); }
+	unsigned int getVoxelsY() const { return _stack.height(); }
+	unsigned int getVoxelsZ() const { return _stack.size(); }
+
+	const value_type* getSection(unsigned int z) const { return _stack[z]->data(); }
+
+private:
+
+	const ImageStack& _stack;
+};
+
+#endif // GUI_IMAGE_STACK_VOXEL_ADAPTOR_H__
+
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <set>
+#include <util/Logger.h>
+#include "LabelIndex.h"
+
+logger::LogChannel labelindexlog("labelindexlog", "[LabelIndex] ");
+
+LabelIndex::LabelIndex(unsigned int background) :
+	_background(background),
+	_width(0),
+	_height(0) {}
+
+void
+LabelIndex::build(const ImageStack& stack) {
+
+	_width  = stack.width();
+	_height = stack.height();
+
+	_sections.clear();
+	_sections.resize(stack.size());
+	_labels.clear();
+
+	for (unsigned int z = 0; z < stack.size(); z++) {
+
+		indexSection(stack, z);
+
+		Entries::const_iterator i;
+		for (i = _sections[z].begin(); i != _sections[z].end(); i++)
+			_labels[i->first].fit(i->second);
+	}
+
+	LOG_DEBUG(labelindexlog) << "found " << _labels.size() << " labels in " << _sections.size() << " sections" << std::endl;
+}
+
+void
+LabelIndex::updateSection(const ImageStack& stack, unsigned int section) {
+
+	// the labels that were or are in this section
+	std::set<unsigned int> labels;
+
+	Entries::const_iterator i;
+	for (i = _sections[section].begin(); i != _sections[section].end(); i++)
+		labels.insert(i->first);
+
+	indexSection(stack, section);
+
+	for (i = _sections[section].begin(); i != _sections[section].end(); i++)
+		labels.insert(i->first);
+
+	for (std::set<unsigned int>::const_iterator label = labels.begin(); label != labels.end(); label++)
+		updateLabel(*label);
+}
+
+std::vector<unsigned int>
+LabelIndex::getLabels() const {
+
+	std::vector<unsigned int> labels;
+	labels.reserve(_labels.size());
+
+	Entries::const_iterator i;
+	for (i = _labels.begin(); i != _labels.end(); i++)
+		labels.push_back(i->first);
+
+	return labels;
+}
+
+unsigned int
+LabelIndex::getNumVoxels(unsigned int label) const {
+
+	Entries::const_iterator i = _labels.find(label);
+
+	if (i == _labels.end())
+		return 0;
+
+	return i->second.numVoxels;
+}
+
+BoundingBox
+LabelIndex::getBoundingBox(unsigned int label) const {
+
+	Entries::const_iterator i = _labels.find(label);
+
+	if (i == _labels.end())
+		return BoundingBox();
+
+	const Entry& entry = i->second;
+
+	return BoundingBox(
+			entry.minX, entry.minY, entry.minZ,
+			entry.maxX, entry.maxY, entry.maxZ);
+}
+
+void
+LabelIndex::indexSection(const ImageStack& stack, unsigned int section) {
+
+	Entries& entries = _sections[section];
+	entries.clear();
+
+	const Image& image = *stack[section];
+
+	for (unsigned int y = 0; y < _height; y++) {
+
+		// look at runs of equal labels, such that the map is accessed once per 
+		// run only
+		unsigned int x = 0;
+		while (x < _width) {
+
+			unsigned int label = image(x, y);
+			unsigned int begin = x;
+
+			while (x < _width && static_cast<unsigned int>(image(x, y)) == label)
+				x++;
+
+			if (label == _background)
+				continue;
+
+			Entry run;
+			run.minX = begin;
+			run.maxX = x;
+			run.minY = y;
+			run.maxY = y + 1;
+			run.minZ = section;
+			run.maxZ = section + 1;
+			run.numVoxels = x - begin;
+
+			entries[label].fit(run);
+		}
+	}
+}
+
+void
+LabelIndex::updateLabel(unsigned int label) {
+
+	Entry entry;
+
+	for (unsigned int z = 0; z < _sections.size(); z++) {
+
+		Entries::const_iterator i = _sections[z].find(label);
+
+		if (i != _sections[z].end())
+			entry.fit(i->second);
+	}
+
+	if (entry.numVoxels == 0)
+		_labels.erase(label);
+	else
+		_labels[label] = entry;
+}
+
+void
+LabelIndex::Entry::fit(const Entry& other) {
+
+	if (numVoxels == 0) {
+
+		*this = other;
+		return;
+	}
+
+	minX = std::min(minX, other.minX);
+	minY = std::min(minY, other.minY);
+	minZ = std::min(minZ, other.minZ);
+	maxX = std::max(maxX, other.maxX);
+	maxY = std::max(maxY, other.maxY);
+	maxZ = std::max(maxZ, other.maxZ);
+	numVoxels += other.numVoxels;
+}
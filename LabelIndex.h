@@ -0,0 +1,95 @@
+#ifndef GUI_LABEL_INDEX_H__
+#define GUI_LABEL_INDEX_H__
+
+#include <map>
+#include <vector>
+#include <imageprocessing/ImageStack.h>
+#include <imageprocessing/Volume.h>
+
+/**
+ * An index of the labels in an image stack. For each label, the number of 
+ * voxels and the voxel bounding box is stored, such that surfaces can be 
+ * extracted from the part of the stack that contains the label only.
+ *
+ * The index is kept per section, such that it can be updated for a single 
+ * edited section without scanning the whole stack again.
+ */
+class LabelIndex {
+
+public:
+
+	/**
+	 * Create an index for the non-background labels of an image stack.
+	 *
+	 * @param background
+	 *              The label to ignore.
+	 */
+	LabelIndex(unsigned int background = 0);
+
+	/**
+	 * (Re-)build the index for the given stack.
+	 */
+	void build(const ImageStack& stack);
+
+	/**
+	 * Update the index after the given section of the stack has been 
+	 * changed. The stack has to be the one the index was built for.
+	 */
+	void updateSection(const ImageStack& stack, unsigned int section);
+
+	/**
+	 * Get all labels in the stack in increasing order.
+	 */
+	std::vector<unsigned int> getLabels() const;
+
+	/**
+	 * Get the number of voxels of a label.
+	 */
+	unsigned int getNumVoxels(unsigned int label) const;
+
+	/**
+	 * Get the bounding box of a label in voxel coordinates (i.e., the maximum 
+	 * is one past the last voxel of the label). The bounding box is invalid 
+	 * if the label is not in the stack.
+	 */
+	BoundingBox getBoundingBox(unsigned int label) const;
+
+private:
+
+	// the extent of a label in a section or in the whole stack
+	struct Entry {
+
+		Entry() :
+			minX(0), minY(0), minZ(0),
+			maxX(0), maxY(0), maxZ(0),
+			numVoxels(0) {}
+
+		void fit(const Entry& other);
+
+		unsigned int minX, minY, minZ;
+		unsigned int maxX, maxY, maxZ;
+		unsigned int numVoxels;
+	};
+
+	typedef std::map<unsigned int, Entry> Entries;
+
+	// find the labels in one section of the stack
+	void indexSection(const ImageStack& stack, unsigned int section);
+
+	// recompute the stack entry of a label from its section entries
+	void updateLabel(unsigned int label);
+
+	unsigned int _background;
+
+	unsigned int _width;
+	unsigned int _height;
+
+	// the labels in each section
+	std::vector<Entries> _sections;
+
+	// the labels in the whole stack
+	Entries _labels;
+};
+
+#endif // GUI_LABEL_INDEX_H__
+
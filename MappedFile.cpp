@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/exceptions.h>
+#include <util/Logger.h>
+#include "MappedFile.h"
+
+static logger::LogChannel mappedfilelog("mappedfilelog", "[MappedFile] ");
+
+MappedFile::MappedFile(const std::string& filename) :
+	_data(0),
+	_size(0),
+	_pageSize(sysconf(_SC_PAGESIZE)) {
+
+	int fd = open(filename.c_str(), O_RDONLY);
+
+	if (fd < 0)
+		BOOST_THROW_EXCEPTION(IOError() << error_message("can not open " + filename) << STACK_TRACE);
+
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+
+		close(fd);
+		BOOST_THROW_EXCEPTION(IOError() << error_message("can not stat " + filename) << STACK_TRACE);
+	}
+
+	_size = status.st_size;
+
+	if (_size > 0) {
+
+		void* data = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED) {
+
+			close(fd);
+			BOOST_THROW_EXCEPTION(IOError() << error_message("can not map " + filename) << STACK_TRACE);
+		}
+
+		_data = static_cast<const char*>(data);
+
+		// we expect the file to be read front to back
+		madvise(data, _size, MADV_SEQUENTIAL);
+	}
+
+	// the mapping stays valid without the file descriptor
+	close(fd);
+
+	LOG_DEBUG(mappedfilelog) << "mapped " << _size << " bytes of " << filename << std::endl;
+}
+
+MappedFile::~MappedFile() {
+
+	if (_data)
+		munmap(const_cast<char*>(_data), _size);
+}
+
+void
+MappedFile::prefetch(std::size_t begin, std::size_t end) const {
+
+	end = std::min(end, _size);
+
+	// round begin down to the start of its page
+	begin -= begin%_pageSize;
+
+	if (begin >= end)
+		return;
+
+	madvise(const_cast<char*>(_data + begin), end - begin, MADV_WILLNEED);
+}
+
+void
+MappedFile::release(std::size_t begin, std::size_t end) const {
+
+	// only pages that lie completely in [begin, end), unless end is the end
+	// of the file
+	begin = ((begin + _pageSize - 1)/_pageSize)*_pageSize;
+	if (end < _size)
+		end -= end%_pageSize;
+	else
+		end = _size;
+
+	if (begin >= end)
+		return;
+
+	madvise(const_cast<char*>(_data + begin), end - begin, MADV_DONTNEED);
+}
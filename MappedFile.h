@@ -0,0 +1,60 @@
+#ifndef GUI_MAPPED_FILE_H__
+#define GUI_MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+/**
+ * A read-only memory mapping of a whole file. Pages are read on demand when
+ * they are accessed first and can be handed back to the operating system
+ * with release(), such that the resident part of the file stays small even
+ * if the file is much larger than the main memory.
+ */
+class MappedFile : boost::noncopyable {
+
+public:
+
+	/**
+	 * Map the given file. Throws an IOError if the file can not be opened or
+	 * mapped.
+	 */
+	MappedFile(const std::string& filename);
+
+	~MappedFile();
+
+	/**
+	 * Pointer to the first byte of the file.
+	 */
+	const char* data() const { return _data; }
+
+	/**
+	 * The size of the file in bytes.
+	 */
+	std::size_t size() const { return _size; }
+
+	/**
+	 * Tell the operating system that the bytes [begin, end) will be needed
+	 * soon.
+	 */
+	void prefetch(std::size_t begin, std::size_t end) const;
+
+	/**
+	 * Tell the operating system that the bytes [begin, end) are not needed
+	 * anymore. The memory of all pages that lie completely in this range is
+	 * freed. The pages are read again from the file if they are accessed
+	 * later.
+	 */
+	void release(std::size_t begin, std::size_t end) const;
+
+private:
+
+	const char* _data;
+
+	std::size_t _size;
+
+	std::size_t _pageSize;
+};
+
+#endif // GUI_MAPPED_FILE_H__
+
@@ -0,0 +1,110 @@
+#ifndef GUI_MAPPED_VOLUME_H__
+#define GUI_MAPPED_VOLUME_H__
+
+#include <string>
+#include <util/exceptions.h>
+#include <imageprocessing/Volume.h>
+#include "MappedFile.h"
+
+/**
+ * A dense volume (see VolumeSampler) that reads its voxels from a memory-
+ * mapped raw file. The file contains width*height*depth values of type
+ * ValueType (in native byte order), row by row and section by section,
+ * optionally after a header of the given number of bytes.
+ *
+ * Sections are read from the file only when they are accessed. Sections that
+ * are not needed anymore can be released with releaseSections(), such that
+ * volumes much larger than the main memory can be processed (see
+ * MarchingCubes::generateSurfaceStreaming()).
+ */
+template <typename ValueType>
+class MappedVolume : public Volume {
+
+public:
+
+	typedef ValueType value_type;
+
+	// mark this volume as dense, see VolumeSampler
+	typedef void dense_volume_tag;
+
+	MappedVolume(
+			const std::string& filename,
+			unsigned int width,
+			unsigned int height,
+			unsigned int depth,
+			std::size_t headerSize = 0) :
+		_file(filename),
+		_width(width),
+		_height(height),
+		_depth(depth),
+		_headerSize(headerSize) {
+
+		if (_file.size() < _headerSize + getSectionSize()*_depth)
+			BOOST_THROW_EXCEPTION(
+					IOError()
+					<< error_message(filename + " is too small for the given volume size")
+					<< STACK_TRACE);
+	}
+
+	unsigned int getVoxelsX() const { return _width; }
+	unsigned int getVoxelsY() const { return _height; }
+	unsigned int getVoxelsZ() const { return _depth; }
+
+	const value_type* getSection(unsigned int z) const {
+
+		return reinterpret_cast<const value_type*>(_file.data() + getSectionOffset(z));
+	}
+
+	value_type operator()(float x, float y, float z) const {
+
+		if (!getBoundingBox().contains(x, y, z))
+			return value_type(0);
+
+		return getSection(static_cast<unsigned int>(z))[
+				static_cast<unsigned int>(y)*_width +
+				static_cast<unsigned int>(x)];
+	}
+
+	/**
+	 * Announce that the sections [begin, end) will be accessed soon.
+	 */
+	void prefetchSections(unsigned int begin, unsigned int end) const {
+
+		_file.prefetch(getSectionOffset(begin), getSectionOffset(end));
+	}
+
+	/**
+	 * Free the memory of the sections [begin, end). They will be read from
+	 * the file again if they are accessed later.
+	 */
+	void releaseSections(unsigned int begin, unsigned int end) const {
+
+		_file.release(getSectionOffset(begin), getSectionOffset(end));
+	}
+
+private:
+
+	BoundingBox computeBoundingBox() const {
+
+		return BoundingBox(0, 0, 0, _width, _height, _depth);
+	}
+
+	std::size_t getSectionSize() const {
+
+		return static_cast<std::size_t>(_width)*_height*sizeof(value_type);
+	}
+
+	std::size_t getSectionOffset(unsigned int z) const {
+
+		return _headerSize + z*getSectionSize();
+	}
+
+	MappedFile _file;
+
+	unsigned int _width, _height, _depth;
+
+	std::size_t _headerSize;
+};
+
+#endif // GUI_MAPPED_VOLUME_H__
+
@@ -12,55 +12,33 @@
 // CIsoSurface can be used to construct an isosurface from a scalar
 // field.
 
+#include <algorithm>
+#include <cmath>
 #include <map>
+#include <set>
 #include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/timer/timer.hpp>
 #include <util/Logger.h>
+#include "CellClassification.h"
+#include "ThreadPool.h"
 #include "Point3d.h"
 #include "Vector3d.h"
+#include "Triangle.h"
 #include "Mesh.h"
+#include "Meshes.h"
+#include "MeshNormals.h"
+#include "MinMaxPyramid.h"
+#include "VolumeSampler.h"
 
 extern logger::LogChannel marchingcubeslog;
 
-/**
- * A point in 3D with an id.
- */
-struct Point3dId {
-
-	unsigned int newId;
-	float x, y, z;
-
-	// default constructor
-	Point3dId() {}
-
-	// construction from Point3d
-	Point3dId(const Point3d& p) :
-		newId(0), x(p.x), y(p.y), z(p.z) {};
-
-	// conversion to regular Point3d
-	operator Point3d () {
-		return Point3d(x, y, z);
-	}
-};
-
-/**
- * A map of ids to points.
- */
-typedef std::map<unsigned int, Point3dId> Id2Point3dId;
-
-/**
- * Triples of points that form a triangle.
- */
-struct TriangleId {
-	unsigned int pointId[3];
-};
-
-/**
- * A vector of triangles.
- */
-typedef std::vector<TriangleId> TriangleVector;
-
 /**
  * Generic marching cubes implementation for volumes that implement:
  *
@@ -74,12 +52,17 @@ typedef std::vector<TriangleId> TriangleVector;
  *
  *   // access to the data
  *   value_type Volume::operator(float x, float y, float z)
+ *
+ * Volumes that give access to their voxels in memory are read directly, see 
+ * VolumeSampler.
  */
 template <typename Volume>
 class MarchingCubes {
 
 	typedef typename Volume::value_type value_type;
 
+	typedef VolumeSampler<Volume> Sampler;
+
 public:
 
 	/**
@@ -116,9 +99,121 @@ public:
 		value_type reference;
 	};
 
+	/**
+	 * Edge placement policy that places the surface vertex on an edge by a 
+	 * binary search for the change of the interior test between the two 
+	 * corners, using ten samples of the volume. This works for any interior 
+	 * test and is the default.
+	 */
+	struct Bisection {
+
+		template <typename SamplerType, typename InteriorTest>
+		Point3d operator()(
+				const SamplerType& sampler,
+				const InteriorTest& interiorTest,
+				const Point3d& outside,
+				const Point3d& inside,
+				value_type /*outsideValue*/,
+				value_type /*insideValue*/) const {
+
+			Point3d interpolation;
+
+			// binary search for intersection
+			float mu = 0.5;
+			float delta = 0.25;
+
+			// mu == 0 -> outside, mu == 1 -> inside
+			//
+			// incrase  mu -> go to inside
+			// decrease mu -> go to outside
+
+			for (unsigned int i = 0; i < 10; i++, delta /= 2.0) {
+
+				interpolation = outside + mu*(inside - outside);
+
+				if (interiorTest(
+						sampler(
+								interpolation.x,
+								interpolation.y,
+								interpolation.z)))
+					mu -= delta; // go to outside
+				else
+					mu += delta; // go to inside
+			}
+
+			return interpolation;
+		}
+	};
+
+	/**
+	 * Edge placement policy that linearly interpolates the values at the two 
+	 * corners to find the position of the threshold of the interior test. 
+	 * Needs no further samples of the volume. Only applicable with 
+	 * AcceptAbove, i.e., for continuous valued volumes.
+	 */
+	struct LinearInterpolation {
+
+		template <typename SamplerType, typename InteriorTest>
+		Point3d operator()(
+				const SamplerType& /*sampler*/,
+				const InteriorTest& interiorTest,
+				const Point3d& outside,
+				const Point3d& inside,
+				value_type outsideValue,
+				value_type insideValue) const {
+
+			float mu = 0.5;
+
+			if (insideValue != outsideValue)
+				mu = std::min(1.0f, std::max(0.0f,
+						static_cast<float>(interiorTest.threshold - outsideValue)/
+						static_cast<float>(insideValue - outsideValue)));
+
+			return outside + mu*(inside - outside);
+		}
+	};
+
+	/**
+	 * Edge placement policy that places the surface vertex in the middle of 
+	 * the edge. Needs no further samples of the volume. Intended for label 
+	 * volumes, where the values along an edge do not tell where the surface 
+	 * is.
+	 */
+	struct Midpoint {
+
+		template <typename SamplerType, typename InteriorTest>
+		Point3d operator()(
+				const SamplerType& /*sampler*/,
+				const InteriorTest& /*interiorTest*/,
+				const Point3d& outside,
+				const Point3d& inside,
+				value_type /*outsideValue*/,
+				value_type /*insideValue*/) const {
+
+			return outside + 0.5f*(inside - outside);
+		}
+	};
+
 	// Constructor and destructor.
 	MarchingCubes();
 	~MarchingCubes();
+
+	/**
+	 * Set the number of threads to use for the surface generation. If set to 
+	 * 0, one thread per hardware thread will be used. The default is 1. The 
+	 * threads are created with the first extraction that needs them and 
+	 * reused by all following extractions.
+	 */
+	void setNumThreads(unsigned int numThreads);
+
+	/**
+	 * Set a min/max pyramid of the volume to skip blocks of cells that can 
+	 * not contain the surface. The pyramid has to be built for the volume 
+	 * passed to the following extractions. It is only used for dense volumes 
+	 * (see VolumeSampler), for the interior tests AcceptAbove and 
+	 * AcceptExactly, and for generateSurfaces().
+	 */
+	void setMinMaxPyramid(boost::shared_ptr<const MinMaxPyramid<value_type> > pyramid) { _pyramid = pyramid; }
 	
 	/**
 	 * Generate an iso-surface mesh from a volume. For that, the volume is 
@@ -126,6 +221,17 @@ public:
 	 * compared to the provided isoLevel, and replaced by a mesh approximating 
 	 * the iso surface.
 	 *
+	 * The volume is processed one z-slab of cells at a time. Vertices are 
+	 * numbered in the order in which they are first used by a triangle, such 
+	 * that only the vertex indices of the edges on the two lattice planes 
+	 * enclosing the current slab have to be remembered.
+	 *
+	 * If more than one thread is used (see setNumThreads()), the volume is 
+	 * split into chunks of z-slabs that are processed in parallel. The 
+	 * vertices on the lattice planes between two chunks are welded 
+	 * afterwards, such that the resulting mesh is identical to the one 
+	 * obtained with a single thread.
+	 *
 	 * @param volume
 	 *              The volume.
 	 * @param cellSizeX
@@ -143,6 +249,170 @@ public:
 			float cellSizeY,
 			float cellSizeZ);
 
+	/**
+	 * Same as generateSurface() above, but only visits the cells that can 
+	 * sample the given region of the volume. The cells are the ones of the 
+	 * whole volume, such that the resulting mesh is identical to the one of 
+	 * the whole volume, as long as the interior is contained in the region.
+	 *
+	 * @param region
+	 *              The part of the volume to extract the surface from.
+	 */
+	template <typename InteriorTest>
+	boost::shared_ptr<Mesh> generateSurface(
+			const Volume& volume,
+			const InteriorTest& interiorTest,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			const BoundingBox& region);
+
+	/**
+	 * Same as generateSurface() above, with a policy to place the vertices 
+	 * on the intersected edges of the cells (one of Bisection, 
+	 * LinearInterpolation, or Midpoint).
+	 *
+	 * @param edgePlacement
+	 *              The edge placement policy.
+	 */
+	template <typename InteriorTest, typename EdgePlacement>
+	boost::shared_ptr<Mesh> generateSurface(
+			const Volume& volume,
+			const InteriorTest& interiorTest,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			const BoundingBox& region,
+			const EdgePlacement& edgePlacement);
+
+	/**
+	 * Same as generateSurface(), but for dense volumes that do not fit into 
+	 * memory (like MappedVolume). The cells are processed in passes of a few 
+	 * planes per thread, and the triangles found are welded into the growing 
+	 * mesh right away. While a pass is processed, the sections of the next 
+	 * pass are read ahead. After each pass, the sections of the volume that 
+	 * are not needed for the remaining cells are released, such that only a 
+	 * window of sections of the size of two passes is resident, independent 
+	 * of the depth of the volume. The volume has to implement
+	 *
+	 *   // announce that sections [begin, end) will be accessed soon
+	 *   void Volume::prefetchSections(unsigned int begin, unsigned int end)
+	 *
+	 *   // free the memory of sections [begin, end)
+	 *   void Volume::releaseSections(unsigned int begin, unsigned int end)
+	 *
+	 * The resulting mesh is identical to the one of generateSurface().
+	 */
+	template <typename InteriorTest>
+	boost::shared_ptr<Mesh> generateSurfaceStreaming(
+			const Volume& volume,
+			const InteriorTest& interiorTest,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ);
+
+	/**
+	 * Same as generateSurfaceStreaming() above, with a policy to place the 
+	 * vertices on the intersected edges of the cells.
+	 */
+	template <typename InteriorTest, typename EdgePlacement>
+	boost::shared_ptr<Mesh> generateSurfaceStreaming(
+			const Volume& volume,
+			const InteriorTest& interiorTest,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			const EdgePlacement& edgePlacement);
+
+	/**
+	 * Generate one iso-surface mesh for each label in a volume of labels in a 
+	 * single pass. Each cell is visited only once: For every label found at 
+	 * the corners of the cell, the cell is classified with 
+	 * AcceptExactly(label) and triangulated into the mesh of that label. The 
+	 * result is the same as calling generateSurface() with 
+	 * AcceptExactly(label) for each label.
+	 *
+	 * @param volume
+	 *              The volume.
+	 * @param cellSizeX
+	 *              The size of a cell in x to sample.
+	 * @param cellSizeY
+	 *              The size of a cell in y to sample.
+	 * @param cellSizeZ
+	 *              The size of a cell in z to sample.
+	 * @param background
+	 *              The label for which no surface should be extracted.
+	 */
+	boost::shared_ptr<Meshes> generateSurfaces(
+			const Volume& volume,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			value_type background = 0);
+
+	/**
+	 * Same as generateSurfaces() above, with a policy to place the vertices 
+	 * on the intersected edges of the cells (Bisection or Midpoint).
+	 *
+	 * @param edgePlacement
+	 *              The edge placement policy.
+	 */
+	template <typename EdgePlacement>
+	boost::shared_ptr<Meshes> generateSurfaces(
+			const Volume& volume,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			value_type background,
+			const EdgePlacement& edgePlacement);
+
+	/**
+	 * Update the surfaces of a volume of labels after the volume changed in 
+	 * the given region. The meshes have to be the result of 
+	 * generateSurfaces() (or of generateSurface() with AcceptExactly(label) 
+	 * for each label) for the same cell size and edge placement.
+	 *
+	 * Only the cells that sample the dirty region and a border of one cell 
+	 * around them are visited again. In each mesh, the triangles of these 
+	 * cells are replaced by the new ones, which are welded to the remaining 
+	 * triangles along the border of the visited cells. The remaining 
+	 * vertices, normals, and triangles keep their order, such that the cost 
+	 * depends on the size of the dirty region and the size of the affected 
+	 * meshes, but not on the size of the volume. Meshes without triangles 
+	 * are removed, meshes for new labels are added.
+	 *
+	 * The min/max pyramid (see setMinMaxPyramid()) is not used, since it 
+	 * might not reflect the changes.
+	 *
+	 * @param dirtyRegion
+	 *              The part of the volume that changed.
+	 * @param meshes
+	 *              The meshes to update.
+	 */
+	void updateSurfaces(
+			const Volume& volume,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			const BoundingBox& dirtyRegion,
+			Meshes& meshes,
+			value_type background = 0);
+
+	/**
+	 * Same as updateSurfaces() above, with a policy to place the vertices on 
+	 * the intersected edges of the cells.
+	 */
+	template <typename EdgePlacement>
+	void updateSurfaces(
+			const Volume& volume,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ,
+			const BoundingBox& dirtyRegion,
+			Meshes& meshes,
+			value_type background,
+			const EdgePlacement& edgePlacement);
+
 	/**
 	 * Returns true if a valid surface has been generated.
 	 */
@@ -162,49 +432,291 @@ public:
 
 private:
 
-	// get the value in the volume corresponding to the given location in cell 
-	// coordinates
-	inline value_type getValue(const Volume& volume, int x, int y, int z) {
+	/**
+	 * A range of z-slabs [beginZ, endZ) to be processed at once.
+	 */
+	struct SlabRange {
+
+		SlabRange() :
+			visitedCells(0),
+			skippedCells(0) {}
 
-		return volume(
-				volume.getBoundingBox().getMinX() + (x-1)*_cellSizeX,
-				volume.getBoundingBox().getMinY() + (y-1)*_cellSizeY,
-				volume.getBoundingBox().getMinZ() + (z-1)*_cellSizeZ);
+		unsigned int beginZ;
+		unsigned int endZ;
+
+		// the number of cells looked at and the number of cells skipped with 
+		// the help of the min/max pyramid
+		unsigned long visitedCells;
+		unsigned long skippedCells;
+	};
+
+	// a range [first, second) of cells in x
+	typedef std::pair<unsigned int, unsigned int> Span;
+
+	// interior test for generateSurfaces(), used to find blocks of cells 
+	// with more than one label
+	struct AnyLabel {};
+
+	// the size of the blocks of cells that can be skipped
+	static const unsigned int CellBlockSize = 8;
+
+	// the number of planes of cells per chunk in generateSurfaceStreaming()
+	static const unsigned int StreamingChunkSize = 8;
+
+	/**
+	 * The vertices and triangles found in a range of z-slabs.
+	 */
+	struct Chunk : public SlabRange {
+
+		// List of vertices which form the isosurface.
+		std::vector<Point3d> vertices;
+
+		// List of triangles which form the triangulation of the isosurface.
+		std::vector<Triangle> triangles;
+
+		// The indices of the vertices on the edges starting at each lattice 
+		// point of the lower (0) and upper (1) plane of the current slab, 
+		// three per lattice point (for the edges along x, y, and z).
+		std::vector<unsigned int> slabVertices[2];
+
+		// The vertex indices of the first (beginZ) and last (endZ) lattice 
+		// plane of this chunk, kept to weld neighboring chunks.
+		std::vector<unsigned int> firstPlane;
+		std::vector<unsigned int> lastPlane;
+	};
+
+	// maps from label index and edge index to vertex indices
+	typedef boost::unordered_map<boost::uint64_t, unsigned int> EdgeVertexMap;
+
+	/**
+	 * The vertices and triangles of all labels found in a range of z-slabs.
+	 */
+	struct LabelChunk : public SlabRange {
+
+		// the labels found in this chunk and their index in this chunk
+		std::vector<value_type> labels;
+		boost::unordered_map<value_type, unsigned int> labelIndices;
+
+		// vertices and triangles for each label index
+		std::vector<std::vector<Point3d> >  vertices;
+		std::vector<std::vector<Triangle> > triangles;
+
+		// the vertex indices of the edges on the lower (0) and upper (1) 
+		// lattice plane of the current slab
+		EdgeVertexMap slabVertices[2];
+
+		// for each label index, pairs of edge index and vertex index of the 
+		// x- and y-edges on the first lattice plane of this chunk
+		std::vector<std::vector<std::pair<unsigned int, unsigned int> > > firstPlane;
+
+		// the vertex indices of the edges on the last lattice plane
+		EdgeVertexMap lastPlane;
+
+		// get the index of a label in this chunk, add it if needed
+		unsigned int getLabelIndex(value_type label) {
+
+			typename boost::unordered_map<value_type, unsigned int>::iterator i = labelIndices.find(label);
+
+			if (i != labelIndices.end())
+				return i->second;
+
+			unsigned int index = labels.size();
+			labelIndices[label] = index;
+			labels.push_back(label);
+			vertices.resize(index + 1);
+			triangles.resize(index + 1);
+			firstPlane.resize(index + 1);
+
+			return index;
+		}
+	};
+
+	// Set the number and size of cells to cover the given volume.
+	void setupCells(
+			const Volume& volume,
+			float cellSizeX,
+			float cellSizeY,
+			float cellSizeZ);
+
+	// Limit the cells to visit to the ones that can sample the given region.
+	void restrictCells(const BoundingBox& region);
+
+	// Split the volume into chunks of z-slabs and process them, in parallel 
+	// if more than one thread is used.
+	template <typename ChunkType>
+	void processChunks(
+			std::vector<ChunkType>& chunks,
+			const boost::function<void(ChunkType&)>& process);
+
+	// Get the thread pool to process chunks with, create it on first use. 
+	// Returns 0 if only one thread is used.
+	ThreadPool* getThreadPool();
+
+	// Process the given chunks, in parallel if a thread pool is given.
+	template <typename ChunkType>
+	void runChunks(
+			std::vector<ChunkType>& chunks,
+			const boost::function<void(ChunkType&)>& process,
+			ThreadPool* pool);
+
+	// Create a sampler for the lattice of the current cells.
+	Sampler createSampler(const Volume& volume) const;
+
+	// Find the blocks of cells that might contain the surface of the given 
+	// interior test, using the min/max pyramid (if set).
+	template <typename InteriorTest>
+	void findActiveBlocks(const Sampler& sampler, const InteriorTest& interiorTest);
+
+	// Get the ranges of cells of the row (y, z) that might contain the 
+	// surface.
+	void getActiveSpans(unsigned int y, unsigned int z, std::vector<Span>& spans) const;
+
+	// Sum up and report the numbers of visited and skipped cells.
+	template <typename ChunkType>
+	void logCellStatistics(const std::vector<ChunkType>& chunks) const;
+
+	// Check whether the result of the interior test can change for values in 
+	// [min, max].
+	template <typename InteriorTest>
+	bool mayCross(value_type, value_type, const InteriorTest&) const { return true; }
+	bool mayCross(value_type min, value_type max, const AcceptAbove& interiorTest) const {
+
+		return max > interiorTest.threshold && !(min > interiorTest.threshold);
 	}
+	bool mayCross(value_type min, value_type max, const AcceptExactly& interiorTest) const {
 
-	// Returns the edge Id.
-	unsigned int GetEdgeId(unsigned int nX, unsigned int nY, unsigned int nZ, unsigned int nEdgeNo);
+		return min <= interiorTest.reference && interiorTest.reference <= max && min != max;
+	}
+	bool mayCross(value_type min, value_type max, const AnyLabel&) const {
 
-	// Returns the vertex Id.
-	unsigned int GetVertexId(unsigned int nX, unsigned int nY, unsigned int nZ);
+		return min != max;
+	}
 
-	// Calculates the intersection point of the isosurface with an
-	// edge.
+	// Mark the values that are exterior according to the interior test with 
+	// 0xff, the others with 0x00. The tests provided by MarchingCubes are 
+	// classified with vectorized kernels.
 	template <typename InteriorTest>
-	Point3dId CalculateIntersection(
-			const Volume& volume,
+	void classify(const value_type* values, unsigned int n, const InteriorTest& interiorTest, unsigned char* exterior) const {
+
+		for (unsigned int i = 0; i < n; i++)
+			exterior[i] = (interiorTest(values[i]) ? 0x00 : 0xff);
+	}
+	void classify(const value_type* values, unsigned int n, const AcceptAbove& interiorTest, unsigned char* exterior) const {
+
+		classifyAbove(values, n, interiorTest.threshold, exterior);
+	}
+	void classify(const value_type* values, unsigned int n, const AcceptExactly& interiorTest, unsigned char* exterior) const {
+
+		classifyExactly(values, n, interiorTest.reference, exterior);
+	}
+
+	// get the location of a lattice point in volume coordinates
+	inline Point3d getLatticePoint(int x, int y, int z) const {
+
+		return Point3d(
+				_minX + (x-1)*_cellSizeX,
+				_minY + (y-1)*_cellSizeY,
+				_minZ + (z-1)*_cellSizeZ);
+	}
+
+	// Find the vertices and triangles of all cells in the z-slabs of the 
+	// given chunk.
+	template <typename InteriorTest, typename EdgePlacement>
+	void processChunk(
+			const Sampler& sampler,
 			const InteriorTest& interiorTest,
-			unsigned int nX,
-			unsigned int nY,
-			unsigned int nZ,
-			unsigned int nEdgeNo);
-
-	// Find the point between an interior and an exterior point where the 
-	// surface starts. p1 is assumed to be exterior, p2 is assumed to be 
-	// interior.
-	template <typename InteriorTest>
-	Point3dId findSurfaceIntersection(
-			const Volume& volume,
+			const EdgePlacement& edgePlacement,
+			Chunk& chunk) const;
+
+	// Find the vertices and triangles of all labels in the cells of the 
+	// z-slabs of the given chunk.
+	template <typename EdgePlacement>
+	void processLabelChunk(
+			const Sampler& sampler,
+			value_type background,
+			const EdgePlacement& edgePlacement,
+			LabelChunk& chunk) const;
+
+	// Get the index of the vertex on the given edge of cell (x, y, z). If the 
+	// vertex does not exist yet, it is created.
+	template <typename InteriorTest, typename EdgePlacement>
+	unsigned int getEdgeVertex(
+			const Sampler& sampler,
 			const InteriorTest& interiorTest,
-			const Point3d& p1,
-			const Point3d& p2);
- 
-	// Renames vertices and triangles so that they can be accessed more
-	// efficiently.
-	void RenameVerticesAndTriangles();
+			const EdgePlacement& edgePlacement,
+			Chunk& chunk,
+			unsigned int x,
+			unsigned int y,
+			unsigned int z,
+			unsigned int edge) const;
+
+	// Same as getEdgeVertex() for the surface of the label with the given 
+	// index in a LabelChunk.
+	template <typename EdgePlacement>
+	unsigned int getLabelEdgeVertex(
+			const Sampler& sampler,
+			const EdgePlacement& edgePlacement,
+			LabelChunk& chunk,
+			unsigned int labelIndex,
+			unsigned int x,
+			unsigned int y,
+			unsigned int z,
+			unsigned int edge) const;
+
+	// Calculates the intersection point of the isosurface with the edge 
+	// starting at lattice point (x, y, z) along the given axis (0, 1, 2 for 
+	// x, y, z).
+	template <typename InteriorTest, typename EdgePlacement>
+	Point3d CalculateIntersection(
+			const Sampler& sampler,
+			const InteriorTest& interiorTest,
+			const EdgePlacement& edgePlacement,
+			unsigned int x,
+			unsigned int y,
+			unsigned int z,
+			unsigned int axis) const;
+
+	// Forget the vertices of the lower lattice plane and make the upper plane 
+	// the new lower plane.
+	void advanceSlab(Chunk& chunk) const;
+
+	// Announce the sections of the volume needed by the cells in planes 
+	// [beginZ, endZ) to the volume, see generateSurfaceStreaming().
+	void prefetchSections(const Volume& volume, const Sampler& sampler, unsigned int beginZ, unsigned int endZ) const;
+
+	// Weld the chunks along their shared lattice planes and append the found 
+	// vertices and triangles to the mesh. seam contains the mesh vertex 
+	// indices of the edges of the last lattice plane stitched so far (empty 
+	// for the first call) and is updated for the next call.
+	void stitchChunks(std::vector<Chunk>& chunks, std::vector<unsigned int>& seam);
+
+	// Same as stitchChunks() for each label, creates one mesh per label.
+	boost::shared_ptr<Meshes> stitchLabelChunks(std::vector<LabelChunk>& chunks) const;
+
+	// Replace the triangles of the current cells in the mesh with the ones 
+	// of the patch (which may be null), welding the vertices on the border of 
+	// the current cells.
+	void spliceSurface(Mesh& mesh, const Mesh* patch) const;
+
+	// lexicographic order of points, to find vertices at the same position
+	struct PointLess {
+
+		bool operator()(const Point3d& a, const Point3d& b) const {
+
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		}
+	};
+
+	// Get the index of an edge on a lattice plane.
+	inline unsigned int getPlaneEdgeIndex(unsigned int x, unsigned int y, unsigned int axis) const {
+
+		return 3*((y - _beginY)*(_endX - _beginX + 1) + x - _beginX) + axis;
+	}
 
-	// Calculates the normals.
-	void CalculateNormals();
+	// Calculates the (area weighted) normals, see MeshNormals.
+	void CalculateNormals(Mesh& mesh) const;
 
 	// The number of vertices which make up the isosurface.
 	unsigned int _nVertices;
@@ -218,18 +730,35 @@ private:
 	// the mesh that represents the surface
 	boost::shared_ptr<Mesh> _mesh;
 
-	// List of Point3ds which form the isosurface.
-	Id2Point3dId _i2pt3idVertices;
+	// the number of threads to use
+	unsigned int _numThreads;
 
-	// List of Triangles which form the triangulation of the isosurface.
-	TriangleVector _trivecTriangles;
+	// the worker threads shared by all extractions
+	boost::scoped_ptr<ThreadPool> _pool;
+
+	// optional min/max pyramid of the volume
+	boost::shared_ptr<const MinMaxPyramid<value_type> > _pyramid;
+
+	// the first block of cells to visit, the number of blocks to visit in 
+	// each dimension, and whether they might contain the surface (empty if 
+	// all cells have to be visited)
+	unsigned int _firstBlockX, _firstBlockY, _firstBlockZ;
+	unsigned int _blocksX, _blocksY, _blocksZ;
+	std::vector<char> _activeBlocks;
 
 	// No. of cells in x, y, and z directions.
 	unsigned int _nCellsX, _nCellsY, _nCellsZ;
 
+	// The cells to visit, [begin, end) in x, y, and z.
+	unsigned int _beginX, _beginY, _beginZ;
+	unsigned int _endX, _endY, _endZ;
+
 	// Cell length in x, y, and z directions.
 	float _cellSizeX, _cellSizeY, _cellSizeZ;
 
+	// The minimal corner of the volume's bounding box.
+	float _minX, _minY, _minZ;
+
 	// The isosurface value.
 	value_type _tIsoLevel;
 
@@ -240,6 +769,10 @@ private:
 	static const unsigned int _edgeTable[256];
 	static const unsigned int _triTable[256][16];
 
+	// For each of the 12 edges of a cell, the offset of the lattice point the 
+	// edge starts at and the axis it is aligned with.
+	static const unsigned int _edgeLocations[12][4];
+
 	static const unsigned int Invalid = -1;
 };
 
@@ -539,6 +1072,27 @@ const unsigned int MarchingCubes<Volume>::_triTable[256][16] = {
 	{Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid, Invalid}
 };
 
+
+template <typename Volume>
+const unsigned int MarchingCubes<Volume>::Invalid;
+
+template <typename Volume>
+const unsigned int MarchingCubes<Volume>::_edgeLocations[12][4] = {
+	// dx, dy, dz, axis
+	{0, 0, 0, 1},
+	{0, 1, 0, 0},
+	{1, 0, 0, 1},
+	{0, 0, 0, 0},
+	{0, 0, 1, 1},
+	{0, 1, 1, 0},
+	{1, 0, 1, 1},
+	{0, 0, 1, 0},
+	{0, 0, 0, 2},
+	{0, 1, 0, 2},
+	{1, 1, 0, 2},
+	{1, 0, 0, 2}
+};
+
 template <typename Volume>
 MarchingCubes<Volume>::MarchingCubes()
 {
@@ -548,9 +1102,12 @@ MarchingCubes<Volume>::MarchingCubes()
 	_nCellsX = 0;
 	_nCellsY = 0;
 	_nCellsZ = 0;
+	_beginX = _beginY = _beginZ = 0;
+	_endX = _endY = _endZ = 0;
 	_nTriangles = 0;
 	_nNormals = 0;
 	_nVertices = 0;
+	_numThreads = 1;
 	_bValidSurface = false;
 }
 
@@ -560,6 +1117,16 @@ MarchingCubes<Volume>::~MarchingCubes()
 	deleteSurface();
 }
 
+template <typename Volume>
+void
+MarchingCubes<Volume>::setNumThreads(unsigned int numThreads)
+{
+	if (numThreads != _numThreads)
+		_pool.reset();
+
+	_numThreads = numThreads;
+}
+
 
 template <typename Volume>
 template <typename InteriorTest>
@@ -570,278 +1137,1111 @@ MarchingCubes<Volume>::generateSurface(
 		float cellSizeX,
 		float cellSizeY,
 		float cellSizeZ)
+{
+	return generateSurface(
+			volume,
+			interiorTest,
+			cellSizeX,
+			cellSizeY,
+			cellSizeZ,
+			volume.getBoundingBox(),
+			Bisection());
+}
+
+template <typename Volume>
+template <typename InteriorTest>
+boost::shared_ptr<Mesh>
+MarchingCubes<Volume>::generateSurface(
+		const Volume& volume,
+		const InteriorTest& interiorTest,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		const BoundingBox& region)
+{
+	return generateSurface(
+			volume,
+			interiorTest,
+			cellSizeX,
+			cellSizeY,
+			cellSizeZ,
+			region,
+			Bisection());
+}
+
+template <typename Volume>
+template <typename InteriorTest, typename EdgePlacement>
+boost::shared_ptr<Mesh>
+MarchingCubes<Volume>::generateSurface(
+		const Volume& volume,
+		const InteriorTest& interiorTest,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		const BoundingBox& region,
+		const EdgePlacement& edgePlacement)
 {
 	if (_bValidSurface)
 		deleteSurface();
 
 	_mesh = boost::make_shared<Mesh>();
 
-	float width  = volume.getBoundingBox().width();
-	float height = volume.getBoundingBox().height();
-	float depth  = volume.getBoundingBox().depth();
+	setupCells(volume, cellSizeX, cellSizeY, cellSizeZ);
+	restrictCells(region);
 
-	_nCellsX = ceil(width /cellSizeX) + 1;
-	_nCellsY = ceil(height/cellSizeY) + 1;
-	_nCellsZ = ceil(depth /cellSizeZ) + 1;
-	_cellSizeX = cellSizeX;
-	_cellSizeY = cellSizeY;
-	_cellSizeZ = cellSizeZ;
+	boost::timer::cpu_timer timer;
+
+	Sampler sampler = createSampler(volume);
+
+	findActiveBlocks(sampler, interiorTest);
+
+	std::vector<Chunk> chunks;
+	processChunks(
+			chunks,
+			boost::function<void(Chunk&)>(
+					boost::bind(
+							&MarchingCubes<Volume>::template processChunk<InteriorTest, EdgePlacement>,
+							this,
+							boost::cref(sampler),
+							boost::cref(interiorTest),
+							boost::cref(edgePlacement),
+							_1)));
+
+	logCellStatistics(chunks);
+
+	_nVertices  = 0;
+	_nTriangles = 0;
+	std::vector<unsigned int> seam;
+	stitchChunks(chunks, seam);
+
+	LOG_DEBUG(marchingcubeslog) << "created a mesh with " << _nVertices << " vertices" << std::endl;
+
+	CalculateNormals(*_mesh);
+	_nNormals = _nVertices;
+	_bValidSurface = true;
 
 	LOG_DEBUG(marchingcubeslog)
-			<< "creating mesh for " << width << "x" << height << "x" << depth
-			<< " volume with " << _nCellsX << "x" << _nCellsY << "x" << _nCellsZ
-			<< " cells" << std::endl;
+			<< "extracted " << _nTriangles << " triangles in " << chunks.size()
+			<< " chunks using " << (_numThreads == 0 ? boost::thread::hardware_concurrency() : _numThreads)
+			<< " threads:" << timer.format() << std::endl;
 
-	// Generate isosurface.
-	for (unsigned int z = 0; z < _nCellsZ; z++)
-		for (unsigned int y = 0; y < _nCellsY; y++)
-			for (unsigned int x = 0; x < _nCellsX; x++) {
-				// Calculate table lookup index from those
-				// vertices which are below the isolevel.
-				unsigned int tableIndex = 0;
-				if (!interiorTest(getValue(volume, x, y, z)))
-					tableIndex |= 1;
-				if (!interiorTest(getValue(volume, x, y+1, z)))
-					tableIndex |= 2;
-				if (!interiorTest(getValue(volume, x+1, y+1, z)))
-					tableIndex |= 4;
-				if (!interiorTest(getValue(volume, x+1, y, z)))
-					tableIndex |= 8;
-				if (!interiorTest(getValue(volume, x, y, z+1)))
-					tableIndex |= 16;
-				if (!interiorTest(getValue(volume, x, y+1, z+1)))
-					tableIndex |= 32;
-				if (!interiorTest(getValue(volume, x+1, y+1, z+1)))
-					tableIndex |= 64;
-				if (!interiorTest(getValue(volume, x+1, y, z+1)))
-					tableIndex |= 128;
-
-				// Now create a triangulation of the isosurface in this
-				// cell.
-				if (_edgeTable[tableIndex] != 0) {
-					if (_edgeTable[tableIndex] & 8) {
-						Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 3);
-						unsigned int id = GetEdgeId(x, y, z, 3);
-						_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-					}
-					if (_edgeTable[tableIndex] & 1) {
-						Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 0);
-						unsigned int id = GetEdgeId(x, y, z, 0);
-						_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-					}
-					if (_edgeTable[tableIndex] & 256) {
-						Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 8);
-						unsigned int id = GetEdgeId(x, y, z, 8);
-						_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-					}
-					
-					if (x == _nCellsX - 1) {
-						if (_edgeTable[tableIndex] & 4) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 2);
-							unsigned int id = GetEdgeId(x, y, z, 2);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-						if (_edgeTable[tableIndex] & 2048) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 11);
-							unsigned int id = GetEdgeId(x, y, z, 11);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-					}
-					if (y == _nCellsY - 1) {
-						if (_edgeTable[tableIndex] & 2) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 1);
-							unsigned int id = GetEdgeId(x, y, z, 1);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-						if (_edgeTable[tableIndex] & 512) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 9);
-							unsigned int id = GetEdgeId(x, y, z, 9);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
+	LOG_DEBUG(marchingcubeslog)
+			<< "vertex throughput: "
+			<< _nVertices/(1e-9*std::max(timer.elapsed().wall, boost::timer::nanosecond_type(1)))
+			<< " vertices/s" << std::endl;
+
+	return _mesh;
+}
+
+template <typename Volume>
+template <typename InteriorTest>
+boost::shared_ptr<Mesh>
+MarchingCubes<Volume>::generateSurfaceStreaming(
+		const Volume& volume,
+		const InteriorTest& interiorTest,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ)
+{
+	return generateSurfaceStreaming(
+			volume,
+			interiorTest,
+			cellSizeX,
+			cellSizeY,
+			cellSizeZ,
+			Bisection());
+}
+
+template <typename Volume>
+template <typename InteriorTest, typename EdgePlacement>
+boost::shared_ptr<Mesh>
+MarchingCubes<Volume>::generateSurfaceStreaming(
+		const Volume& volume,
+		const InteriorTest& interiorTest,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		const EdgePlacement& edgePlacement)
+{
+	if (_bValidSurface)
+		deleteSurface();
+
+	_mesh = boost::make_shared<Mesh>();
+
+	setupCells(volume, cellSizeX, cellSizeY, cellSizeZ);
+
+	boost::timer::cpu_timer timer;
+
+	Sampler sampler = createSampler(volume);
+
+	findActiveBlocks(sampler, interiorTest);
+
+	ThreadPool* pool = getThreadPool();
+
+	// one chunk per thread and pass
+	unsigned int planesPerChunk = StreamingChunkSize;
+	unsigned int planesPerPass  = (pool ? pool->size() : 1)*planesPerChunk;
+
+	boost::function<void(Chunk&)> process(
+			boost::bind(
+					&MarchingCubes<Volume>::template processChunk<InteriorTest, EdgePlacement>,
+					this,
+					boost::cref(sampler),
+					boost::cref(interiorTest),
+					boost::cref(edgePlacement),
+					_1));
+
+	_nVertices  = 0;
+	_nTriangles = 0;
+	std::vector<unsigned int> seam;
+	std::vector<Chunk> chunks;
+
+	// the sections [0, released) of the volume are not needed anymore
+	unsigned int released = 0;
+
+	prefetchSections(volume, sampler, _beginZ, std::min(_beginZ + planesPerPass, _endZ));
+
+	for (unsigned int z = _beginZ; z < _endZ; z += planesPerPass) {
+
+		unsigned int endZ = std::min(z + planesPerPass, _endZ);
+
+		// read the sections of the next pass while this one is processed
+		if (endZ < _endZ)
+			prefetchSections(volume, sampler, endZ, std::min(endZ + planesPerPass, _endZ));
+
+		chunks.assign((endZ - z + planesPerChunk - 1)/planesPerChunk, Chunk());
+		for (unsigned int i = 0; i < chunks.size(); i++) {
+
+			chunks[i].beginZ = z + i*planesPerChunk;
+			chunks[i].endZ   = std::min(z + (i + 1)*planesPerChunk, endZ);
+		}
+
+		runChunks(chunks, process, pool);
+		stitchChunks(chunks, seam);
+
+		// the first section needed by the remaining cells is the one of 
+		// their first lattice plane inside the volume
+		unsigned int needed = volume.getVoxelsZ();
+		for (unsigned int l = endZ; l <= _endZ; l++) {
+
+			unsigned int minVoxel = 0, maxVoxel = 0;
+			bool outside, empty;
+			sampler.getVoxelRange(l, l, 2, minVoxel, maxVoxel, outside, empty);
+
+			if (!empty) {
+
+				needed = minVoxel;
+				break;
+			}
+		}
+
+		if (needed > released) {
+
+			volume.releaseSections(released, needed);
+			released = needed;
+		}
+	}
+
+	LOG_DEBUG(marchingcubeslog) << "created a mesh with " << _nVertices << " vertices" << std::endl;
+
+	CalculateNormals(*_mesh);
+	_nNormals = _nVertices;
+	_bValidSurface = true;
+
+	LOG_DEBUG(marchingcubeslog)
+			<< "extracted " << _nTriangles << " triangles streaming "
+			<< planesPerPass << " planes per pass:" << timer.format() << std::endl;
+
+	return _mesh;
+}
+
+template <typename Volume>
+boost::shared_ptr<Meshes>
+MarchingCubes<Volume>::generateSurfaces(
+		const Volume& volume,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		value_type background)
+{
+	return generateSurfaces(
+			volume,
+			cellSizeX,
+			cellSizeY,
+			cellSizeZ,
+			background,
+			Bisection());
+}
+
+template <typename Volume>
+template <typename EdgePlacement>
+boost::shared_ptr<Meshes>
+MarchingCubes<Volume>::generateSurfaces(
+		const Volume& volume,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		value_type background,
+		const EdgePlacement& edgePlacement)
+{
+	if (_bValidSurface)
+		deleteSurface();
+
+	setupCells(volume, cellSizeX, cellSizeY, cellSizeZ);
+
+	boost::timer::cpu_timer timer;
+
+	Sampler sampler = createSampler(volume);
+
+	findActiveBlocks(sampler, AnyLabel());
+
+	std::vector<LabelChunk> chunks;
+	processChunks(
+			chunks,
+			boost::function<void(LabelChunk&)>(
+					boost::bind(
+							&MarchingCubes<Volume>::template processLabelChunk<EdgePlacement>,
+							this,
+							boost::cref(sampler),
+							background,
+							boost::cref(edgePlacement),
+							_1)));
+
+	logCellStatistics(chunks);
+
+	boost::shared_ptr<Meshes> meshes = stitchLabelChunks(chunks);
+
+	LOG_DEBUG(marchingcubeslog)
+			<< "extracted " << meshes->getMeshIds().size() << " surfaces in " << chunks.size()
+			<< " chunks:" << timer.format() << std::endl;
+
+	return meshes;
+}
+
+template <typename Volume>
+void
+MarchingCubes<Volume>::setupCells(
+		const Volume& volume,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ)
+{
+	float width  = volume.getBoundingBox().width();
+	float height = volume.getBoundingBox().height();
+	float depth  = volume.getBoundingBox().depth();
+
+	_nCellsX = ceil(width /cellSizeX) + 1;
+	_nCellsY = ceil(height/cellSizeY) + 1;
+	_nCellsZ = ceil(depth /cellSizeZ) + 1;
+	_cellSizeX = cellSizeX;
+	_cellSizeY = cellSizeY;
+	_cellSizeZ = cellSizeZ;
+
+	_minX = volume.getBoundingBox().getMinX();
+	_minY = volume.getBoundingBox().getMinY();
+	_minZ = volume.getBoundingBox().getMinZ();
+
+	_beginX = _beginY = _beginZ = 0;
+	_endX = _nCellsX;
+	_endY = _nCellsY;
+	_endZ = _nCellsZ;
+
+	LOG_DEBUG(marchingcubeslog)
+			<< "creating mesh for " << width << "x" << height << "x" << depth
+			<< " volume with " << _nCellsX << "x" << _nCellsY << "x" << _nCellsZ
+			<< " cells" << std::endl;
+}
+
+template <typename Volume>
+typename MarchingCubes<Volume>::Sampler
+MarchingCubes<Volume>::createSampler(const Volume& volume) const
+{
+	return Sampler(
+			volume,
+			_minX, _minY, _minZ,
+			_cellSizeX, _cellSizeY, _cellSizeZ,
+			_nCellsX + 1, _nCellsY + 1, _nCellsZ + 1);
+}
+
+template <typename Volume>
+void
+MarchingCubes<Volume>::updateSurfaces(
+		const Volume& volume,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		const BoundingBox& dirtyRegion,
+		Meshes& meshes,
+		value_type background)
+{
+	updateSurfaces(
+			volume,
+			cellSizeX,
+			cellSizeY,
+			cellSizeZ,
+			dirtyRegion,
+			meshes,
+			background,
+			Bisection());
+}
+
+template <typename Volume>
+template <typename EdgePlacement>
+void
+MarchingCubes<Volume>::updateSurfaces(
+		const Volume& volume,
+		float cellSizeX,
+		float cellSizeY,
+		float cellSizeZ,
+		const BoundingBox& dirtyRegion,
+		Meshes& meshes,
+		value_type background,
+		const EdgePlacement& edgePlacement)
+{
+	boost::timer::cpu_timer timer;
+
+	// The cells that sample the dirty region, plus one cell on each side. 
+	// The triangles of the border cells do not change, such that the 
+	// vertices on the border of these cells are the same as before.
+	setupCells(volume, cellSizeX, cellSizeY, cellSizeZ);
+	restrictCells(dirtyRegion);
+
+	_activeBlocks.clear();
+
+	Sampler sampler = createSampler(volume);
+
+	std::vector<LabelChunk> chunks;
+	processChunks(
+			chunks,
+			boost::function<void(LabelChunk&)>(
+					boost::bind(
+							&MarchingCubes<Volume>::template processLabelChunk<EdgePlacement>,
+							this,
+							boost::cref(sampler),
+							background,
+							boost::cref(edgePlacement),
+							_1)));
+
+	boost::shared_ptr<Meshes> patches = stitchLabelChunks(chunks);
+
+	// the visited cells in volume coordinates
+	float minX = _minX + (static_cast<int>(_beginX) - 1)*_cellSizeX;
+	float minY = _minY + (static_cast<int>(_beginY) - 1)*_cellSizeY;
+	float minZ = _minZ + (static_cast<int>(_beginZ) - 1)*_cellSizeZ;
+	float maxX = _minX + (static_cast<int>(_endX) - 1)*_cellSizeX;
+	float maxY = _minY + (static_cast<int>(_endY) - 1)*_cellSizeY;
+	float maxZ = _minZ + (static_cast<int>(_endZ) - 1)*_cellSizeZ;
+
+	unsigned int numUpdated = 0;
+
+	// existing meshes (copy the ids, since meshes might get removed)
+	std::vector<unsigned int> ids = meshes.getMeshIds();
+	for (unsigned int i = 0; i < ids.size(); i++) {
+
+		boost::shared_ptr<Mesh> mesh  = meshes.get(ids[i]);
+		boost::shared_ptr<Mesh> patch = patches->get(ids[i]);
+
+		if (!patch) {
+
+			// without a patch, only meshes that reach into the visited cells 
+			// can change
+			const BoundingBox& box = mesh->getBoundingBox();
+			if (box.getMaxX() < minX || box.getMinX() > maxX ||
+			    box.getMaxY() < minY || box.getMinY() > maxY ||
+			    box.getMaxZ() < minZ || box.getMinZ() > maxZ)
+				continue;
+		}
+
+		spliceSurface(*mesh, patch.get());
+		numUpdated++;
+
+		if (mesh->getNumTriangles() == 0)
+			meshes.remove(ids[i]);
+		else
+			meshes.add(ids[i], mesh);
+	}
+
+	// new labels
+	for (unsigned int i = 0; i < patches->getMeshIds().size(); i++) {
+
+		unsigned int id = patches->getMeshIds()[i];
+
+		if (!meshes.get(id)) {
+
+			meshes.add(id, patches->get(id));
+			numUpdated++;
+		}
+	}
+
+	LOG_DEBUG(marchingcubeslog)
+			<< "updated " << numUpdated << " surfaces in cells [" << _beginX << ", " << _endX << ")x["
+			<< _beginY << ", " << _endY << ")x[" << _beginZ << ", " << _endZ << "):"
+			<< timer.format() << std::endl;
+}
+
+template <typename Volume>
+void
+MarchingCubes<Volume>::spliceSurface(Mesh& mesh, const Mesh* patch) const
+{
+	// the current cells in volume coordinates
+	float minX = _minX + (static_cast<int>(_beginX) - 1)*_cellSizeX;
+	float minY = _minY + (static_cast<int>(_beginY) - 1)*_cellSizeY;
+	float minZ = _minZ + (static_cast<int>(_beginZ) - 1)*_cellSizeZ;
+	float maxX = _minX + (static_cast<int>(_endX) - 1)*_cellSizeX;
+	float maxY = _minY + (static_cast<int>(_endY) - 1)*_cellSizeY;
+	float maxZ = _minZ + (static_cast<int>(_endZ) - 1)*_cellSizeZ;
+
+	unsigned int numVertices  = mesh.getNumVertices();
+	unsigned int numTriangles = mesh.getNumTriangles();
+
+	// the new index of each vertex that is still used
+	std::vector<unsigned int> ids(numVertices, Invalid);
+
+	// Keep the triangles of the cells that have not been visited. The 
+	// vertices of a triangle are on the edges of its cell, and not all of 
+	// them on the same face, such that its centroid is strictly inside its 
+	// cell.
+	unsigned int keptTriangles = 0;
+	for (unsigned int i = 0; i < numTriangles; i++) {
+
+		Triangle triangle = mesh.getTriangle(i);
+
+		const Point3d& p0 = mesh.getVertex(triangle.v0);
+		const Point3d& p1 = mesh.getVertex(triangle.v1);
+		const Point3d& p2 = mesh.getVertex(triangle.v2);
+
+		float x = (p0.x + p1.x + p2.x)/3;
+		float y = (p0.y + p1.y + p2.y)/3;
+		float z = (p0.z + p1.z + p2.z)/3;
+
+		if (x > minX && x < maxX && y > minY && y < maxY && z > minZ && z < maxZ)
+			continue;
+
+		ids[triangle.v0] = ids[triangle.v1] = ids[triangle.v2] = 0;
+
+		mesh.setTriangle(keptTriangles, triangle.v0, triangle.v1, triangle.v2);
+		keptTriangles++;
+	}
+
+	// Move the used vertices to the front, in their original order. Used 
+	// vertices in the closed box of the visited cells are on its border and 
+	// shared with the patch.
+	std::map<Point3d, unsigned int, PointLess> border;
+
+	unsigned int keptVertices = 0;
+	for (unsigned int i = 0; i < numVertices; i++) {
+
+		if (ids[i] == Invalid)
+			continue;
+
+		ids[i] = keptVertices;
+
+		const Point3d& vertex = mesh.getVertex(i);
+
+		if (vertex.x >= minX && vertex.x <= maxX &&
+		    vertex.y >= minY && vertex.y <= maxY &&
+		    vertex.z >= minZ && vertex.z <= maxZ)
+			border[vertex] = keptVertices;
+
+		if (i != keptVertices) {
+
+			mesh.setVertex(keptVertices, vertex);
+			mesh.setNormal(keptVertices, mesh.getNormal(i));
+		}
+
+		keptVertices++;
+	}
+
+	for (unsigned int i = 0; i < keptTriangles; i++) {
+
+		Triangle& triangle = mesh.getTriangle(i);
+
+		triangle.v0 = ids[triangle.v0];
+		triangle.v1 = ids[triangle.v1];
+		triangle.v2 = ids[triangle.v2];
+	}
+
+	if (!patch) {
+
+		mesh.setNumVertices(keptVertices);
+		mesh.setNumTriangles(keptTriangles);
+		return;
+	}
+
+	// append the vertices of the patch that are not on the border
+	std::vector<unsigned int> patchIds(patch->getNumVertices());
+
+	unsigned int nextVertex = keptVertices;
+	for (unsigned int i = 0; i < patch->getNumVertices(); i++) {
+
+		typename std::map<Point3d, unsigned int, PointLess>::const_iterator j = border.find(patch->getVertex(i));
+
+		patchIds[i] = (j == border.end() ? nextVertex++ : j->second);
+	}
+
+	mesh.setNumVertices(nextVertex);
+
+	// The normals of border vertices stay the same, since the triangles 
+	// around them did not change. The normals of the other vertices depend 
+	// only on triangles of the patch.
+	for (unsigned int i = 0; i < patch->getNumVertices(); i++)
+		if (patchIds[i] >= keptVertices) {
+
+			mesh.setVertex(patchIds[i], patch->getVertex(i));
+			mesh.setNormal(patchIds[i], patch->getNormal(i));
+		}
+
+	mesh.setNumTriangles(keptTriangles + patch->getNumTriangles());
+
+	for (unsigned int i = 0; i < patch->getNumTriangles(); i++) {
+
+		const Triangle& triangle = patch->getTriangle(i);
+
+		mesh.setTriangle(
+				keptTriangles + i,
+				patchIds[triangle.v0],
+				patchIds[triangle.v1],
+				patchIds[triangle.v2]);
+	}
+}
+
+template <typename Volume>
+template <typename InteriorTest>
+void
+MarchingCubes<Volume>::findActiveBlocks(const Sampler& sampler, const InteriorTest& interiorTest)
+{
+	_activeBlocks.clear();
+
+	if (!_pyramid)
+		return;
+
+	if (_beginX == _endX || _beginY == _endY || _beginZ == _endZ)
+		return;
+
+	// only the blocks of the cells to visit
+	_firstBlockX = _beginX/CellBlockSize;
+	_firstBlockY = _beginY/CellBlockSize;
+	_firstBlockZ = _beginZ/CellBlockSize;
+	_blocksX = (_endX - 1)/CellBlockSize - _firstBlockX + 1;
+	_blocksY = (_endY - 1)/CellBlockSize - _firstBlockY + 1;
+	_blocksZ = (_endZ - 1)/CellBlockSize - _firstBlockZ + 1;
+
+	std::vector<char> activeBlocks(_blocksX*_blocksY*_blocksZ);
+	unsigned int numActive = 0;
+
+	// the voxels covered by the lattice points of the current block
+	unsigned int minVoxel[3] = {0, 0, 0};
+	unsigned int maxVoxel[3] = {0, 0, 0};
+	bool outside[3], empty[3];
+
+	for (unsigned int bz = _firstBlockZ; bz < _firstBlockZ + _blocksZ; bz++) {
+
+		if (!sampler.getVoxelRange(bz*CellBlockSize, std::min((bz + 1)*CellBlockSize, _nCellsZ), 2, minVoxel[2], maxVoxel[2], outside[2], empty[2]))
+			return;
+
+		for (unsigned int by = _firstBlockY; by < _firstBlockY + _blocksY; by++) {
+
+			sampler.getVoxelRange(by*CellBlockSize, std::min((by + 1)*CellBlockSize, _nCellsY), 1, minVoxel[1], maxVoxel[1], outside[1], empty[1]);
+
+			for (unsigned int bx = _firstBlockX; bx < _firstBlockX + _blocksX; bx++) {
+
+				sampler.getVoxelRange(bx*CellBlockSize, std::min((bx + 1)*CellBlockSize, _nCellsX), 0, minVoxel[0], maxVoxel[0], outside[0], empty[0]);
+
+				// lattice points outside of the volume read 0
+				value_type min = 0;
+				value_type max = 0;
+
+				if (!empty[0] && !empty[1] && !empty[2]) {
+
+					_pyramid->getRange(
+							minVoxel[0], minVoxel[1], minVoxel[2],
+							maxVoxel[0], maxVoxel[1], maxVoxel[2],
+							min, max);
+
+					if (outside[0] || outside[1] || outside[2]) {
+
+						min = std::min(min, value_type(0));
+						max = std::max(max, value_type(0));
 					}
-					if (z == _nCellsZ - 1) {
-						if (_edgeTable[tableIndex] & 16) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 4);
-							unsigned int id = GetEdgeId(x, y, z, 4);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-						if (_edgeTable[tableIndex] & 128) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 7);
-							unsigned int id = GetEdgeId(x, y, z, 7);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
+				}
+
+				bool active = mayCross(min, max, interiorTest);
+
+				activeBlocks[((bz - _firstBlockZ)*_blocksY + by - _firstBlockY)*_blocksX + bx - _firstBlockX] = active;
+				if (active)
+					numActive++;
+			}
+		}
+	}
+
+	_activeBlocks.swap(activeBlocks);
+
+	LOG_ALL(marchingcubeslog)
+			<< numActive << " of " << _activeBlocks.size()
+			<< " blocks of cells might contain the surface" << std::endl;
+}
+
+template <typename Volume>
+void
+MarchingCubes<Volume>::getActiveSpans(unsigned int y, unsigned int z, std::vector<Span>& spans) const
+{
+	spans.clear();
+
+	if (_activeBlocks.empty()) {
+
+		spans.push_back(Span(_beginX, _endX));
+		return;
+	}
+
+	const char* activeBlocks = &_activeBlocks[((z/CellBlockSize - _firstBlockZ)*_blocksY + y/CellBlockSize - _firstBlockY)*_blocksX];
+
+	for (unsigned int bx = _beginX/CellBlockSize; bx*CellBlockSize < _endX; bx++) {
+
+		if (!activeBlocks[bx - _firstBlockX])
+			continue;
+
+		unsigned int begin = std::max(_beginX, bx*CellBlockSize);
+		unsigned int end   = std::min(_endX, (bx + 1)*CellBlockSize);
+
+		// merge with the previous span, if adjacent
+		if (!spans.empty() && spans.back().second == begin)
+			spans.back().second = end;
+		else
+			spans.push_back(Span(begin, end));
+	}
+}
+
+template <typename Volume>
+template <typename ChunkType>
+void
+MarchingCubes<Volume>::logCellStatistics(const std::vector<ChunkType>& chunks) const
+{
+	unsigned long visited = 0;
+	unsigned long skipped = 0;
+
+	for (unsigned int i = 0; i < chunks.size(); i++) {
+
+		visited += chunks[i].visitedCells;
+		skipped += chunks[i].skippedCells;
+	}
+
+	LOG_DEBUG(marchingcubeslog)
+			<< "visited " << visited << " cells, skipped " << skipped << " cells" << std::endl;
+}
+
+template <typename Volume>
+void
+MarchingCubes<Volume>::restrictCells(const BoundingBox& region)
+{
+	// Lattice point i samples the volume at min + (i-1)*cellSize, cell i 
+	// spans lattice points i and i+1. Take all cells with a lattice point in 
+	// the region, plus one more on each side to be safe against rounding.
+	_beginX = std::max(0.0f, std::floor((region.getMinX() - _minX)/_cellSizeX) - 1);
+	_beginY = std::max(0.0f, std::floor((region.getMinY() - _minY)/_cellSizeY) - 1);
+	_beginZ = std::max(0.0f, std::floor((region.getMinZ() - _minZ)/_cellSizeZ) - 1);
+	_endX   = std::min((float)_nCellsX, std::max(0.0f, std::ceil((region.getMaxX() - _minX)/_cellSizeX) + 2));
+	_endY   = std::min((float)_nCellsY, std::max(0.0f, std::ceil((region.getMaxY() - _minY)/_cellSizeY) + 2));
+	_endZ   = std::min((float)_nCellsZ, std::max(0.0f, std::ceil((region.getMaxZ() - _minZ)/_cellSizeZ) + 2));
+
+	_beginX = std::min(_beginX, _endX);
+	_beginY = std::min(_beginY, _endY);
+	_beginZ = std::min(_beginZ, _endZ);
+
+	LOG_ALL(marchingcubeslog)
+			<< "restricted to cells [" << _beginX << ", " << _endX << ")x["
+			<< _beginY << ", " << _endY << ")x[" << _beginZ << ", " << _endZ << ")" << std::endl;
+}
+
+template <typename Volume>
+template <typename ChunkType>
+void
+MarchingCubes<Volume>::processChunks(
+		std::vector<ChunkType>& chunks,
+		const boost::function<void(ChunkType&)>& process)
+{
+	ThreadPool* pool = getThreadPool();
+
+	// split the volume into chunks of z-slabs, a few more than threads to 
+	// balance the load
+	unsigned int numSlabs  = _endZ - _beginZ;
+	unsigned int numChunks = (pool ? std::max(1u, std::min(numSlabs, 4*pool->size())) : 1);
+	chunks.resize(numChunks);
+
+	for (unsigned int i = 0; i < numChunks; i++) {
+
+		chunks[i].beginZ = _beginZ + (i*numSlabs)/numChunks;
+		chunks[i].endZ   = _beginZ + ((i + 1)*numSlabs)/numChunks;
+	}
+
+	runChunks(chunks, process, pool);
+}
+
+template <typename Volume>
+ThreadPool*
+MarchingCubes<Volume>::getThreadPool()
+{
+	if (_numThreads == 1)
+		return 0;
+
+	if (!_pool)
+		_pool.reset(new ThreadPool(_numThreads));
+
+	return _pool.get();
+}
+
+template <typename Volume>
+template <typename ChunkType>
+void
+MarchingCubes<Volume>::runChunks(
+		std::vector<ChunkType>& chunks,
+		const boost::function<void(ChunkType&)>& process,
+		ThreadPool* pool)
+{
+	if (!pool) {
+
+		for (unsigned int i = 0; i < chunks.size(); i++)
+			process(chunks[i]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < chunks.size(); i++)
+		pool->schedule(boost::bind(process, boost::ref(chunks[i])));
+
+	pool->wait();
+}
+
+template <typename Volume>
+template <typename InteriorTest, typename EdgePlacement>
+void
+MarchingCubes<Volume>::processChunk(
+		const Sampler& sampler,
+		const InteriorTest& interiorTest,
+		const EdgePlacement& edgePlacement,
+		Chunk& chunk) const
+{
+	// one entry per edge starting at a lattice point of a plane
+	unsigned int slabSize = 3*(_endX - _beginX + 1)*(_endY - _beginY + 1);
+	chunk.slabVertices[0].assign(slabSize, Invalid);
+	chunk.slabVertices[1].assign(slabSize, Invalid);
+
+	// The values and exterior masks of the lattice points of the rows (y, z), 
+	// (y, z+1) (index 0) and (y+1, z), (y+1, z+1) (index 1), and the case 
+	// codes of the row of cells between them.
+	unsigned int numCells  = _endX - _beginX;
+	unsigned int numPoints = numCells + 1;
+	std::vector<value_type>    values(numPoints);
+	std::vector<unsigned char> exterior[2][2];
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 2; j++)
+			exterior[i][j].resize(numPoints);
+	std::vector<unsigned char> codes(numCells);
+
+	// the ranges of cells of the current row that might contain the surface
+	std::vector<Span> spans;
+
+	// Generate isosurface.
+	for (unsigned int z = chunk.beginZ; z < chunk.endZ; z++) {
+
+		// whether the masks at y+1 of the previous row of cells are complete
+		bool previousComplete = false;
+
+		for (unsigned int y = _beginY; y < _endY; y++) {
+
+			getActiveSpans(y, z, spans);
+
+			bool complete = (spans.size() == 1 && spans[0].first == _beginX && spans[0].second == _endX);
+
+			unsigned int visited = 0;
+
+			for (unsigned int s = 0; s < spans.size(); s++) {
+
+				unsigned int begin  = spans[s].first;
+				unsigned int end    = spans[s].second;
+				unsigned int offset = begin - _beginX;
+
+				visited += end - begin;
+
+				for (int dz = 0; dz < 2; dz++) {
+
+					// The rows at y are the ones at y+1 of the previous row
+					// of cells, if both rows are visited completely.
+					if (complete && previousComplete) {
+
+						exterior[0][dz].swap(exterior[1][dz]);
+
+					} else {
+
+						sampler.getRow(y, z + dz).read(begin, end + 1, &values[0]);
+						classify(&values[0], end - begin + 1, interiorTest, &exterior[0][dz][offset]);
 					}
-					if ((x==_nCellsX - 1) && (y==_nCellsY - 1))
-						if (_edgeTable[tableIndex] & 1024) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 10);
-							unsigned int id = GetEdgeId(x, y, z, 10);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-					if ((x==_nCellsX - 1) && (z==_nCellsZ - 1))
-						if (_edgeTable[tableIndex] & 64) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 6);
-							unsigned int id = GetEdgeId(x, y, z, 6);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-					if ((y==_nCellsY - 1) && (z==_nCellsZ - 1))
-						if (_edgeTable[tableIndex] & 32) {
-							Point3dId pt = CalculateIntersection(volume, interiorTest, x, y, z, 5);
-							unsigned int id = GetEdgeId(x, y, z, 5);
-							_i2pt3idVertices.insert(Id2Point3dId::value_type(id, pt));
-						}
-					
+
+					sampler.getRow(y + 1, z + dz).read(begin, end + 1, &values[0]);
+					classify(&values[0], end - begin + 1, interiorTest, &exterior[1][dz][offset]);
+				}
+
+				// skip cells that are completely inside or outside
+				if (!combineCaseCodes(
+						&exterior[0][0][offset],
+						&exterior[1][0][offset],
+						&exterior[0][1][offset],
+						&exterior[1][1][offset],
+						end - begin,
+						&codes[offset]))
+					continue;
+
+				for (unsigned int x = begin; x < end; x++) {
+
+					// the table lookup index of the corners that are exterior
+					unsigned int tableIndex = codes[x - _beginX];
+
+					if (_edgeTable[tableIndex] == 0)
+						continue;
+
+					// Now create a triangulation of the isosurface in this
+					// cell. The vertices are requested one after another,
+					// such that they get numbered in a deterministic order.
 					for (unsigned int i = 0; _triTable[tableIndex][i] != Invalid; i += 3) {
-						TriangleId triangle;
-						unsigned int pointId0, pointId1, pointId2;
-						pointId0 = GetEdgeId(x, y, z, _triTable[tableIndex][i]);
-						pointId1 = GetEdgeId(x, y, z, _triTable[tableIndex][i+1]);
-						pointId2 = GetEdgeId(x, y, z, _triTable[tableIndex][i+2]);
-						triangle.pointId[0] = pointId0;
-						triangle.pointId[1] = pointId1;
-						triangle.pointId[2] = pointId2;
-						_trivecTriangles.push_back(triangle);
+
+						unsigned int v0 = getEdgeVertex(sampler, interiorTest, edgePlacement, chunk, x, y, z, _triTable[tableIndex][i]);
+						unsigned int v1 = getEdgeVertex(sampler, interiorTest, edgePlacement, chunk, x, y, z, _triTable[tableIndex][i+1]);
+						unsigned int v2 = getEdgeVertex(sampler, interiorTest, edgePlacement, chunk, x, y, z, _triTable[tableIndex][i+2]);
+
+						chunk.triangles.push_back(Triangle(v0, v1, v2));
 					}
 				}
 			}
-	
-	RenameVerticesAndTriangles();
-	CalculateNormals();
-	_bValidSurface = true;
 
-	return _mesh;
+			chunk.visitedCells += visited;
+			chunk.skippedCells += (_endX - _beginX) - visited;
+
+			previousComplete = complete;
+		}
+
+		if (z == chunk.beginZ)
+			chunk.firstPlane = chunk.slabVertices[0];
+		if (z + 1 == chunk.endZ)
+			chunk.lastPlane = chunk.slabVertices[1];
+
+		advanceSlab(chunk);
+	}
+
+	chunk.slabVertices[0].clear();
+	chunk.slabVertices[1].clear();
 }
 
 template <typename Volume>
-template <typename InteriorTest>
-Point3dId MarchingCubes<Volume>::CalculateIntersection(
-		const Volume& volume,
+template <typename InteriorTest, typename EdgePlacement>
+unsigned int
+MarchingCubes<Volume>::getEdgeVertex(
+		const Sampler& sampler,
 		const InteriorTest& interiorTest,
-		unsigned int nX,
-		unsigned int nY,
-		unsigned int nZ,
-		unsigned int nEdgeNo)
-{
-	Point3d p1, p2;
-	int v1x = nX, v1y = nY, v1z = nZ;
-	int v2x = nX, v2y = nY, v2z = nZ;
-	
-	switch (nEdgeNo)
-	{
-	case 0:
-		v2y += 1;
-		break;
-	case 1:
-		v1y += 1;
-		v2x += 1;
-		v2y += 1;
-		break;
-	case 2:
-		v1x += 1;
-		v1y += 1;
-		v2x += 1;
-		break;
-	case 3:
-		v1x += 1;
-		break;
-	case 4:
-		v1z += 1;
-		v2y += 1;
-		v2z += 1;
-		break;
-	case 5:
-		v1y += 1;
-		v1z += 1;
-		v2x += 1;
-		v2y += 1;
-		v2z += 1;
-		break;
-	case 6:
-		v1x += 1;
-		v1y += 1;
-		v1z += 1;
-		v2x += 1;
-		v2z += 1;
-		break;
-	case 7:
-		v1x += 1;
-		v1z += 1;
-		v2z += 1;
-		break;
-	case 8:
-		v2z += 1;
-		break;
-	case 9:
-		v1y += 1;
-		v2y += 1;
-		v2z += 1;
-		break;
-	case 10:
-		v1x += 1;
-		v1y += 1;
-		v2x += 1;
-		v2y += 1;
-		v2z += 1;
-		break;
-	case 11:
-		v1x += 1;
-		v2x += 1;
-		v2z += 1;
-		break;
+		const EdgePlacement& edgePlacement,
+		Chunk& chunk,
+		unsigned int x,
+		unsigned int y,
+		unsigned int z,
+		unsigned int edge) const
+{
+	unsigned int lx   = x + _edgeLocations[edge][0];
+	unsigned int ly   = y + _edgeLocations[edge][1];
+	unsigned int dz   = _edgeLocations[edge][2];
+	unsigned int axis = _edgeLocations[edge][3];
+
+	unsigned int& id = chunk.slabVertices[dz][getPlaneEdgeIndex(lx, ly, axis)];
+
+	if (id == Invalid) {
+
+		id = chunk.vertices.size();
+		chunk.vertices.push_back(CalculateIntersection(sampler, interiorTest, edgePlacement, lx, ly, z + dz, axis));
 	}
 
-	// transform local coordinates back into volume space
-	p1.x = volume.getBoundingBox().getMinX() + (v1x-1)*_cellSizeX;
-	p1.y = volume.getBoundingBox().getMinY() + (v1y-1)*_cellSizeY;
-	p1.z = volume.getBoundingBox().getMinZ() + (v1z-1)*_cellSizeZ;
-	p2.x = volume.getBoundingBox().getMinX() + (v2x-1)*_cellSizeX;
-	p2.y = volume.getBoundingBox().getMinY() + (v2y-1)*_cellSizeY;
-	p2.z = volume.getBoundingBox().getMinZ() + (v2z-1)*_cellSizeZ;
-
-	value_type val1 = getValue(volume, v1x, v1y, v1z);
-	value_type val2 = getValue(volume, v2x, v2y, v2z);
-
-	if (interiorTest(val1) && !interiorTest(val2))
-		return findSurfaceIntersection(volume, interiorTest, p2, p1);
-	else
-		return findSurfaceIntersection(volume, interiorTest, p1, p2);
+	return id;
 }
 
 template <typename Volume>
-template <typename InteriorTest>
-Point3dId MarchingCubes<Volume>::findSurfaceIntersection(
-		const Volume& volume,
-		const InteriorTest& interiorTest,
-		const Point3d& p1,
-		const Point3d& p2)
+template <typename EdgePlacement>
+void
+MarchingCubes<Volume>::processLabelChunk(
+		const Sampler& sampler,
+		value_type background,
+		const EdgePlacement& edgePlacement,
+		LabelChunk& chunk) const
 {
-	Point3dId interpolation;
+	value_type values[8];
 
-	// binary search for intersection
-	float mu = 0.5;
-	float delta = 0.25;
+	// the ranges of cells of the current row that might contain a surface
+	std::vector<Span> spans;
 
-	// assume that p1 is outside, p2 is inside
-	//
-	// mu == 0 -> p1, mu == 1 -> p2
-	//
-	// incrase  mu -> go to inside
-	// decrease mu -> go to outside
+	for (unsigned int z = chunk.beginZ; z < chunk.endZ; z++) {
 
-	for (unsigned int i = 0; i < 10; i++, delta /= 2.0) {
+		for (unsigned int y = _beginY; y < _endY; y++) {
 
-		interpolation = p1 + mu*(p2 - p1);
+			getActiveSpans(y, z, spans);
 
-		if (interiorTest(
-				volume(
-						interpolation.x,
-						interpolation.y,
-						interpolation.z)))
-			mu -= delta; // go to outside
-		else
-			mu += delta; // go to inside
+			typename Sampler::Row row00 = sampler.getRow(y,   z);
+			typename Sampler::Row row10 = sampler.getRow(y+1, z);
+			typename Sampler::Row row01 = sampler.getRow(y,   z+1);
+			typename Sampler::Row row11 = sampler.getRow(y+1, z+1);
+
+			unsigned int visited = 0;
+
+			for (unsigned int s = 0; s < spans.size(); s++) {
+
+				unsigned int begin = spans[s].first;
+				unsigned int end   = spans[s].second;
+
+				visited += end - begin;
+
+				// the labels at the corners, in the order of the bits of the 
+				// table index (the ones at x+1 are reused as the ones at x 
+				// of the next cell)
+				values[3] = row00[begin];
+				values[2] = row10[begin];
+				values[7] = row01[begin];
+				values[6] = row11[begin];
+
+				for (unsigned int x = begin; x < end; x++) {
+
+					values[0] = values[3];
+					values[1] = values[2];
+					values[4] = values[7];
+					values[5] = values[6];
+					values[2] = row10[x+1];
+					values[3] = row00[x+1];
+					values[6] = row11[x+1];
+					values[7] = row01[x+1];
+
+					for (unsigned int i = 0; i < 8; i++) {
+
+						value_type label = values[i];
+
+						if (label == background)
+							continue;
+
+						// visit each label only once
+						bool seen = false;
+						for (unsigned int j = 0; j < i; j++)
+							if (values[j] == label)
+								seen = true;
+						if (seen)
+							continue;
+
+						unsigned int tableIndex = 0;
+						for (unsigned int j = 0; j < 8; j++)
+							if (values[j] != label)
+								tableIndex |= (1 << j);
+
+						if (_edgeTable[tableIndex] == 0)
+							continue;
+
+						unsigned int labelIndex = chunk.getLabelIndex(label);
+
+						for (unsigned int t = 0; _triTable[tableIndex][t] != Invalid; t += 3) {
+
+							unsigned int v0 = getLabelEdgeVertex(sampler, edgePlacement, chunk, labelIndex, x, y, z, _triTable[tableIndex][t]);
+							unsigned int v1 = getLabelEdgeVertex(sampler, edgePlacement, chunk, labelIndex, x, y, z, _triTable[tableIndex][t+1]);
+							unsigned int v2 = getLabelEdgeVertex(sampler, edgePlacement, chunk, labelIndex, x, y, z, _triTable[tableIndex][t+2]);
+
+							chunk.triangles[labelIndex].push_back(Triangle(v0, v1, v2));
+						}
+					}
+				}
+			}
+
+			chunk.visitedCells += visited;
+			chunk.skippedCells += (_endX - _beginX) - visited;
+		}
+
+		if (z == chunk.beginZ) {
+
+			typename EdgeVertexMap::const_iterator i;
+			for (i = chunk.slabVertices[0].begin(); i != chunk.slabVertices[0].end(); i++) {
+
+				unsigned int labelIndex = i->first >> 32;
+				unsigned int edgeIndex  = i->first & 0xffffffff;
+
+				if (edgeIndex%3 != 2)
+					chunk.firstPlane[labelIndex].push_back(std::make_pair(edgeIndex, i->second));
+			}
+		}
+
+		if (z + 1 == chunk.endZ)
+			chunk.lastPlane = chunk.slabVertices[1];
+
+		chunk.slabVertices[0].swap(chunk.slabVertices[1]);
+		chunk.slabVertices[1].clear();
 	}
 
-	return interpolation;
+	chunk.slabVertices[0].clear();
+	chunk.slabVertices[1].clear();
+}
+
+template <typename Volume>
+template <typename EdgePlacement>
+unsigned int
+MarchingCubes<Volume>::getLabelEdgeVertex(
+		const Sampler& sampler,
+		const EdgePlacement& edgePlacement,
+		LabelChunk& chunk,
+		unsigned int labelIndex,
+		unsigned int x,
+		unsigned int y,
+		unsigned int z,
+		unsigned int edge) const
+{
+	unsigned int lx   = x + _edgeLocations[edge][0];
+	unsigned int ly   = y + _edgeLocations[edge][1];
+	unsigned int dz   = _edgeLocations[edge][2];
+	unsigned int axis = _edgeLocations[edge][3];
+
+	boost::uint64_t key = (static_cast<boost::uint64_t>(labelIndex) << 32) | getPlaneEdgeIndex(lx, ly, axis);
+
+	typename EdgeVertexMap::const_iterator i = chunk.slabVertices[dz].find(key);
+
+	if (i != chunk.slabVertices[dz].end())
+		return i->second;
+
+	std::vector<Point3d>& vertices = chunk.vertices[labelIndex];
+
+	unsigned int id = vertices.size();
+	vertices.push_back(
+			CalculateIntersection(
+					sampler,
+					AcceptExactly(chunk.labels[labelIndex]),
+					edgePlacement,
+					lx, ly, z + dz,
+					axis));
+	chunk.slabVertices[dz][key] = id;
+
+	return id;
+}
+
+template <typename Volume>
+template <typename InteriorTest, typename EdgePlacement>
+Point3d MarchingCubes<Volume>::CalculateIntersection(
+		const Sampler& sampler,
+		const InteriorTest& interiorTest,
+		const EdgePlacement& edgePlacement,
+		unsigned int x,
+		unsigned int y,
+		unsigned int z,
+		unsigned int axis) const
+{
+	int v2x = x + (axis == 0);
+	int v2y = y + (axis == 1);
+	int v2z = z + (axis == 2);
+
+	// transform local coordinates back into volume space
+	Point3d p1 = getLatticePoint(x, y, z);
+	Point3d p2 = getLatticePoint(v2x, v2y, v2z);
+
+	value_type val1 = sampler(static_cast<int>(x), static_cast<int>(y), static_cast<int>(z));
+	value_type val2 = sampler(v2x, v2y, v2z);
+
+	if (interiorTest(val1))
+		return edgePlacement(sampler, interiorTest, p2, p1, val2, val1);
+	else
+		return edgePlacement(sampler, interiorTest, p1, p2, val1, val2);
 }
 
 template <typename Volume>
@@ -859,6 +2259,8 @@ void MarchingCubes<Volume>::deleteSurface()
 	_nCellsX = 0;
 	_nCellsY = 0;
 	_nCellsZ = 0;
+	_beginX = _beginY = _beginZ = 0;
+	_endX = _endY = _endZ = 0;
 	_nTriangles = 0;
 	_nNormals = 0;
 	_nVertices = 0;
@@ -879,134 +2281,175 @@ int MarchingCubes<Volume>::getVolumeLengths(float& fVolLengthX, float& fVolLengt
 }
 
 template <typename Volume>
-unsigned int MarchingCubes<Volume>::GetEdgeId(unsigned int nX, unsigned int nY, unsigned int nZ, unsigned int nEdgeNo)
-{
-	switch (nEdgeNo) {
-	case 0:
-		return GetVertexId(nX, nY, nZ) + 1;
-	case 1:
-		return GetVertexId(nX, nY + 1, nZ);
-	case 2:
-		return GetVertexId(nX + 1, nY, nZ) + 1;
-	case 3:
-		return GetVertexId(nX, nY, nZ);
-	case 4:
-		return GetVertexId(nX, nY, nZ + 1) + 1;
-	case 5:
-		return GetVertexId(nX, nY + 1, nZ + 1);
-	case 6:
-		return GetVertexId(nX + 1, nY, nZ + 1) + 1;
-	case 7:
-		return GetVertexId(nX, nY, nZ + 1);
-	case 8:
-		return GetVertexId(nX, nY, nZ) + 2;
-	case 9:
-		return GetVertexId(nX, nY + 1, nZ) + 2;
-	case 10:
-		return GetVertexId(nX + 1, nY + 1, nZ) + 2;
-	case 11:
-		return GetVertexId(nX + 1, nY, nZ) + 2;
-	default:
-		// Invalid edge no.
-		return Invalid;
-	}
+void MarchingCubes<Volume>::advanceSlab(Chunk& chunk) const
+{
+	chunk.slabVertices[0].swap(chunk.slabVertices[1]);
+	std::fill(chunk.slabVertices[1].begin(), chunk.slabVertices[1].end(), Invalid);
 }
 
 template <typename Volume>
-unsigned int MarchingCubes<Volume>::GetVertexId(unsigned int nX, unsigned int nY, unsigned int nZ)
+void MarchingCubes<Volume>::prefetchSections(const Volume& volume, const Sampler& sampler, unsigned int beginZ, unsigned int endZ) const
 {
-	return 3*(nZ*(_nCellsY + 1)*(_nCellsX + 1) + nY*(_nCellsX + 1) + nX);
+	// the cells between lattice planes beginZ and endZ
+	unsigned int minVoxel = 0, maxVoxel = 0;
+	bool outside, empty;
+	sampler.getVoxelRange(beginZ, endZ, 2, minVoxel, maxVoxel, outside, empty);
+
+	if (!empty)
+		volume.prefetchSections(minVoxel, maxVoxel + 1);
 }
 
 template <typename Volume>
-void MarchingCubes<Volume>::RenameVerticesAndTriangles()
+void MarchingCubes<Volume>::stitchChunks(std::vector<Chunk>& chunks, std::vector<unsigned int>& seam)
 {
-	unsigned int nextId = 0;
-	Id2Point3dId::iterator mapIterator = _i2pt3idVertices.begin();
-	TriangleVector::iterator vecIterator = _trivecTriangles.begin();
-
-	// Rename vertices.
-	while (mapIterator != _i2pt3idVertices.end()) {
-		(*mapIterator).second.newId = nextId;
-		nextId++;
-		mapIterator++;
+	// For each chunk, the mesh index of each of its vertices. The intersected 
+	// x- and y-edges of the first lattice plane of a chunk have already been 
+	// found (and numbered) by the previous chunk. All other vertices are 
+	// numbered in the order of the chunks, which is the order a single chunk 
+	// would have used.
+	std::vector<unsigned int> ids;
+
+	unsigned int nextTriangle = _nTriangles;
+	unsigned int maxVertices  = _nVertices;
+	for (unsigned int c = 0; c < chunks.size(); c++) {
+
+		_nTriangles  += chunks[c].triangles.size();
+		maxVertices  += chunks[c].vertices.size();
 	}
 
-	// Now rename triangles.
-	while (vecIterator != _trivecTriangles.end()) {
-		for (unsigned int i = 0; i < 3; i++) {
-			unsigned int newId = _i2pt3idVertices[(*vecIterator).pointId[i]].newId;
-			(*vecIterator).pointId[i] = newId;
-		}
-		vecIterator++;
-	}
+	// grow the mesh once, make room for all vertices, the unused ones are 
+	// removed below
+	_mesh->setNumTriangles(_nTriangles);
+	_mesh->setNumVertices(maxVertices);
 
-	// Copy all the vertices and triangles into two arrays so that they
-	// can be efficiently accessed.
-	// Copy vertices.
-	mapIterator = _i2pt3idVertices.begin();
-	_nVertices = _i2pt3idVertices.size();
-	_mesh->setNumVertices(_nVertices);
+	Point3d*  vertices  = _mesh->getVertices();
+	Triangle* triangles = _mesh->getTriangles();
 
-	LOG_DEBUG(marchingcubeslog) << "created a mesh with " << _nVertices << " vertices" << std::endl;
+	for (unsigned int c = 0; c < chunks.size(); c++) {
 
-	for (unsigned int i = 0; i < _nVertices; i++, mapIterator++)
-		_mesh->setVertex(i, mapIterator->second);
+		Chunk& chunk = chunks[c];
 
-	// Copy vertex indices which make triangles.
-	vecIterator = _trivecTriangles.begin();
-	_nTriangles = _trivecTriangles.size();
-	_mesh->setNumTriangles(_nTriangles);
+		ids.assign(chunk.vertices.size(), Invalid);
+
+		if (!seam.empty())
+			for (unsigned int i = 0; i < chunk.firstPlane.size(); i++)
+				if (i%3 != 2 && chunk.firstPlane[i] != Invalid)
+					ids[chunk.firstPlane[i]] = seam[i];
 
-	for (unsigned int i = 0; i < _nTriangles; i++, vecIterator++)
-		_mesh->setTriangle(i,(*vecIterator).pointId[0], (*vecIterator).pointId[1], (*vecIterator).pointId[2]);
+		for (unsigned int i = 0; i < chunk.vertices.size(); i++)
+			if (ids[i] == Invalid) {
 
-	_i2pt3idVertices.clear();
-	_trivecTriangles.clear();
+				ids[i] = _nVertices;
+				vertices[_nVertices] = chunk.vertices[i];
+				_nVertices++;
+			}
+
+		for (unsigned int i = 0; i < chunk.triangles.size(); i++, nextTriangle++)
+			triangles[nextTriangle] = Triangle(
+					ids[chunk.triangles[i].v0],
+					ids[chunk.triangles[i].v1],
+					ids[chunk.triangles[i].v2]);
+
+		seam.resize(chunk.lastPlane.size());
+		for (unsigned int i = 0; i < chunk.lastPlane.size(); i++)
+			seam[i] = (chunk.lastPlane[i] == Invalid ? Invalid : ids[chunk.lastPlane[i]]);
+
+		// free memory as early as possible
+		std::vector<Point3d>().swap(chunk.vertices);
+		std::vector<Triangle>().swap(chunk.triangles);
+		std::vector<unsigned int>().swap(chunk.firstPlane);
+		std::vector<unsigned int>().swap(chunk.lastPlane);
+	}
+
+	_mesh->setNumVertices(_nVertices);
 }
 
 template <typename Volume>
-void MarchingCubes<Volume>::CalculateNormals()
+boost::shared_ptr<Meshes>
+MarchingCubes<Volume>::stitchLabelChunks(std::vector<LabelChunk>& chunks) const
 {
-	_nNormals = _nVertices;
-	
-	// Set all normals to 0.
-	for (unsigned int i = 0; i < _nNormals; i++)
-		_mesh->setNormal(i, Vector3d(0, 0, 0));
-
-	// Calculate normals.
-	for (unsigned int i = 0; i < _nTriangles; i++) {
-		Vector3d vec1, vec2, normal;
-		unsigned int id0, id1, id2;
-		id0 = _mesh->getTriangle(i).v0;
-		id1 = _mesh->getTriangle(i).v1;
-		id2 = _mesh->getTriangle(i).v2;
-		vec1.x = _mesh->getVertex(id1).x - _mesh->getVertex(id0).x;
-		vec1.y = _mesh->getVertex(id1).y - _mesh->getVertex(id0).y;
-		vec1.z = _mesh->getVertex(id1).z - _mesh->getVertex(id0).z;
-		vec2.x = _mesh->getVertex(id2).x - _mesh->getVertex(id0).x;
-		vec2.y = _mesh->getVertex(id2).y - _mesh->getVertex(id0).y;
-		vec2.z = _mesh->getVertex(id2).z - _mesh->getVertex(id0).z;
-		normal.x = vec1.z*vec2.y - vec1.y*vec2.z;
-		normal.y = vec1.x*vec2.z - vec1.z*vec2.x;
-		normal.z = vec1.y*vec2.x - vec1.x*vec2.y;
-		_mesh->getNormal(id0) += normal;
-		_mesh->getNormal(id1) += normal;
-		_mesh->getNormal(id2) += normal;
-	}
+	boost::shared_ptr<Meshes> meshes = boost::make_shared<Meshes>();
+
+	// all labels found in any chunk, in increasing order
+	std::set<value_type> labels;
+	for (unsigned int c = 0; c < chunks.size(); c++)
+		labels.insert(chunks[c].labels.begin(), chunks[c].labels.end());
+
+	std::vector<unsigned int> previousIds;
+	std::vector<unsigned int> ids;
+
+	for (typename std::set<value_type>::const_iterator label = labels.begin(); label != labels.end(); label++) {
+
+		std::vector<Point3d>  vertices;
+		std::vector<Triangle> triangles;
+
+		// the index of the label in the previous chunk, if any
+		unsigned int previousIndex = Invalid;
 
-	// Normalize normals.
-	for (unsigned int i = 0; i < _nNormals; i++) {
-		float length = sqrt(
-				_mesh->getNormal(i).x*_mesh->getNormal(i).x +
-				_mesh->getNormal(i).y*_mesh->getNormal(i).y +
-				_mesh->getNormal(i).z*_mesh->getNormal(i).z);
-		_mesh->getNormal(i).x /= length;
-		_mesh->getNormal(i).y /= length;
-		_mesh->getNormal(i).z /= length;
+		for (unsigned int c = 0; c < chunks.size(); c++) {
+
+			LabelChunk& chunk = chunks[c];
+
+			typename boost::unordered_map<value_type, unsigned int>::const_iterator i = chunk.labelIndices.find(*label);
+
+			if (i == chunk.labelIndices.end()) {
+
+				previousIndex = Invalid;
+				continue;
+			}
+
+			unsigned int labelIndex = i->second;
+
+			ids.assign(chunk.vertices[labelIndex].size(), Invalid);
+
+			// weld the vertices on the plane shared with the previous chunk
+			if (previousIndex != Invalid)
+				for (unsigned int j = 0; j < chunk.firstPlane[labelIndex].size(); j++) {
+
+					boost::uint64_t key =
+							(static_cast<boost::uint64_t>(previousIndex) << 32) |
+							chunk.firstPlane[labelIndex][j].first;
+
+					ids[chunk.firstPlane[labelIndex][j].second] = previousIds[chunks[c-1].lastPlane.find(key)->second];
+				}
+
+			for (unsigned int j = 0; j < ids.size(); j++)
+				if (ids[j] == Invalid) {
+
+					ids[j] = vertices.size();
+					vertices.push_back(chunk.vertices[labelIndex][j]);
+				}
+
+			for (unsigned int j = 0; j < chunk.triangles[labelIndex].size(); j++) {
+
+				const Triangle& triangle = chunk.triangles[labelIndex][j];
+				triangles.push_back(Triangle(ids[triangle.v0], ids[triangle.v1], ids[triangle.v2]));
+			}
+
+			previousIds.swap(ids);
+			previousIndex = labelIndex;
+		}
+
+		// allocate the mesh once and copy the arrays in bulk
+		boost::shared_ptr<Mesh> mesh = boost::make_shared<Mesh>(vertices.size(), triangles.size());
+
+		std::copy(vertices.begin(),  vertices.end(),  mesh->getVertices());
+		std::copy(triangles.begin(), triangles.end(), mesh->getTriangles());
+		mesh->setVerticesChanged();
+
+		CalculateNormals(*mesh);
+
+		meshes->add(static_cast<unsigned int>(*label), mesh);
 	}
+
+	return meshes;
 }
 
+template <typename Volume>
+void MarchingCubes<Volume>::CalculateNormals(Mesh& mesh) const
+{
+	MeshNormals(MeshNormals::AreaWeighted, _numThreads).computeNormals(mesh);
+}
 
 #endif // GUI_MARCHING_CUBES_H__
 
@@ -1,70 +1,218 @@
+#include <cstdlib>
+#include <new>
+#include <boost/static_assert.hpp>
 #include "Mesh.h"
 
-Mesh
-Mesh::createSubmesh(const std::vector<unsigned int>& triangles) {
+// the arrays are handed to OpenGl as they are
+BOOST_STATIC_ASSERT(sizeof(Point3d)  == 3*sizeof(float));
+BOOST_STATIC_ASSERT(sizeof(Vector3d) == 3*sizeof(float));
+BOOST_STATIC_ASSERT(sizeof(Triangle) == 3*sizeof(unsigned int));
+
+Mesh::Mesh() :
+	_arena(0),
+	_vertexCapacity(0),
+	_triangleCapacity(0),
+	_numVertices(0),
+	_numTriangles(0),
+	_vertices(0),
+	_normals(0),
+	_triangles(0),
+	_revision(0) {}
+
+Mesh::Mesh(unsigned int numVertices, unsigned int numTriangles) :
+	_arena(0),
+	_vertexCapacity(0),
+	_triangleCapacity(0),
+	_numVertices(0),
+	_numTriangles(0),
+	_vertices(0),
+	_normals(0),
+	_triangles(0),
+	_revision(0) {
+
+	reallocate(numVertices, numTriangles);
+
+	_numVertices  = numVertices;
+	_numTriangles = numTriangles;
+}
 
-	Mesh submesh;
+Mesh::Mesh(const Mesh& other) :
+	pipeline::Data(other),
+	Volume(other),
+	_arena(0),
+	_vertexCapacity(0),
+	_triangleCapacity(0),
+	_numVertices(0),
+	_numTriangles(0),
+	_vertices(0),
+	_normals(0),
+	_triangles(0),
+	_revision(0) {
+
+	*this = other;
+}
 
-	submesh._vertices = _vertices;
-	submesh._normals  = _normals;
+Mesh::~Mesh() {
 
-	submesh._triangles.reserve(triangles.size());
+	std::free(_arena);
+}
 
-	foreach (unsigned int triangle, triangles)
-		submesh._triangles.push_back(_triangles[triangle]);
+Mesh&
+Mesh::operator=(const Mesh& other) {
 
-	submesh.strip();
+	if (&other == this)
+		return *this;
 
-	return submesh;
+	if (other._numVertices > _vertexCapacity || other._numTriangles > _triangleCapacity)
+		reallocate(
+				std::max(other._numVertices, _vertexCapacity),
+				std::max(other._numTriangles, _triangleCapacity));
+
+	_numVertices  = other._numVertices;
+	_numTriangles = other._numTriangles;
+
+	std::copy(other._vertices,  other._vertices  + _numVertices,  _vertices);
+	std::copy(other._normals,   other._normals   + _numVertices,  _normals);
+	std::copy(other._triangles, other._triangles + _numTriangles, _triangles);
+
+	_levelsOfDetail = other._levelsOfDetail;
+
+	setVerticesChanged();
+
+	return *this;
 }
 
 void
-Mesh::strip() {
+Mesh::setNumVertices(unsigned int numVertices) {
 
-	std::vector<unsigned int> vertexTag(getNumVertices(), std::numeric_limits<unsigned int>::max());
+	if (numVertices > _vertexCapacity)
+		reallocate(std::max(numVertices, 2*_vertexCapacity), _triangleCapacity);
 
-	// tag all used vertices with 0
+	if (numVertices > _numVertices) {
 
-	foreach (const Triangle& triangle, _triangles) {
-
-		vertexTag[triangle.v0] = 0;
-		vertexTag[triangle.v1] = 0;
-		vertexTag[triangle.v2] = 0;
+		std::fill(_vertices + _numVertices, _vertices + numVertices, Point3d());
+		std::fill(_normals  + _numVertices, _normals  + numVertices, Vector3d());
 	}
 
-	// create a vector of the used vertices (and normals)
+	_numVertices = numVertices;
+
+	setVerticesChanged();
+}
+
+void
+Mesh::setNumTriangles(unsigned int numTriangles) {
+
+	if (numTriangles > _triangleCapacity)
+		reallocate(_vertexCapacity, std::max(numTriangles, 2*_triangleCapacity));
+
+	if (numTriangles > _numTriangles)
+		std::fill(_triangles + _numTriangles, _triangles + numTriangles, Triangle());
+
+	_numTriangles = numTriangles;
+
+	setTrianglesChanged();
+}
+
+void
+Mesh::addLevelOfDetail(boost::shared_ptr<Mesh> mesh, float error) {
+
+	_levelsOfDetail.push_back(std::make_pair(mesh, error));
+	_revision++;
+}
+
+void
+Mesh::clearLevelsOfDetail() {
+
+	_levelsOfDetail.clear();
+	_revision++;
+}
+
+void
+Mesh::reserve(unsigned int numVertices, unsigned int numTriangles) {
+
+	if (numVertices > _vertexCapacity || numTriangles > _triangleCapacity)
+		reallocate(
+				std::max(numVertices, _vertexCapacity),
+				std::max(numTriangles, _triangleCapacity));
+}
+
+void
+Mesh::reallocate(unsigned int vertexCapacity, unsigned int triangleCapacity) {
+
+	std::size_t size =
+			static_cast<std::size_t>(vertexCapacity)*(sizeof(Point3d) + sizeof(Vector3d)) +
+			static_cast<std::size_t>(triangleCapacity)*sizeof(Triangle);
 
-	std::vector<Point3d>  usedVertices;
-	std::vector<Vector3d> usedNormals;
+	char* arena = static_cast<char*>(std::malloc(size));
 
-	unsigned int newIndex = 0;
-	for (unsigned int i = 0; i < getNumVertices(); i++) {
+	if (size > 0 && !arena)
+		throw std::bad_alloc();
 
-		if (vertexTag[i] == 0) { // vertex is used
+	Point3d*  vertices  = reinterpret_cast<Point3d*>(arena);
+	Vector3d* normals   = reinterpret_cast<Vector3d*>(vertices + vertexCapacity);
+	Triangle* triangles = reinterpret_cast<Triangle*>(normals + vertexCapacity);
 
-			// keep the vertex
+	std::copy(_vertices,  _vertices  + _numVertices,  vertices);
+	std::copy(_normals,   _normals   + _numVertices,  normals);
+	std::copy(_triangles, _triangles + _numTriangles, triangles);
 
-			usedVertices.push_back(_vertices[i]);
-			usedNormals.push_back(_normals[i]);
+	std::free(_arena);
+
+	_arena            = arena;
+	_vertexCapacity   = vertexCapacity;
+	_triangleCapacity = triangleCapacity;
+	_vertices         = vertices;
+	_normals          = normals;
+	_triangles        = triangles;
+}
+
+Mesh
+Mesh::createSubmesh(const std::vector<unsigned int>& triangles) {
 
-			// tag the vertex with the new index in the reduced vector
+	const unsigned int Invalid = std::numeric_limits<unsigned int>::max();
 
-			vertexTag[i] = newIndex;
-			newIndex++;
-		}
+	if (_submeshIds.size() < _numVertices)
+		_submeshIds.resize(_numVertices, Invalid);
+
+	// number the used vertices in the order they are first used
+
+	_submeshVertices.clear();
+
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+
+		const Triangle& triangle = _triangles[triangles[i]];
+
+		const unsigned int corners[3] = { triangle.v0, triangle.v1, triangle.v2 };
+
+		for (int j = 0; j < 3; j++)
+			if (_submeshIds[corners[j]] == Invalid) {
+
+				_submeshIds[corners[j]] = _submeshVertices.size();
+				_submeshVertices.push_back(corners[j]);
+			}
 	}
 
-	// use the reduced vector of vertices (and normals)
+	Mesh submesh(_submeshVertices.size(), triangles.size());
 
-	_vertices = usedVertices;
-	_normals  = usedNormals;
+	for (unsigned int i = 0; i < triangles.size(); i++) {
 
-	// update the indices in the triangles
+		const Triangle& triangle = _triangles[triangles[i]];
 
-	foreach (Triangle& triangle, _triangles) {
+		submesh._triangles[i] = Triangle(
+				_submeshIds[triangle.v0],
+				_submeshIds[triangle.v1],
+				_submeshIds[triangle.v2]);
+	}
+
+	// copy the used vertices (and normals) and invalidate the ids again
+
+	for (unsigned int i = 0; i < _submeshVertices.size(); i++) {
 
-		triangle.v0 = vertexTag[triangle.v0];
-		triangle.v1 = vertexTag[triangle.v1];
-		triangle.v2 = vertexTag[triangle.v2];
+		submesh._vertices[i] = _vertices[_submeshVertices[i]];
+		submesh._normals[i]  = _normals[_submeshVertices[i]];
+
+		_submeshIds[_submeshVertices[i]] = Invalid;
 	}
+
+	return submesh;
 }
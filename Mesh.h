@@ -1,7 +1,10 @@
 #ifndef GUI_MESH_H__
 #define GUI_MESH_H__
 
+#include <algorithm>
+#include <limits>
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include <imageprocessing/Volume.h>
 #include <pipeline/Data.h>
 #include <util/foreach.h>
@@ -11,42 +14,75 @@
 
 /**
  * A 3D mesh as a list of triangles.
+ *
+ * The vertices, normals, and triangles are stored as three tightly packed 
+ * arrays (of three floats, three floats, and three unsigned ints per 
+ * element) in a single allocation. The arrays returned by getVertices(), 
+ * getNormals(), and getTriangles() can be passed as they are to OpenGl as 
+ * vertex, normal, and index (GL_UNSIGNED_INT) arrays or buffers.
+ *
+ * Large meshes should be built in bulk: Create the mesh with the final 
+ * number of vertices and triangles (a single allocation), write the arrays 
+ * directly, and call setVerticesChanged() once.
+ *
+ * A mesh can carry coarser versions of itself (levels of detail, see 
+ * addLevelOfDetail()), to be drawn instead when it is small on the screen.
  */
 class Mesh : public pipeline::Data, public Volume {
 
 public:
 
-	Mesh() {}
+	Mesh();
 
 	/**
-	 * Set the number of vertices (and normals) to allocate for this mesh.
+	 * Create a mesh with the given number of vertices (and normals) and 
+	 * triangles. The content of the arrays is undefined.
 	 */
-	void setNumVertices(unsigned int numVertices)   { _vertices.resize(numVertices); _normals.resize(numVertices); }
+	Mesh(unsigned int numVertices, unsigned int numTriangles);
+
+	Mesh(const Mesh& other);
+
+	~Mesh();
+
+	Mesh& operator=(const Mesh& other);
+
+	/**
+	 * Set the number of vertices (and normals) of this mesh. New vertices 
+	 * and normals are set to zero.
+	 */
+	void setNumVertices(unsigned int numVertices);
 
 	/**
-	 * Set the number of triangles to allocate for this mesh.
+	 * Set the number of triangles of this mesh. New triangles are set to (0, 
+	 * 0, 0).
 	 */
-	void setNumTriangles(unsigned int numTriangles) { _triangles.resize(numTriangles); }
+	void setNumTriangles(unsigned int numTriangles);
+
+	/**
+	 * Allocate memory for the given number of vertices and triangles, 
+	 * without changing the size of the mesh.
+	 */
+	void reserve(unsigned int numVertices, unsigned int numTriangles);
 
 	/**
 	 * Number of vertices (and normals) of this mesh.
 	 */
-	unsigned int getNumVertices()   { return _vertices.size(); }
+	unsigned int getNumVertices() const  { return _numVertices; }
 
 	/**
 	 * The number of triangles that constitute this mesh.
 	 */
-	unsigned int getNumTriangles() { return _triangles.size(); }
+	unsigned int getNumTriangles() const { return _numTriangles; }
 
 	/**
 	 * Set a vertex by index.
 	 */
-	void setVertex(unsigned int index, const Point3d&  vertex) { _vertices[index] = vertex; setBoundingBoxDirty(); }
+	void setVertex(unsigned int index, const Point3d&  vertex) { _vertices[index] = vertex; setVerticesChanged(); }
 
 	/**
 	 * Set a vertex' normal by index.
 	 */
-	void setNormal(unsigned int index, const Vector3d& normal) { _normals[index]  = normal; }
+	void setNormal(unsigned int index, const Vector3d& normal) { _normals[index]  = normal; _revision++; }
 
 	/**
 	 * Set a triangle by specifying three vertices by index.
@@ -58,6 +94,7 @@ public:
 			unsigned int v3) {
 
 		_triangles[index] = Triangle(v1, v2, v3);
+		_revision++;
 	}
 
 	/**
@@ -79,19 +116,84 @@ public:
 	const Triangle& getTriangle(unsigned int index) const { return _triangles[index]; }
 
 	/**
-	 * Get a vector of all vertices of this mesh.
+	 * Get the array of all vertices of this mesh. If vertices are changed 
+	 * through this array, call setVerticesChanged() afterwards.
+	 */
+	Point3d*        getVertices()        { return _vertices; }
+	const Point3d*  getVertices()  const { return _vertices; }
+
+	/**
+	 * Get the array of all normals of this mesh. If normals are changed 
+	 * through this array, call setNormalsChanged() afterwards.
 	 */
-	const std::vector<Point3d>&  getVertices()  const { return _vertices; }
+	Vector3d*       getNormals()         { return _normals; }
+	const Vector3d* getNormals()   const { return _normals; }
 
 	/**
-	 * Get a vector of all normals of this mesh.
+	 * Get the array of all triangles that constitute this mesh. If triangles 
+	 * are changed through this array, call setTrianglesChanged() afterwards.
 	 */
-	const std::vector<Vector3d>& getNormals()   const { return _normals; }
+	Triangle*       getTriangles()       { return _triangles; }
+	const Triangle* getTriangles() const { return _triangles; }
 
 	/**
-	 * Get a vector of all triangles that constitute this mesh.
+	 * Tell the mesh that vertices have been changed through getVertices(), 
+	 * such that the bounding box gets updated.
 	 */
-	const std::vector<Triangle>& getTriangles() const { return _triangles; }
+	void setVerticesChanged() { _revision++; setBoundingBoxDirty(); }
+
+	/**
+	 * Tell the mesh that normals have been changed through getNormals().
+	 */
+	void setNormalsChanged() { _revision++; }
+
+	/**
+	 * Tell the mesh that triangles have been changed through getTriangles().
+	 */
+	void setTrianglesChanged() { _revision++; }
+
+	/**
+	 * A number that changes whenever the content of this mesh changes 
+	 * through its setters, setNumVertices(), setNumTriangles(), or one of the 
+	 * set*Changed() methods. Can be used to find out whether copies of the 
+	 * mesh (like buffers on the GPU) are still up to date.
+	 */
+	unsigned int getRevision() const { return _revision; }
+
+	/**
+	 * Add a coarser version of this mesh. Levels have to be added from fine 
+	 * to coarse. They are shared with copies of this mesh, and not updated 
+	 * when this mesh changes.
+	 *
+	 * @param mesh
+	 *              The coarser mesh.
+	 * @param error
+	 *              An upper bound of the distance of the vertices of this 
+	 *              mesh to the surface of the coarser mesh (in units of the 
+	 *              mesh).
+	 */
+	void addLevelOfDetail(boost::shared_ptr<Mesh> mesh, float error);
+
+	/**
+	 * Remove all coarser versions of this mesh.
+	 */
+	void clearLevelsOfDetail();
+
+	/**
+	 * The number of levels of detail, including this mesh.
+	 */
+	unsigned int getNumLevelsOfDetail() const { return _levelsOfDetail.size() + 1; }
+
+	/**
+	 * Get a level of detail. Level 0 is this mesh, higher levels are 
+	 * coarser.
+	 */
+	const Mesh& getLevelOfDetail(unsigned int level) const { return (level == 0 ? *this : *_levelsOfDetail[level - 1].first); }
+
+	/**
+	 * Get the error of a level of detail (0 for level 0).
+	 */
+	float getLevelOfDetailError(unsigned int level) const { return (level == 0 ? 0.0f : _levelsOfDetail[level - 1].second); }
 
 	/**
 	 * Create a submesh from a selection of triangles of this mesh.
@@ -99,7 +201,13 @@ public:
 	 * @param triangles
 	 *              Indices of the triangles to use in the submesh.
 	 *
-	 * @return A mesh containing only the specified triangles.
+	 * @return A mesh containing only the specified triangles and the 
+	 *         vertices (and normals) they use, in the order they are first 
+	 *         used.
+	 *
+	 * Only the vertices of the selected triangles are visited, such that 
+	 * small submeshes of large meshes are cheap. See Submesh for a 
+	 * selection that does not copy any vertices.
 	 */
 	Mesh createSubmesh(const std::vector<unsigned int>& triangles);
 
@@ -110,17 +218,18 @@ private:
 		float minX, minY, minZ;
 		float maxX, maxY, maxZ;
 
-		minX = minY = minZ = std::numeric_limits<float>::max();
-		maxX = maxY = maxZ = std::numeric_limits<float>::min();
+		minX = minY = minZ =  std::numeric_limits<float>::max();
+		maxX = maxY = maxZ = -std::numeric_limits<float>::max();
 
-		foreach (const Point3d& p, _vertices) {
+		const Point3d* end = _vertices + _numVertices;
+		for (const Point3d* p = _vertices; p != end; p++) {
 
-			minX = std::min(p.x, minX);
-			minY = std::min(p.y, minY);
-			minZ = std::min(p.z, minZ);
-			maxX = std::max(p.x, maxX);
-			maxY = std::max(p.y, maxY);
-			maxZ = std::max(p.z, maxZ);
+			minX = std::min(p->x, minX);
+			minY = std::min(p->y, minY);
+			minZ = std::min(p->z, minZ);
+			maxX = std::max(p->x, maxX);
+			maxY = std::max(p->y, maxY);
+			maxZ = std::max(p->z, maxZ);
 		}
 
 		return BoundingBox(
@@ -129,18 +238,43 @@ private:
 	}
 
 	/**
-	 * Remove all vertices (and normals) that are not used by any triangle.
+	 * Move the content of this mesh into a new arena with the given 
+	 * capacities.
 	 */
-	void strip();
+	void reallocate(unsigned int vertexCapacity, unsigned int triangleCapacity);
+
+	// the single allocation that holds the vertices, the normals, and the 
+	// triangles, each array followed by its unused capacity
+	char* _arena;
+
+	unsigned int _vertexCapacity;
+	unsigned int _triangleCapacity;
+
+	unsigned int _numVertices;
+	unsigned int _numTriangles;
 
 	// the vertices of the mesh
-	std::vector<Point3d>  _vertices;
+	Point3d*  _vertices;
 
 	// the normals, one for each vertex
-	std::vector<Vector3d> _normals;
+	Vector3d* _normals;
 
 	// list of triangles that make up the mesh
-	std::vector<Triangle> _triangles;
+	Triangle* _triangles;
+
+	// incremented with every change of the content
+	unsigned int _revision;
+
+	// coarser versions of this mesh and their errors
+	std::vector<std::pair<boost::shared_ptr<Mesh>, float> > _levelsOfDetail;
+
+	// Map from vertices of this mesh to vertices of a submesh, reused 
+	// between calls to createSubmesh(). All entries are invalid between 
+	// calls.
+	std::vector<unsigned int> _submeshIds;
+
+	// the vertices of this mesh that are used by a submesh
+	std::vector<unsigned int> _submeshVertices;
 };
 
 #endif // GUI_MESH_H__
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/timer/timer.hpp>
+#include <util/exceptions.h>
+#include <util/Logger.h>
+#include "MeshFile.h"
+
+static logger::LogChannel meshfilelog("meshfilelog", "[MeshFile] ");
+
+namespace {
+
+const char           Magic[8] = { 'G', 'U', 'I', 'M', 'E', 'S', 'H', 0 };
+const boost::uint32_t Version = 1;
+
+// the largest quantized coordinate
+const float MaxQuantized = 65535.0f;
+
+// the largest component of an encoded normal
+const float MaxSnorm = 32767.0f;
+
+std::size_t align(std::size_t size, std::size_t alignment) {
+
+	return ((size + alignment - 1)/alignment)*alignment;
+}
+
+float signNotZero(float value) {
+
+	return (value >= 0 ? 1.0f : -1.0f);
+}
+
+boost::int16_t toSnorm(float value) {
+
+	return static_cast<boost::int16_t>(std::floor(std::max(-1.0f, std::min(1.0f, value))*MaxSnorm + 0.5f));
+}
+
+// Project the normal on the octahedron |x| + |y| + |z| = 1 and fold the
+// lower half over the upper one, to get two values in [-1,1].
+void encodeNormal(const Vector3d& normal, boost::int16_t* encoded) {
+
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+
+	if (length == 0) {
+
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+
+	float x = normal.x/length;
+	float y = normal.y/length;
+
+	if (normal.z < 0) {
+
+		float foldedX = (1.0f - std::fabs(y))*signNotZero(x);
+		float foldedY = (1.0f - std::fabs(x))*signNotZero(y);
+
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = toSnorm(x);
+	encoded[1] = toSnorm(y);
+}
+
+Vector3d decodeNormal(const boost::int16_t* encoded) {
+
+	float x = std::max(-1.0f, encoded[0]/MaxSnorm);
+	float y = std::max(-1.0f, encoded[1]/MaxSnorm);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+	if (z < 0) {
+
+		float unfoldedX = (1.0f - std::fabs(y))*signNotZero(x);
+		float unfoldedY = (1.0f - std::fabs(x))*signNotZero(y);
+
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float length = std::sqrt(x*x + y*y + z*z);
+
+	return Vector3d(x/length, y/length, z/length);
+}
+
+// Write the triangles of a mesh with indices of the given type.
+template <typename IndexType>
+void writeIndices(std::ofstream& out, const Mesh& mesh) {
+
+	std::vector<IndexType> indices(3*mesh.getNumTriangles());
+
+	const Triangle* triangles = mesh.getTriangles();
+
+	for (unsigned int i = 0; i < mesh.getNumTriangles(); i++) {
+
+		indices[3*i    ] = static_cast<IndexType>(triangles[i].v0);
+		indices[3*i + 1] = static_cast<IndexType>(triangles[i].v1);
+		indices[3*i + 2] = static_cast<IndexType>(triangles[i].v2);
+	}
+
+	if (!indices.empty())
+		out.write(reinterpret_cast<const char*>(&indices[0]), indices.size()*sizeof(IndexType));
+}
+
+// Read the triangles of a mesh from indices of the given type. Returns false
+// if an index does not refer to a vertex of the mesh.
+template <typename IndexType>
+bool readIndices(const char* data, Mesh& mesh) {
+
+	const IndexType* indices = reinterpret_cast<const IndexType*>(data);
+
+	Triangle* triangles = mesh.getTriangles();
+
+	unsigned int numVertices = mesh.getNumVertices();
+
+	for (unsigned int i = 0; i < mesh.getNumTriangles(); i++) {
+
+		if (indices[3*i] >= numVertices || indices[3*i + 1] >= numVertices || indices[3*i + 2] >= numVertices)
+			return false;
+
+		triangles[i] = Triangle(indices[3*i], indices[3*i + 1], indices[3*i + 2]);
+	}
+
+	return true;
+}
+
+void pad(std::ofstream& out, std::size_t alignment) {
+
+	static const char zeros[8] = { 0 };
+
+	std::size_t position = out.tellp();
+
+	out.write(zeros, align(position, alignment) - position);
+}
+
+} // anonymous namespace
+
+void
+MeshFile::write(const std::string& filename, Meshes& meshes) {
+
+	boost::timer::cpu_timer timer;
+
+	std::ofstream out(filename.c_str(), std::ios::binary);
+
+	if (!out)
+		BOOST_THROW_EXCEPTION(IOError() << error_message("can not open " + filename + " for writing") << STACK_TRACE);
+
+	const std::vector<unsigned int>& ids = meshes.getMeshIds();
+
+	Header header;
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version   = Version;
+	header.numMeshes = ids.size();
+
+	// the table of contents
+
+	std::vector<Entry> entries(ids.size());
+
+	std::size_t offset = align(sizeof(Header) + entries.size()*sizeof(Entry), 8);
+
+	for (unsigned int i = 0; i < ids.size(); i++) {
+
+		const Mesh& mesh = *meshes.get(ids[i]);
+
+		Entry& entry = entries[i];
+
+		entry.id           = ids[i];
+		entry.numVertices  = mesh.getNumVertices();
+		entry.numTriangles = mesh.getNumTriangles();
+		entry.indexSize    = (mesh.getNumVertices() <= 65536 ? 2 : 4);
+		entry.offset       = offset;
+
+		const BoundingBox& boundingBox = mesh.getBoundingBox();
+
+		if (mesh.getNumVertices() == 0) {
+
+			std::fill(entry.origin, entry.origin + 3, 0.0f);
+			std::fill(entry.step,   entry.step   + 3, 0.0f);
+
+		} else {
+
+			entry.origin[0] = boundingBox.getMinX();
+			entry.origin[1] = boundingBox.getMinY();
+			entry.origin[2] = boundingBox.getMinZ();
+			entry.step[0]   = boundingBox.width()/MaxQuantized;
+			entry.step[1]   = boundingBox.height()/MaxQuantized;
+			entry.step[2]   = boundingBox.depth()/MaxQuantized;
+		}
+
+		offset += dataSize(entry);
+	}
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	if (!entries.empty())
+		out.write(reinterpret_cast<const char*>(&entries[0]), entries.size()*sizeof(Entry));
+	pad(out, 8);
+
+	// the meshes
+
+	for (unsigned int i = 0; i < ids.size(); i++) {
+
+		const Mesh&  mesh  = *meshes.get(ids[i]);
+		const Entry& entry = entries[i];
+
+		unsigned int numVertices = mesh.getNumVertices();
+
+		std::vector<boost::uint16_t> positions(3*numVertices);
+		std::vector<boost::int16_t>  normals(2*numVertices);
+
+		const Point3d*  vertices      = mesh.getVertices();
+		const Vector3d* vertexNormals = mesh.getNormals();
+
+		for (unsigned int v = 0; v < numVertices; v++) {
+
+			const float coordinates[3] = { vertices[v].x, vertices[v].y, vertices[v].z };
+
+			for (int d = 0; d < 3; d++) {
+
+				float quantized = (entry.step[d] > 0 ? (coordinates[d] - entry.origin[d])/entry.step[d] : 0.0f);
+
+				positions[3*v + d] = static_cast<boost::uint16_t>(std::floor(std::max(0.0f, std::min(MaxQuantized, quantized)) + 0.5f));
+			}
+
+			encodeNormal(vertexNormals[v], &normals[2*v]);
+		}
+
+		if (numVertices > 0) {
+
+			out.write(reinterpret_cast<const char*>(&positions[0]), positions.size()*sizeof(boost::uint16_t));
+			out.write(reinterpret_cast<const char*>(&normals[0]),   normals.size()*sizeof(boost::int16_t));
+		}
+		pad(out, 4);
+
+		if (entry.indexSize == 2)
+			writeIndices<boost::uint16_t>(out, mesh);
+		else
+			writeIndices<boost::uint32_t>(out, mesh);
+		pad(out, 8);
+	}
+
+	if (!out)
+		BOOST_THROW_EXCEPTION(IOError() << error_message("can not write " + filename) << STACK_TRACE);
+
+	LOG_DEBUG(meshfilelog)
+			<< "wrote " << ids.size() << " meshes (" << offset << " bytes) to "
+			<< filename << ":" << timer.format() << std::endl;
+}
+
+boost::shared_ptr<Meshes>
+MeshFile::read(const std::string& filename) {
+
+	boost::shared_ptr<MeshFile> file = boost::make_shared<MeshFile>(filename);
+	boost::shared_ptr<Meshes>   meshes = boost::make_shared<Meshes>();
+
+	// the loaders keep the file mapped until all meshes have been loaded or
+	// the meshes are destructed
+	for (unsigned int i = 0; i < file->_numMeshes; i++) {
+
+		const Entry& entry = file->_entries[i];
+
+		meshes->addLazy(
+				entry.id,
+				boost::bind(&MeshFile::load, file, entry.id),
+				file->getBoundingBox(entry.id));
+	}
+
+	return meshes;
+}
+
+MeshFile::MeshFile(const std::string& filename) :
+	_filename(filename),
+	_file(filename),
+	_entries(0),
+	_numMeshes(0) {
+
+	if (_file.size() < sizeof(Header))
+		BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " is not a mesh file") << STACK_TRACE);
+
+	const Header* header = reinterpret_cast<const Header*>(_file.data());
+
+	if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+		BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " is not a mesh file") << STACK_TRACE);
+
+	if (header->version != Version)
+		BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " has an unsupported mesh file version") << STACK_TRACE);
+
+	if ((_file.size() - sizeof(Header))/sizeof(Entry) < header->numMeshes)
+		BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " is truncated") << STACK_TRACE);
+
+	_entries   = reinterpret_cast<const Entry*>(_file.data() + sizeof(Header));
+	_numMeshes = header->numMeshes;
+
+	for (unsigned int i = 0; i < _numMeshes; i++) {
+
+		if (_entries[i].indexSize != 2 && _entries[i].indexSize != 4)
+			BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " is not a valid mesh file") << STACK_TRACE);
+
+		// without overflows for huge offsets and sizes
+		if (_entries[i].offset > _file.size() || dataSize(_entries[i]) > _file.size() - _entries[i].offset)
+			BOOST_THROW_EXCEPTION(IOError() << error_message(filename + " is truncated") << STACK_TRACE);
+
+		_index[_entries[i].id] = &_entries[i];
+	}
+
+	LOG_DEBUG(meshfilelog) << "opened " << filename << " with " << _numMeshes << " meshes" << std::endl;
+}
+
+std::vector<unsigned int>
+MeshFile::getMeshIds() const {
+
+	std::vector<unsigned int> ids(_numMeshes);
+
+	for (unsigned int i = 0; i < _numMeshes; i++)
+		ids[i] = _entries[i].id;
+
+	return ids;
+}
+
+BoundingBox
+MeshFile::getBoundingBox(unsigned int id) const {
+
+	const Entry* entry = find(id);
+
+	if (!entry || entry->numVertices == 0)
+		return BoundingBox();
+
+	return BoundingBox(
+			entry->origin[0],
+			entry->origin[1],
+			entry->origin[2],
+			entry->origin[0] + entry->step[0]*MaxQuantized,
+			entry->origin[1] + entry->step[1]*MaxQuantized,
+			entry->origin[2] + entry->step[2]*MaxQuantized);
+}
+
+boost::shared_ptr<Mesh>
+MeshFile::load(unsigned int id) const {
+
+	const Entry* entry = find(id);
+
+	if (!entry)
+		return boost::shared_ptr<Mesh>();
+
+	boost::timer::cpu_timer timer;
+
+	unsigned int numVertices  = entry->numVertices;
+	unsigned int numTriangles = entry->numTriangles;
+
+	const char* begin = _file.data() + entry->offset;
+
+	const boost::uint16_t* positions = reinterpret_cast<const boost::uint16_t*>(begin);
+	const boost::int16_t*  normals   = reinterpret_cast<const boost::int16_t*>(begin + 6*numVertices);
+	const char*            indices   = begin + align(10*numVertices, 4);
+
+	boost::shared_ptr<Mesh> mesh = boost::make_shared<Mesh>(numVertices, numTriangles);
+
+	Point3d*  vertices      = mesh->getVertices();
+	Vector3d* vertexNormals = mesh->getNormals();
+
+	for (unsigned int v = 0; v < numVertices; v++) {
+
+		vertices[v] = Point3d(
+				entry->origin[0] + positions[3*v    ]*entry->step[0],
+				entry->origin[1] + positions[3*v + 1]*entry->step[1],
+				entry->origin[2] + positions[3*v + 2]*entry->step[2]);
+
+		vertexNormals[v] = decodeNormal(&normals[2*v]);
+	}
+
+	bool valid;
+	if (entry->indexSize == 2)
+		valid = readIndices<boost::uint16_t>(indices, *mesh);
+	else
+		valid = readIndices<boost::uint32_t>(indices, *mesh);
+
+	if (!valid)
+		BOOST_THROW_EXCEPTION(IOError() << error_message(_filename + " contains invalid vertex indices") << STACK_TRACE);
+
+	mesh->setVerticesChanged();
+
+	// the data is not needed anymore, don't keep it resident
+	_file.release(entry->offset, entry->offset + dataSize(*entry));
+
+	LOG_ALL(meshfilelog)
+			<< "loaded mesh " << id << " with " << numTriangles
+			<< " triangles:" << timer.format() << std::endl;
+
+	return mesh;
+}
+
+std::size_t
+MeshFile::dataSize(const Entry& entry) {
+
+	return align(
+			align(10*static_cast<std::size_t>(entry.numVertices), 4) +
+			3*static_cast<std::size_t>(entry.numTriangles)*entry.indexSize,
+			8);
+}
+
+const MeshFile::Entry*
+MeshFile::find(unsigned int id) const {
+
+	std::map<unsigned int, const Entry*>::const_iterator i = _index.find(id);
+
+	if (i == _index.end())
+		return 0;
+
+	return i->second;
+}
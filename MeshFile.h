@@ -0,0 +1,111 @@
+#ifndef GUI_MESH_FILE_H__
+#define GUI_MESH_FILE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <imageprocessing/Volume.h>
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "Meshes.h"
+
+/**
+ * A compact binary file of a set of meshes, that are loaded from a memory
+ * mapping one label at a time.
+ *
+ * The file starts with a header (magic number, version, number of meshes),
+ * followed by a table with the id, size, bounding box, and offset of each
+ * mesh. The data of each mesh consists of
+ *
+ *   - the vertex positions, quantized to 16 bits per coordinate relative to
+ *     the bounding box of the mesh (the error is at most 1/131070 of the
+ *     size of the bounding box),
+ *   - the normals, octahedron encoded in two 16 bit values,
+ *   - the triangles, with 16 bit indices for meshes of at most 65536
+ *     vertices and 32 bit indices otherwise.
+ *
+ * All values are stored in native byte order.
+ */
+class MeshFile {
+
+public:
+
+	/**
+	 * Write the given meshes to a file. All meshes are loaded for that.
+	 */
+	static void write(const std::string& filename, Meshes& meshes);
+
+	/**
+	 * Open a mesh file for reading and create a Meshes with all meshes of the
+	 * file. The meshes are read from the file only when they are requested
+	 * with Meshes::get() for the first time.
+	 */
+	static boost::shared_ptr<Meshes> read(const std::string& filename);
+
+	/**
+	 * Map the given mesh file. Throws an IOError if the file can not be
+	 * opened or is not a valid mesh file.
+	 */
+	MeshFile(const std::string& filename);
+
+	/**
+	 * Get the ids of all meshes in the file.
+	 */
+	std::vector<unsigned int> getMeshIds() const;
+
+	/**
+	 * Get the bounding box of the mesh with the given id, without reading
+	 * the mesh.
+	 */
+	BoundingBox getBoundingBox(unsigned int id) const;
+
+	/**
+	 * Read the mesh with the given id. Returns an empty pointer, if there is
+	 * no such mesh.
+	 */
+	boost::shared_ptr<Mesh> load(unsigned int id) const;
+
+private:
+
+	struct Header {
+
+		char           magic[8];
+		boost::uint32_t version;
+		boost::uint32_t numMeshes;
+	};
+
+	struct Entry {
+
+		boost::uint32_t id;
+		boost::uint32_t numVertices;
+		boost::uint32_t numTriangles;
+		boost::uint32_t indexSize;
+		boost::uint64_t offset;
+
+		// the bounding box, as origin and size of one quantization step
+		float           origin[3];
+		float           step[3];
+	};
+
+	// the size of the data of a mesh in the file
+	static std::size_t dataSize(const Entry& entry);
+
+	// find the entry of the given mesh, 0 if there is none
+	const Entry* find(unsigned int id) const;
+
+	std::string _filename;
+
+	MappedFile _file;
+
+	const Entry* _entries;
+
+	unsigned int _numMeshes;
+
+	// the entries by mesh id
+	std::map<unsigned int, const Entry*> _index;
+};
+
+#endif // GUI_MESH_FILE_H__
+
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/timer/timer.hpp>
+#include <util/Logger.h>
+#include "MeshNormals.h"
+#include "ThreadPool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GUI_MESH_NORMALS_X86
+#include <emmintrin.h>
+#endif
+
+static logger::LogChannel meshnormalslog("meshnormalslog", "[MeshNormals] ");
+
+namespace {
+
+// meshes with fewer triangles are processed in the calling thread
+const unsigned int MinParallelTriangles = 1 << 16;
+
+// the number of ranges per thread, to balance the load
+const unsigned int RangesPerThread = 4;
+
+// if the partial sums of the ranges together have more than this times the
+// number of vertices, the normals are computed in the calling thread
+const unsigned int MaxPartialSizeFactor = 4;
+
+#ifdef GUI_MESH_NORMALS_X86
+
+bool hasSse2() {
+
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("sse2");
+}
+
+// Normalize four vectors (twelve floats) at a time, returns the number of
+// normalized vectors. The rest is left to the scalar code.
+__attribute__((target("sse2")))
+unsigned int normalizeVectorsSse2(float* values, unsigned int n) {
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4, values += 12) {
+
+		// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+		__m128 a = _mm_loadu_ps(values);
+		__m128 b = _mm_loadu_ps(values + 4);
+		__m128 c = _mm_loadu_ps(values + 8);
+
+		// transpose into x0..x3, y0..y3, z0..z3
+		__m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		__m128 y = _mm_shuffle_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+				_mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+				_MM_SHUFFLE(2, 0, 2, 0));
+		__m128 z = _mm_shuffle_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+				_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+				_MM_SHUFFLE(2, 0, 2, 0));
+
+		__m128 lengths = _mm_sqrt_ps(
+				_mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+						_mm_mul_ps(z, z)));
+
+		// divide vectors of length zero by one
+		__m128 isZero = _mm_cmpeq_ps(lengths, zero);
+		lengths = _mm_or_ps(_mm_andnot_ps(isZero, lengths), _mm_and_ps(isZero, one));
+
+		// spread the lengths to the layout of the vectors
+		a = _mm_div_ps(a, _mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(1, 0, 0, 0)));
+		b = _mm_div_ps(b, _mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(2, 2, 1, 1)));
+		c = _mm_div_ps(c, _mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(3, 3, 3, 2)));
+
+		_mm_storeu_ps(values,     a);
+		_mm_storeu_ps(values + 4, b);
+		_mm_storeu_ps(values + 8, c);
+	}
+
+	return i;
+}
+
+#endif // GUI_MESH_NORMALS_X86
+
+} // anonymous namespace
+
+void normalizeVectors(Vector3d* vectors, unsigned int n) {
+
+	unsigned int i = 0;
+
+#ifdef GUI_MESH_NORMALS_X86
+	static const bool sse2 = hasSse2();
+
+	if (sse2)
+		i = normalizeVectorsSse2(reinterpret_cast<float*>(vectors), n);
+#endif
+
+	for (; i < n; i++) {
+
+		Vector3d& v = vectors[i];
+
+		float length = std::sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+
+		if (length == 0)
+			continue;
+
+		v.x /= length;
+		v.y /= length;
+		v.z /= length;
+	}
+}
+
+MeshNormals::MeshNormals(Weighting weighting, unsigned int numThreads) :
+	_weighting(weighting),
+	_numThreads(numThreads) {}
+
+void
+MeshNormals::computeNormals(Mesh& mesh) const {
+
+	boost::timer::cpu_timer timer;
+
+	unsigned int numVertices  = mesh.getNumVertices();
+	unsigned int numTriangles = mesh.getNumTriangles();
+
+	Vector3d* normals = mesh.getNormals();
+
+	boost::scoped_ptr<ThreadPool> pool;
+	std::vector<Partial> partials;
+
+	// with a single hardware thread, the partial sums are only overhead
+	unsigned int numThreads = (_numThreads == 0 ? std::max(1u, boost::thread::hardware_concurrency()) : _numThreads);
+
+	if (numThreads > 1 && numTriangles >= MinParallelTriangles) {
+
+		pool.reset(new ThreadPool(numThreads));
+
+		unsigned int numRanges = pool->size()*RangesPerThread;
+
+		// find the vertices used by ranges of triangles
+
+		partials.resize(numRanges);
+
+		unsigned int rangeSize = (numTriangles + numRanges - 1)/numRanges;
+		for (unsigned int i = 0; i < numRanges; i++) {
+
+			partials[i].begin = std::min(numTriangles, i*rangeSize);
+			partials[i].end   = std::min(numTriangles, (i + 1)*rangeSize);
+
+			pool->schedule(
+					boost::bind(
+							&MeshNormals::findVertexRange,
+							this,
+							boost::cref(mesh),
+							boost::ref(partials[i])));
+		}
+
+		pool->wait();
+
+		boost::uint64_t partialSize = 0;
+		for (unsigned int i = 0; i < numRanges; i++)
+			partialSize += partials[i].maxVertex - partials[i].minVertex;
+
+		if (partialSize > static_cast<boost::uint64_t>(numVertices)*MaxPartialSizeFactor) {
+
+			LOG_DEBUG(meshnormalslog)
+					<< "triangles are not ordered spatially (" << partialSize
+					<< " partial sums for " << numVertices << " vertices), "
+					<< "computing normals in one thread" << std::endl;
+
+			pool.reset();
+		}
+	}
+
+	if (!pool) {
+
+		std::fill(normals, normals + numVertices, Vector3d(0, 0, 0));
+		accumulate(mesh, 0, numTriangles, normals, 0);
+		normalizeVectors(normals, numVertices);
+		mesh.setNormalsChanged();
+
+		LOG_ALL(meshnormalslog)
+				<< "computed " << numVertices << " normals:" << timer.format() << std::endl;
+
+		return;
+	}
+
+	unsigned int numRanges = partials.size();
+
+	// sum up the normals of ranges of triangles
+
+	for (unsigned int i = 0; i < numRanges; i++)
+		pool->schedule(
+				boost::bind(
+						&MeshNormals::computePartial,
+						this,
+						boost::cref(mesh),
+						boost::ref(partials[i])));
+
+	pool->wait();
+
+	// add them up for ranges of vertices
+
+	unsigned int rangeSize = (numVertices + numRanges - 1)/numRanges;
+	for (unsigned int begin = 0; begin < numVertices; begin += rangeSize)
+		pool->schedule(
+				boost::bind(
+						&MeshNormals::reducePartials,
+						this,
+						boost::ref(mesh),
+						boost::cref(partials),
+						begin,
+						std::min(numVertices, begin + rangeSize)));
+
+	pool->wait();
+
+	mesh.setNormalsChanged();
+
+	std::size_t partialSize = 0;
+	for (unsigned int i = 0; i < numRanges; i++)
+		partialSize += partials[i].normals.size();
+
+	LOG_ALL(meshnormalslog)
+			<< "computed " << numVertices << " normals using " << pool->size()
+			<< " threads (" << partialSize << " partial sums):" << timer.format() << std::endl;
+}
+
+void
+MeshNormals::findVertexRange(const Mesh& mesh, Partial& partial) const {
+
+	if (partial.begin == partial.end)
+		return;
+
+	const Triangle* triangles = mesh.getTriangles();
+
+	unsigned int minVertex = triangles[partial.begin].v0;
+	unsigned int maxVertex = minVertex;
+
+	for (unsigned int i = partial.begin; i < partial.end; i++) {
+
+		minVertex = std::min(minVertex, std::min(triangles[i].v0, std::min(triangles[i].v1, triangles[i].v2)));
+		maxVertex = std::max(maxVertex, std::max(triangles[i].v0, std::max(triangles[i].v1, triangles[i].v2)));
+	}
+
+	partial.minVertex = minVertex;
+	partial.maxVertex = maxVertex + 1;
+}
+
+void
+MeshNormals::computePartial(const Mesh& mesh, Partial& partial) const {
+
+	if (partial.begin == partial.end)
+		return;
+
+	partial.normals.assign(partial.maxVertex - partial.minVertex, Vector3d(0, 0, 0));
+
+	accumulate(mesh, partial.begin, partial.end, &partial.normals[0], partial.minVertex);
+}
+
+void
+MeshNormals::accumulate(
+		const Mesh& mesh,
+		unsigned int begin,
+		unsigned int end,
+		Vector3d* normals,
+		unsigned int offset) const {
+
+	const Point3d*  vertices  = mesh.getVertices();
+	const Triangle* triangles = mesh.getTriangles();
+
+	for (unsigned int i = begin; i < end; i++) {
+
+		unsigned int v0 = triangles[i].v0;
+		unsigned int v1 = triangles[i].v1;
+		unsigned int v2 = triangles[i].v2;
+
+		const Point3d& p0 = vertices[v0];
+		const Point3d& p1 = vertices[v1];
+		const Point3d& p2 = vertices[v2];
+
+		Vector3d e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		Vector3d e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+
+		// twice the area of the triangle
+		Vector3d normal(
+				e1.z*e2.y - e1.y*e2.z,
+				e1.x*e2.z - e1.z*e2.x,
+				e1.y*e2.x - e1.x*e2.y);
+
+		if (_weighting == AreaWeighted) {
+
+			normals[v0 - offset] += normal;
+			normals[v1 - offset] += normal;
+			normals[v2 - offset] += normal;
+			continue;
+		}
+
+		// the angles between the two edges at each corner
+
+		Vector3d e3(p2.x - p1.x, p2.y - p1.y, p2.z - p1.z);
+
+		float l1 = std::sqrt(e1.x*e1.x + e1.y*e1.y + e1.z*e1.z);
+		float l2 = std::sqrt(e2.x*e2.x + e2.y*e2.y + e2.z*e2.z);
+		float l3 = std::sqrt(e3.x*e3.x + e3.y*e3.y + e3.z*e3.z);
+
+		// degenerated triangles don't contribute
+		if (l1 == 0 || l2 == 0 || l3 == 0)
+			continue;
+
+		normalizeVectors(&normal, 1);
+
+		float cos0 =  (e1.x*e2.x + e1.y*e2.y + e1.z*e2.z)/(l1*l2);
+		float cos1 = -(e1.x*e3.x + e1.y*e3.y + e1.z*e3.z)/(l1*l3);
+
+		float angle0 = std::acos(std::max(-1.0f, std::min(1.0f, cos0)));
+		float angle1 = std::acos(std::max(-1.0f, std::min(1.0f, cos1)));
+		float angle2 = std::max(0.0f, static_cast<float>(M_PI) - angle0 - angle1);
+
+		normals[v0 - offset] += angle0*normal;
+		normals[v1 - offset] += angle1*normal;
+		normals[v2 - offset] += angle2*normal;
+	}
+}
+
+void
+MeshNormals::reducePartials(
+		Mesh& mesh,
+		const std::vector<Partial>& partials,
+		unsigned int begin,
+		unsigned int end) const {
+
+	Vector3d* normals = mesh.getNormals();
+
+	std::fill(normals + begin, normals + end, Vector3d(0, 0, 0));
+
+	// add the partials in the order of the triangles
+	for (unsigned int i = 0; i < partials.size(); i++) {
+
+		const Partial& partial = partials[i];
+
+		unsigned int partialBegin = std::max(begin, partial.minVertex);
+		unsigned int partialEnd   = std::min(end,   partial.maxVertex);
+
+		for (unsigned int v = partialBegin; v < partialEnd; v++)
+			normals[v] += partial.normals[v - partial.minVertex];
+	}
+
+	normalizeVectors(normals + begin, end - begin);
+}
+
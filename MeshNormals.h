@@ -0,0 +1,109 @@
+#ifndef GUI_MESH_NORMALS_H__
+#define GUI_MESH_NORMALS_H__
+
+#include <vector>
+#include "Mesh.h"
+
+class ThreadPool;
+
+/**
+ * Computes the normals of the vertices of a mesh as the normalized, weighted
+ * sum of the normals of the triangles around each vertex.
+ *
+ * Large meshes are processed in parallel: Each thread sums up the normals of
+ * a range of triangles into its own buffer, which covers only the vertices
+ * used by these triangles. The buffers are then added up per vertex in
+ * parallel, such that no two threads write the same memory. For meshes whose
+ * triangles are ordered spatially (as the ones created by MarchingCubes), the
+ * buffers are small. If the buffers would be much larger than the mesh (the
+ * triangles of a range use vertices from all over the mesh), the normals are
+ * computed in the calling thread instead. Vertices that are not part of any
+ * triangle get a zero normal.
+ */
+class MeshNormals {
+
+public:
+
+	enum Weighting {
+
+		// each triangle contributes with its area
+		AreaWeighted,
+
+		// each triangle contributes with its angle at the vertex
+		AngleWeighted
+	};
+
+	/**
+	 * Create a normal computation.
+	 *
+	 * @param weighting
+	 *              How to weight the normals of the triangles around a
+	 *              vertex.
+	 * @param numThreads
+	 *              The number of threads to use. If 0, one thread per hardware
+	 *              thread is used. Small meshes are always processed in the
+	 *              calling thread.
+	 */
+	MeshNormals(Weighting weighting = AreaWeighted, unsigned int numThreads = 0);
+
+	/**
+	 * Compute the normals of all vertices of the given mesh.
+	 */
+	void computeNormals(Mesh& mesh) const;
+
+private:
+
+	// the summed normals of a range of triangles
+	struct Partial {
+
+		Partial() :
+			begin(0),
+			end(0),
+			minVertex(0),
+			maxVertex(0) {}
+
+		// the triangles [begin, end)
+		unsigned int begin, end;
+
+		// the vertices [minVertex, maxVertex) used by the triangles
+		unsigned int minVertex, maxVertex;
+
+		// the summed normals of these vertices
+		std::vector<Vector3d> normals;
+	};
+
+	// Find the vertices used by the triangles of the given partial.
+	void findVertexRange(const Mesh& mesh, Partial& partial) const;
+
+	// Sum up the normals of the triangles of the given partial.
+	void computePartial(const Mesh& mesh, Partial& partial) const;
+
+	// Add the weighted normals of triangles [begin, end) to normals[v - 
+	// offset] for each of their vertices v.
+	void accumulate(
+			const Mesh& mesh,
+			unsigned int begin,
+			unsigned int end,
+			Vector3d* normals,
+			unsigned int offset) const;
+
+	// Add up the partials for vertices [begin, end) and normalize the sums.
+	void reducePartials(
+			Mesh& mesh,
+			const std::vector<Partial>& partials,
+			unsigned int begin,
+			unsigned int end) const;
+
+	Weighting _weighting;
+
+	unsigned int _numThreads;
+};
+
+/**
+ * Scale the given vectors to unit length. Vectors of length zero stay zero.
+ * Uses SSE2, if the CPU supports it.
+ */
+void normalizeVectors(Vector3d* vectors, unsigned int n);
+
+#endif // GUI_MESH_NORMALS_H__
+
@@ -1,15 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/timer/timer.hpp>
 #include <util/Logger.h>
 #include <gui/Colors.h>
 #include "MeshPainter.h"
+#include "UploadService.h"
 
 logger::LogChannel meshpainterlog("meshpainterlog", "[MeshPainter] ");
 
+namespace {
+
+// the number of entries in each row of the color table texture
+const unsigned int TableWidth = 256;
+
+// spare capacity of the shared buffers after a rebuild, to add meshes
+// without reallocating
+const float SpareCapacity = 0.5f;
+
+bool
+sameBoundingBox(const BoundingBox& a, const BoundingBox& b) {
+
+	return
+			a.getMinX() == b.getMinX() && a.getMinY() == b.getMinY() && a.getMinZ() == b.getMinZ() &&
+			a.getMaxX() == b.getMaxX() && a.getMaxY() == b.getMaxY() && a.getMaxZ() == b.getMaxZ();
+}
+
+} // anonymous namespace
+
+MeshPainter::MeshPainter() :
+	_vertexCapacity(0),
+	_indexCapacity(0),
+	_verticesEnd(0),
+	_indicesEnd(0),
+	_wastedVertices(0),
+	_wastedIndices(0),
+	_colorTableDirty(true),
+	_highlight(0),
+	_highlightPicked(false),
+	_drawn(false),
+	_pickFramebuffer(0),
+	_pickColorbuffer(0),
+	_pickDepthbuffer(0),
+	_pickPending(false),
+	_pickedLabel(0),
+	_pixelsPerUnit(0),
+	_maxPixelError(1.0f),
+	_hierarchy(boost::make_shared<BoundingBoxHierarchy>()),
+	_hierarchyDirty(true),
+	_uploadsPending(0),
+	_useBuffers(false),
+	_usePicking(false),
+	_buffersChecked(false) {
+
+	// the vertices are handed to OpenGl as they are
+	BOOST_STATIC_ASSERT(sizeof(Vertex) == 6*sizeof(float) + 2*sizeof(GLshort));
+}
+
+MeshPainter::~MeshPainter() {
+
+	// the callbacks of pending uploads refer to this painter
+	if (_buffers) {
+
+		try {
+
+			UploadService::getInstance().flush();
+
+		} catch (boost::exception& e) {
+
+			LOG_ERROR(meshpainterlog) << "upload failed: " << boost::diagnostic_information(e) << std::endl;
+		}
+	}
+
+	if (!_scene && !_colorTexture && _labels.empty())
+		return;
+
+	gui::OpenGl::Guard guard;
+
+	for (Labels::iterator i = _labels.begin(); i != _labels.end(); i++)
+		if (i->second.displayList != 0)
+			glCheck(glDeleteLists(i->second.displayList, 1));
+
+	// deletes the buffer objects
+	_scene.reset();
+	_buffers.reset();
+
+	deletePickResources();
+	_colorTexture.reset();
+}
+
+MeshPainter::Buffers::~Buffers() {
+
+	if (vertexBuffer == 0)
+		return;
+
+	gui::OpenGl::Guard guard;
+
+	glCheck(glDeleteBuffers(1, &vertexBuffer));
+	glCheck(glDeleteBuffers(1, &indexBuffer));
+}
+
 void
 MeshPainter::setMeshes(boost::shared_ptr<Meshes> meshes) {
 
 	if (!meshes)
 		return;
 
+	boost::mutex::scoped_lock lock(_updateMutex);
+
 	_meshes = meshes;
 
 	util::rect<double> size =
@@ -23,45 +124,1209 @@ MeshPainter::setMeshes(boost::shared_ptr<Meshes> meshes) {
 
 	setSize(size);
 
-	updateRecording();
+	// make sure OpenGl operations are save
+	gui::OpenGl::Guard guard;
+
+	if (!_buffersChecked) {
+
+		_useBuffers = glewIsSupported("GL_VERSION_1_5");
+		_usePicking = _useBuffers && glewIsSupported("GL_EXT_framebuffer_object");
+		_buffersChecked = true;
+
+		if (!_useBuffers)
+			LOG_USER(meshpainterlog) << "buffer objects not supported, using display lists" << std::endl;
+		else if (!_usePicking)
+			LOG_USER(meshpainterlog) << "framebuffer objects not supported, can not find meshes under the mouse" << std::endl;
+	}
+
+	update();
 }
 
 void
-MeshPainter::updateRecording() {
+MeshPainter::update() {
+
+	std::vector<Labels::iterator> changed;
+	std::vector<unsigned int>     freedTableIndices;
+
+	updateLabels(changed, freedTableIndices);
+
+	if (changed.empty() && freedTableIndices.empty() && !_hierarchyDirty)
+		return;
+
+	// the positions of the labels in the hierarchy changed
+	bool allChanged = updateHierarchy(changed);
+
+	if (!_useBuffers) {
+
+		updateDisplayLists(changed);
+
+		boost::shared_ptr<Scene> scene = createScene(changed, allChanged);
+		boost::shared_ptr<Scene> previous;
+
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			previous = showScene(scene, freedTableIndices);
+		}
+
+		return;
+	}
+
+	boost::shared_ptr<Upload> upload = boost::make_shared<Upload>();
+
+	// the slots of the labels changed
+	if (updateBuffers(changed, *upload))
+		allChanged = true;
+
+	updateColorTable();
+
+	upload->scene = createScene(changed, allChanged);
+	upload->freedTableIndices.swap(freedTableIndices);
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_uploadsPending++;
+	}
+
+	// the meshes are shown as soon as they are on the GPU
+	UploadService::getInstance().schedule(
+			boost::bind(&MeshPainter::uploadBuffers, upload),
+			boost::bind(&MeshPainter::onUploaded, this, upload));
+}
+
+void
+MeshPainter::setColor(unsigned int id, unsigned char r, unsigned char g, unsigned char b) {
+
+	Labels::const_iterator i = _labels.find(id);
+
+	if (i == _labels.end())
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		Color& color = _colorTable[i->second.tableIndex];
+		color[0] = r;
+		color[1] = g;
+		color[2] = b;
+	}
+
+	updateColor(id);
+}
+
+void
+MeshPainter::setVisible(unsigned int id, bool visible) {
+
+	Labels::const_iterator i = _labels.find(id);
+
+	if (i == _labels.end())
+		return;
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_hidden[i->second.tableIndex] = !visible;
+}
+
+void
+MeshPainter::setMaxPixelError(float maxPixelError) {
+
+	_maxPixelError = maxPixelError;
+}
+
+void
+MeshPainter::setHighlight(unsigned int id) {
+
+	if (id == _highlight)
+		return;
+
+	unsigned int previous = _highlight;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_highlight = id;
+	}
+
+	updateColor(previous);
+	updateColor(id);
+}
+
+void
+MeshPainter::setHighlightPicked(bool highlightPicked) {
+
+	_highlightPicked = highlightPicked;
+}
+
+bool
+MeshPainter::requestLabel(const util::point<double>& position) {
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (!_usePicking || !_drawn || !_scene || !_scene->buffers || !_colorTexture)
+		return false;
+
+	// the window position of the position in the plane z = 0
+	float clip[4];
+	for (int row = 0; row < 4; row++)
+		clip[row] =
+				_projection[row     ]*(_modelview[0]*position.x + _modelview[4]*position.y + _modelview[12]) +
+				_projection[row +  4]*(_modelview[1]*position.x + _modelview[5]*position.y + _modelview[13]) +
+				_projection[row +  8]*(_modelview[2]*position.x + _modelview[6]*position.y + _modelview[14]) +
+				_projection[row + 12]*(_modelview[3]*position.x + _modelview[7]*position.y + _modelview[15]);
+
+	if (clip[3] <= 0)
+		return false;
+
+	double x = _viewport[0] + 0.5*(clip[0]/clip[3] + 1.0)*_viewport[2];
+	double y = _viewport[1] + 0.5*(clip[1]/clip[3] + 1.0)*_viewport[3];
+
+	gui::OpenGl::Guard guard;
+
+	renderLabel(x, y);
+
+	return true;
+}
+
+unsigned int
+MeshPainter::getLabel() {
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return readPickedLabel();
+}
+
+unsigned int
+MeshPainter::readPickedLabel() {
+
+	if (!_pickPending)
+		return _pickedLabel;
 
-	// make sure OpenGl operations are save
 	gui::OpenGl::Guard guard;
 
-	startRecording();
+	const unsigned char* pixel = _pickBuffer->mapRead<unsigned char>();
+
+	unsigned int value = 0;
+	if (pixel)
+		value = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) | (pixel[3] << 24);
+
+	_pickBuffer->unmap();
+
+	_pickPending = false;
+
+	// value is the table index plus one, 0 for the background
+	_pickedLabel = (value > 0 && value <= _tableIds.size() ? _tableIds[value - 1] : 0);
+
+	return _pickedLabel;
+}
+
+bool
+MeshPainter::draw(
+		const util::rect<double>&  /*roi*/,
+		const util::point<double>& resolution) {
+
+	bool redraw;
+
+	unsigned int previousHighlight = 0;
+	unsigned int pickedHighlight   = 0;
+	bool         highlightChanged  = false;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		redraw = drawScene(resolution);
+
+		// the GPU had a frame to find the mesh of the last request
+		if (_highlightPicked && _pickPending) {
+
+			pickedHighlight = readPickedLabel();
+
+			if (pickedHighlight != _highlight) {
+
+				previousHighlight = _highlight;
+				_highlight        = pickedHighlight;
+				highlightChanged  = true;
+			}
+		}
+	}
+
+	if (highlightChanged) {
+
+		updateColor(previousHighlight);
+		updateColor(pickedHighlight);
+		redraw = true;
+	}
+
+	// the meshes that came into view are shown with one of the next calls
+	if (!_missing.empty()) {
+
+		loadMeshes(_missing);
+		redraw = true;
+	}
+
+	return redraw;
+}
+
+bool
+MeshPainter::drawScene(const util::point<double>& resolution) {
+
+	_missing.clear();
+
+	// draw again until the scheduled uploads are shown
+	bool redraw = (_uploadsPending > 0);
+
+	// remember where we draw, to find meshes under positions later
+	glGetFloatv(GL_PROJECTION_MATRIX, _projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, _modelview);
+	glGetIntegerv(GL_VIEWPORT, _viewport);
+	_drawn = true;
+
+	_pixelsPerUnit = std::max(resolution.x, resolution.y);
+
+	// find the meshes in the view frustum
+
+	if (!_scene)
+		return redraw;
+
+	_visible.clear();
+	_scene->hierarchy->getVisible(Frustum(_projection, _modelview), _visible);
+
+	for (unsigned int i = 0; i < _visible.size(); i++) {
+
+		const std::pair<unsigned int, Label>& label = _scene->getLabel(_visible[i]);
+
+		if (!label.second.loaded && !_hidden[label.second.tableIndex])
+			_missing.push_back(label.first);
+	}
+
+	if (!_useBuffers) {
+
+		drawDisplayLists(*_scene, _visible);
+		return redraw;
+	}
+
+	if (!_scene->buffers || !_colorTexture)
+		return redraw;
+
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	// the color of each vertex comes from the color table, modulated with
+	// the lighting of white
+	glColor3f(1, 1, 1);
+
+	glEnable(GL_TEXTURE_2D);
+	_colorTexture->bind();
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+	drawBuffers(*_scene, _visible, *_colorTexture);
+
+	_colorTexture->unbind();
+	glDisable(GL_TEXTURE_2D);
+
+	return redraw;
+}
+
+void
+MeshPainter::loadMeshes(const std::vector<unsigned int>& ids) {
+
+	boost::mutex::scoped_lock lock(_updateMutex);
+
+	boost::timer::cpu_timer timer;
+
+	unsigned int numLoaded = 0;
+
+	foreach (unsigned int id, ids) {
+
+		Labels::const_iterator i = _labels.find(id);
+
+		// gone, or loaded already and waiting for its upload
+		if (i == _labels.end() || i->second.loaded || !_meshes->contains(id))
+			continue;
+
+		_meshes->get(id);
+		numLoaded++;
+	}
+
+	if (numLoaded == 0)
+		return;
+
+	LOG_DEBUG(meshpainterlog)
+			<< "loaded " << numLoaded << " meshes that came into view:" << timer.format() << std::endl;
+
+	update();
+}
+
+void
+MeshPainter::drawBuffers(const Scene& scene, const std::vector<unsigned int>& visible, const gui::Texture& table) {
+
+	_ranges.clear();
+	for (unsigned int i = 0; i < visible.size(); i++) {
+
+		const Label& label = scene.getLabel(visible[i]).second;
+
+		if (_hidden[label.tableIndex] || label.numIndices == 0)
+			continue;
+
+		const Level& level = label.levels[selectLevel(label)];
+
+		if (level.numIndices > 0)
+			_ranges.push_back(std::make_pair(label.firstIndex + level.firstIndex, level.numIndices));
+	}
+
+	if (_ranges.empty())
+		return;
+
+	// merge ranges that follow each other in the index buffer
+
+	std::sort(_ranges.begin(), _ranges.end());
+
+	_counts.clear();
+	_offsets.clear();
+
+	for (unsigned int i = 0; i < _ranges.size(); i++) {
+
+		if (i == 0 || _ranges[i].first != _ranges[i - 1].first + _ranges[i - 1].second) {
+
+			_counts.push_back(0);
+			_offsets.push_back(reinterpret_cast<const GLvoid*>(_ranges[i].first*sizeof(unsigned int)));
+		}
+
+		_counts.back() += _ranges[i].second;
+	}
+
+	LOG_ALL(meshpainterlog)
+			<< "drawing " << _ranges.size() << " of " << scene.numLabels
+			<< " meshes in " << _counts.size() << " ranges" << std::endl;
+
+	// table coordinates to the centers of texels
+	glMatrixMode(GL_TEXTURE);
+	glPushMatrix();
+	glLoadIdentity();
+	glScalef(1.0f/table.width(), 1.0f/table.height(), 1.0f);
+	glTranslatef(0.5f, 0.5f, 0.0f);
+	glMatrixMode(GL_MODELVIEW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, scene.buffers->vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.buffers->indexBuffer);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), reinterpret_cast<const GLvoid*>(offsetof(Vertex, position)));
+	glNormalPointer(GL_FLOAT, sizeof(Vertex), reinterpret_cast<const GLvoid*>(offsetof(Vertex, normal)));
+	glTexCoordPointer(2, GL_SHORT, sizeof(Vertex), reinterpret_cast<const GLvoid*>(offsetof(Vertex, tableCoordinates)));
+
+	glMultiDrawElements(GL_TRIANGLES, &_counts[0], GL_UNSIGNED_INT, &_offsets[0], _counts.size());
+
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glMatrixMode(GL_TEXTURE);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+
+unsigned int
+MeshPainter::selectLevel(const Label& label) const {
+
+	unsigned int coarsest = label.levels.size() - 1;
+
+	if (coarsest == 0 || _pixelsPerUnit <= 0)
+		return 0;
+
+	// the whole mesh is not larger than the allowed error
+	const BoundingBox& box = label.boundingBox;
+	double size = std::sqrt(box.width()*box.width() + box.height()*box.height() + box.depth()*box.depth());
+
+	if (size*_pixelsPerUnit <= _maxPixelError)
+		return coarsest;
+
+	// the coarsest level with an error below a pixel
+	for (unsigned int l = coarsest; l > 0; l--)
+		if (label.levels[l].error*_pixelsPerUnit <= _maxPixelError)
+			return l;
+
+	return 0;
+}
+
+void
+MeshPainter::renderLabel(double x, double y) {
+
+	_pickPending = false;
+	_pickedLabel = 0;
+
+	if (x < _viewport[0] || y < _viewport[1] || x >= _viewport[0] + _viewport[2] || y >= _viewport[1] + _viewport[3])
+		return;
+
+	createPickResources();
+	updateIdTable();
+
+	GLint previousFramebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &previousFramebuffer);
+
+	glCheck(glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _pickFramebuffer));
+
+	glPushAttrib(GL_ENABLE_BIT | GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_TEXTURE_BIT);
+
+	glViewport(0, 0, 1, 1);
+	glClearColor(0, 0, 0, 0);
+	glClearDepth(1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// the ids have to end up in the pixel as they are
+	glDisable(GL_BLEND);
+	glDisable(GL_DITHER);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_FOG);
+	glDisable(GL_ALPHA_TEST);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_CULL_FACE);
+
+	// map the pixel at (x, y) to the whole viewport (see gluPickMatrix()),
+	// such that the frustum contains only the meshes around it
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glTranslated(_viewport[2] - 2*(x - _viewport[0]), _viewport[3] - 2*(y - _viewport[1]), 0);
+	glScaled(_viewport[2], _viewport[3], 1);
+	glMultMatrixf(_projection);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadMatrixf(_modelview);
+
+	_visible.clear();
+	_scene->hierarchy->getVisible(Frustum::fromOpenGl(), _visible);
+
+	glEnable(GL_TEXTURE_2D);
+	_idTexture->bind();
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+	drawBuffers(*_scene, _visible, *_idTexture);
+
+	_idTexture->unbind();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+
+	glPopAttrib();
+
+	// start reading the pixel, without waiting for it
+	_pickBuffer->bind(GL_PIXEL_PACK_BUFFER);
+	glCheck(glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0));
+	_pickBuffer->unbind(GL_PIXEL_PACK_BUFFER);
+
+	glCheck(glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, previousFramebuffer));
+
+	_pickPending = true;
+
+	LOG_ALL(meshpainterlog)
+			<< "rendered label at " << x << ", " << y << " from "
+			<< _ranges.size() << " meshes" << std::endl;
+}
+
+void
+MeshPainter::updateLabels(std::vector<Labels::iterator>& changed, std::vector<unsigned int>& freedTableIndices) {
+
+	for (Labels::iterator i = _labels.begin(); i != _labels.end(); i++)
+		i->second.used = false;
 
 	foreach (unsigned int id, _meshes->getMeshIds()) {
 
-		glEnable(GL_DEPTH_TEST);
-		glDisable(GL_CULL_FACE);
+		Labels::iterator i = _labels.find(id);
+
+		if (i == _labels.end()) {
+
+			i = _labels.insert(std::make_pair(id, Label())).first;
+			_hierarchyDirty = true;
+
+			i->second.tableIndex = allocateTableIndex(id);
+		}
+
+		Label& label = i->second;
+		label.used = true;
+
+		// meshes that are not loaded, yet, are only known by their bounding 
+		// box until they become visible
+		if (!_meshes->isLoaded(id)) {
+
+			BoundingBox boundingBox = _meshes->getMeshBoundingBox(id);
 
-		// colorize the mesh according to its id
-		unsigned char r, g, b;
-		idToRgb(id, r, g, b);
-		glColor3f(static_cast<float>(r)/255.0, static_cast<float>(g)/255.0, static_cast<float>(b)/255.0);
+			if (!label.loaded && sameBoundingBox(label.boundingBox, boundingBox))
+				continue;
 
-		const std::vector<Triangle>& triangles = _meshes->get(id)->getTriangles();
+			label.mesh.reset();
+			label.revision    = 0;
+			label.numVertices = 0;
+			label.numIndices  = 0;
+			label.boundingBox = boundingBox;
+			label.levels.clear();
+			label.loaded      = false;
+			label.uploaded    = false;
 
-		glBegin(GL_TRIANGLES);
-		foreach (const Triangle& triangle, triangles) {
+			changed.push_back(i);
+			continue;
+		}
+
+		boost::shared_ptr<Mesh> mesh = _meshes->get(id);
+
+		// still up to date?
+		if (label.uploaded && label.mesh.lock() == mesh && label.revision == mesh->getRevision())
+			continue;
+
+		label.mesh        = mesh;
+		label.revision    = mesh->getRevision();
+		label.numVertices = 0;
+		label.numIndices  = 0;
+		label.boundingBox = BoundingBox();
 
-			const Point3d&  v0 = _meshes->get(id)->getVertex(triangle.v0);
-			const Point3d&  v1 = _meshes->get(id)->getVertex(triangle.v1);
-			const Point3d&  v2 = _meshes->get(id)->getVertex(triangle.v2);
-			const Vector3d& n0 = _meshes->get(id)->getNormal(triangle.v0);
-			const Vector3d& n1 = _meshes->get(id)->getNormal(triangle.v1);
-			const Vector3d& n2 = _meshes->get(id)->getNormal(triangle.v2);
+		// the levels of detail follow each other in the slot of the label
+		label.levels.resize(mesh->getNumLevelsOfDetail());
+		for (unsigned int l = 0; l < label.levels.size(); l++) {
 
-			glNormal3f(n0.x, n0.y, n0.z); glVertex3f(v0.x, v0.y, v0.z);
-			glNormal3f(n1.x, n1.y, n1.z); glVertex3f(v1.x, v1.y, v1.z);
-			glNormal3f(n2.x, n2.y, n2.z); glVertex3f(v2.x, v2.y, v2.z);
+			const Mesh& levelMesh = mesh->getLevelOfDetail(l);
+
+			label.levels[l].firstIndex = label.numIndices;
+			label.levels[l].numIndices = 3*levelMesh.getNumTriangles();
+			label.levels[l].error      = mesh->getLevelOfDetailError(l);
+
+			label.numVertices += levelMesh.getNumVertices();
+			label.numIndices  += 3*levelMesh.getNumTriangles();
+			label.boundingBox += levelMesh.getBoundingBox();
 		}
-		glEnd();
+		label.loaded      = true;
+		label.uploaded    = false;
+
+		changed.push_back(i);
 	}
 
-	stopRecording();
+	// forget about meshes that are gone
+	for (Labels::iterator i = _labels.begin(); i != _labels.end();)
+		if (!i->second.used) {
+
+			_wastedVertices += i->second.vertexCapacity;
+			_wastedIndices  += i->second.indexCapacity;
+
+			// the entry is still used by the drawn scene
+			freedTableIndices.push_back(i->second.tableIndex);
+
+			// calling a deleted list does nothing
+			if (i->second.displayList != 0)
+				glCheck(glDeleteLists(i->second.displayList, 1));
+
+			_labels.erase(i++);
+
+			_hierarchyDirty = true;
+
+		} else {
+
+			i++;
+		}
+}
+
+void
+MeshPainter::updateDisplayLists(const std::vector<Labels::iterator>& changed) {
+
+	boost::timer::cpu_timer timer;
+
+	// the arrays of the meshes are passed as they are, and copied into the
+	// display lists
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	for (unsigned int i = 0; i < changed.size(); i++) {
+
+		Label& label = changed[i]->second;
+
+		boost::shared_ptr<Mesh> mesh = label.mesh.lock();
+
+		if (!mesh) {
+
+			// don't show the previous mesh
+			if (label.displayList != 0)
+				glCheck(glDeleteLists(label.displayList, 1));
+			label.displayList = 0;
+
+			continue;
+		}
+
+		if (label.displayList == 0) {
+
+			label.displayList = glGenLists(1);
+
+			if (label.displayList == 0)
+				BOOST_THROW_EXCEPTION(gui::OpenGlError() << error_message("Couldn't create display list") << STACK_TRACE);
+		}
+
+		glCheck(glNewList(label.displayList, GL_COMPILE));
+
+		glVertexPointer(3, GL_FLOAT, 0, mesh->getVertices());
+		glNormalPointer(GL_FLOAT, 0, mesh->getNormals());
+
+		glDrawElements(GL_TRIANGLES, 3*mesh->getNumTriangles(), GL_UNSIGNED_INT, mesh->getTriangles());
+
+		glCheck(glEndList());
+
+		label.uploaded = true;
+	}
+
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	LOG_DEBUG(meshpainterlog)
+			<< "recorded " << changed.size() << " of " << _labels.size()
+			<< " meshes:" << timer.format() << std::endl;
+}
+
+void
+MeshPainter::drawDisplayLists(const Scene& scene, const std::vector<unsigned int>& visible) {
+
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	for (unsigned int i = 0; i < visible.size(); i++) {
+
+		const Label& label = scene.getLabel(visible[i]).second;
+
+		if (_hidden[label.tableIndex] || label.displayList == 0)
+			continue;
+
+		const Color color = getDisplayColor(scene.getLabel(visible[i]).first, label);
+		glColor3f(static_cast<float>(color[0])/255.0, static_cast<float>(color[1])/255.0, static_cast<float>(color[2])/255.0);
+
+		glCallList(label.displayList);
+	}
+}
+
+bool
+MeshPainter::updateBuffers(const std::vector<Labels::iterator>& changed, Upload& upload) {
+
+	boost::timer::cpu_timer timer;
+
+	unsigned int numVertices = 0;
+	unsigned int numIndices  = 0;
+
+	for (unsigned int i = 0; i < changed.size(); i++) {
+
+		numVertices += changed[i]->second.numVertices;
+		numIndices  += changed[i]->second.numIndices;
+	}
+
+	bool rebuild =
+			!_buffers ||
+			_verticesEnd + numVertices > _vertexCapacity ||
+			_indicesEnd  + numIndices  > _indexCapacity;
+
+	if (!rebuild) {
+
+		upload.buffers     = _buffers;
+		upload.firstVertex = _verticesEnd;
+		upload.firstIndex  = _indicesEnd;
+
+		// the previous slots of the labels might still be drawn until the
+		// upload is finished, move the labels to the end of the buffers
+		for (unsigned int i = 0; i < changed.size(); i++) {
+
+			Label& label = changed[i]->second;
+
+			_wastedVertices += label.vertexCapacity;
+			_wastedIndices  += label.indexCapacity;
+
+			label.firstVertex    = _verticesEnd;
+			label.vertexCapacity = label.numVertices;
+			label.firstIndex     = _indicesEnd;
+			label.indexCapacity  = label.numIndices;
+
+			_verticesEnd += label.numVertices;
+			_indicesEnd  += label.numIndices;
+
+			stage(label, upload);
+			label.uploaded = true;
+		}
+
+		// compact the buffers if more than half of them is unused
+		if (2*_wastedVertices > _verticesEnd || 2*_wastedIndices > _indicesEnd)
+			rebuild = true;
+	}
+
+	if (rebuild)
+		rebuildBuffers(upload);
+
+	LOG_DEBUG(meshpainterlog)
+			<< (rebuild ? "staged rebuilt buffers after " : "staged ") << changed.size() << " of "
+			<< _labels.size() << " meshes:" << timer.format() << std::endl;
+
+	return rebuild;
+}
+
+void
+MeshPainter::rebuildBuffers(Upload& upload) {
+
+	unsigned int numVertices = 0;
+	unsigned int numIndices  = 0;
+
+	for (Labels::iterator i = _labels.begin(); i != _labels.end(); i++) {
+
+		numVertices += i->second.numVertices;
+		numIndices  += i->second.numIndices;
+	}
+
+	_vertexCapacity = std::max(1u, static_cast<unsigned int>(numVertices*(1 + SpareCapacity)));
+	_indexCapacity  = std::max(1u, static_cast<unsigned int>(numIndices*(1 + SpareCapacity)));
+
+	// the current buffers are drawn until the new ones are filled
+	_buffers = boost::make_shared<Buffers>();
+
+	upload.buffers        = _buffers;
+	upload.vertexCapacity = _vertexCapacity;
+	upload.indexCapacity  = _indexCapacity;
+	upload.firstVertex    = 0;
+	upload.firstIndex     = 0;
+
+	upload.vertices.clear();
+	upload.indices.clear();
+	upload.vertices.reserve(numVertices);
+	upload.indices.reserve(numIndices);
+
+	// pack the labels without gaps
+	_verticesEnd    = 0;
+	_indicesEnd     = 0;
+	_wastedVertices = 0;
+	_wastedIndices  = 0;
+
+	for (Labels::iterator i = _labels.begin(); i != _labels.end(); i++) {
+
+		Label& label = i->second;
+
+		label.firstVertex    = _verticesEnd;
+		label.vertexCapacity = label.numVertices;
+		label.firstIndex     = _indicesEnd;
+		label.indexCapacity  = label.numIndices;
+
+		_verticesEnd += label.numVertices;
+		_indicesEnd  += label.numIndices;
+
+		stage(label, upload);
+		label.uploaded = true;
+	}
+}
+
+void
+MeshPainter::stage(const Label& label, Upload& upload) {
+
+	// the labels are staged in the order of their slots
+	unsigned int vertexOffset = upload.vertices.size();
+	unsigned int indexOffset  = upload.indices.size();
+
+	upload.vertices.resize(vertexOffset + label.numVertices);
+	upload.indices.resize(indexOffset + label.numIndices);
+
+	boost::shared_ptr<Mesh> mesh = label.mesh.lock();
+
+	if (!mesh)
+		return;
+
+	GLshort tableX = label.tableIndex%TableWidth;
+	GLshort tableY = label.tableIndex/TableWidth;
+
+	unsigned int firstVertex = 0;
+
+	for (unsigned int l = 0; l < label.levels.size(); l++) {
+
+		const Mesh& levelMesh = mesh->getLevelOfDetail(l);
+
+		const Point3d*  vertices  = levelMesh.getVertices();
+		const Vector3d* normals   = levelMesh.getNormals();
+		const Triangle* triangles = levelMesh.getTriangles();
+
+		for (unsigned int i = 0; i < levelMesh.getNumVertices(); i++) {
+
+			Vertex& vertex = upload.vertices[vertexOffset + firstVertex + i];
+
+			vertex.position = vertices[i];
+			vertex.normal   = normals[i];
+			vertex.tableCoordinates[0] = tableX;
+			vertex.tableCoordinates[1] = tableY;
+		}
+
+		// the indices refer to the shared vertex buffer
+		unsigned int* indices = &upload.indices[0] + indexOffset + label.levels[l].firstIndex;
+		unsigned int  offset  = label.firstVertex + firstVertex;
+
+		for (unsigned int i = 0; i < levelMesh.getNumTriangles(); i++) {
+
+			indices[3*i    ] = offset + triangles[i].v0;
+			indices[3*i + 1] = offset + triangles[i].v1;
+			indices[3*i + 2] = offset + triangles[i].v2;
+		}
+
+		firstVertex += levelMesh.getNumVertices();
+	}
+}
+
+void
+MeshPainter::uploadBuffers(boost::shared_ptr<Upload> upload) {
+
+	boost::timer::cpu_timer timer;
+
+	Buffers& buffers = *upload->buffers;
+
+	if (upload->vertexCapacity > 0) {
+
+		glCheck(glGenBuffers(1, &buffers.vertexBuffer));
+		glCheck(glGenBuffers(1, &buffers.indexBuffer));
+
+		glCheck(glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer));
+		glCheck(glBufferData(GL_ARRAY_BUFFER, upload->vertexCapacity*sizeof(Vertex), 0, GL_STATIC_DRAW));
+		glCheck(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+		glCheck(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer));
+		glCheck(glBufferData(GL_ELEMENT_ARRAY_BUFFER, upload->indexCapacity*sizeof(unsigned int), 0, GL_STATIC_DRAW));
+		glCheck(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	}
+
+	if (!upload->vertices.empty()) {
+
+		glCheck(glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer));
+		glCheck(glBufferSubData(GL_ARRAY_BUFFER, upload->firstVertex*sizeof(Vertex), upload->vertices.size()*sizeof(Vertex), &upload->vertices[0]));
+		glCheck(glBindBuffer(GL_ARRAY_BUFFER, 0));
+	}
+
+	if (!upload->indices.empty()) {
+
+		glCheck(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer));
+		glCheck(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, upload->firstIndex*sizeof(unsigned int), upload->indices.size()*sizeof(unsigned int), &upload->indices[0]));
+		glCheck(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	}
+
+	LOG_DEBUG(meshpainterlog)
+			<< "uploaded " << upload->vertices.size() << " vertices and "
+			<< upload->indices.size() << " indices:" << timer.format() << std::endl;
+
+	// the staged data is not needed anymore
+	std::vector<Vertex>().swap(upload->vertices);
+	std::vector<unsigned int>().swap(upload->indices);
+}
+
+void
+MeshPainter::onUploaded(boost::shared_ptr<Upload> upload) {
+
+	// released after the lock, it might own buffers to delete
+	boost::shared_ptr<Scene> previous;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		previous = showScene(upload->scene, upload->freedTableIndices);
+		_uploadsPending--;
+	}
+
+	upload->scene.reset();
+}
+
+bool
+MeshPainter::updateHierarchy(const std::vector<Labels::iterator>& changed) {
+
+	// only the boxes of changed labels have to be refitted
+	if (!_hierarchyDirty) {
+
+		// the drawn scenes keep their hierarchy
+		if (!_hierarchy.unique() && !changed.empty())
+			_hierarchy = boost::make_shared<BoundingBoxHierarchy>(*_hierarchy);
+
+		unsigned int i = 0;
+		for (; i < changed.size(); i++) {
+
+			const Label& label = changed[i]->second;
+
+			// meshes without triangles are left out
+			if ((label.loaded && label.numIndices == 0) || !_hierarchy->update(label.hierarchyIndex, label.boundingBox))
+				break;
+		}
+
+		if (i == changed.size())
+			return false;
+	}
+
+	std::vector<BoundingBox> boxes;
+	boxes.reserve(_labels.size());
+
+	for (Labels::iterator i = _labels.begin(); i != _labels.end(); i++) {
+
+		i->second.hierarchyIndex = boxes.size();
+
+		// meshes without triangles are left out, meshes that are not loaded 
+		// are found by their stored bounding box
+		boxes.push_back(i->second.numIndices > 0 || !i->second.loaded ? i->second.boundingBox : BoundingBox());
+	}
+
+	if (!_hierarchy.unique())
+		_hierarchy = boost::make_shared<BoundingBoxHierarchy>();
+
+	_hierarchy->build(boxes);
+
+	_hierarchyDirty = false;
+
+	return true;
+}
+
+boost::shared_ptr<MeshPainter::Scene>
+MeshPainter::createScene(const std::vector<Labels::iterator>& changed, bool allChanged) {
+
+	unsigned int numBlocks = (_labels.size() + LabelBlockSize - 1)/LabelBlockSize;
+
+	if (allChanged || _labelBlocks.size() != numBlocks) {
+
+		// the hierarchy indices are the positions in the map
+		_labelBlocks.clear();
+		_labelBlocks.reserve(numBlocks);
+
+		for (Labels::const_iterator i = _labels.begin(); i != _labels.end(); i++) {
+
+			if (_labelBlocks.empty() || _labelBlocks.back()->size() == LabelBlockSize) {
+
+				_labelBlocks.push_back(boost::make_shared<LabelBlock>());
+				_labelBlocks.back()->reserve(LabelBlockSize);
+			}
+
+			_labelBlocks.back()->push_back(*i);
+		}
+
+	} else {
+
+		for (unsigned int i = 0; i < changed.size(); i++) {
+
+			unsigned int index = changed[i]->second.hierarchyIndex;
+
+			boost::shared_ptr<LabelBlock>& block = _labelBlocks[index/LabelBlockSize];
+
+			// the drawn scenes keep their blocks
+			if (!block.unique())
+				block = boost::make_shared<LabelBlock>(*block);
+
+			(*block)[index%LabelBlockSize] = *changed[i];
+		}
+	}
+
+	boost::shared_ptr<Scene> scene = boost::make_shared<Scene>();
+
+	scene->labels.assign(_labelBlocks.begin(), _labelBlocks.end());
+	scene->numLabels = _labels.size();
+	scene->hierarchy = _hierarchy;
+	scene->buffers   = _buffers;
+
+	return scene;
+}
+
+boost::shared_ptr<MeshPainter::Scene>
+MeshPainter::showScene(boost::shared_ptr<Scene> scene, const std::vector<unsigned int>& freedTableIndices) {
+
+	_scene.swap(scene);
+
+	foreach (unsigned int tableIndex, freedTableIndices) {
+
+		_freeTableIndices.push_back(tableIndex);
+		_tableIds[tableIndex] = 0;
+		_hidden[tableIndex]   = false;
+	}
+
+	return scene;
+}
+
+unsigned int
+MeshPainter::allocateTableIndex(unsigned int id) {
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	unsigned int tableIndex;
+
+	if (!_freeTableIndices.empty()) {
+
+		tableIndex = _freeTableIndices.back();
+		_freeTableIndices.pop_back();
+
+	} else {
+
+		tableIndex = _colorTable.size();
+
+		_colorTable.push_back(Color());
+		_tableIds.push_back(0);
+		_hidden.push_back(false);
+	}
+
+	// colorize the mesh according to its id
+	Color& color = _colorTable[tableIndex];
+	idToRgb(id, color[0], color[1], color[2]);
+	color[3] = 255;
+
+	_tableIds[tableIndex] = id;
+
+	_colorTableDirty = true;
+
+	return tableIndex;
+}
+
+void
+MeshPainter::updateColorTable() {
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	unsigned int rows = std::max(1u, static_cast<unsigned int>((_colorTable.size() + TableWidth - 1)/TableWidth));
+
+	if (!_colorTexture || static_cast<unsigned int>(_colorTexture->height()) < rows) {
+
+		// grow in powers of two, to rarely recreate the texture
+		unsigned int height = 1;
+		while (height < rows)
+			height *= 2;
+
+		if (!_colorTexture)
+			_colorTexture.reset(new gui::Texture(TableWidth, height, GL_RGBA));
+		else
+			_colorTexture->resize(TableWidth, height);
+
+		_colorTableDirty = true;
+	}
+
+	if (!_colorTableDirty)
+		return;
+
+	// upload complete rows
+	std::vector<Color> table(rows*TableWidth);
+	std::copy(_colorTable.begin(), _colorTable.end(), table.begin());
+
+	Labels::const_iterator highlight = _labels.find(_highlight);
+	if (highlight != _labels.end())
+		table[highlight->second.tableIndex] = getDisplayColor(_highlight, highlight->second);
+
+	_colorTexture->loadData(&table[0], util::rect<unsigned int>(0, 0, TableWidth, rows));
+
+	_colorTableDirty = false;
+}
+
+void
+MeshPainter::updateIdTable() {
+
+	if (_idTexture && _idTexture->height() == _colorTexture->height())
+		return;
+
+	unsigned int height = _colorTexture->height();
+
+	// the ids are the table indices plus one, the background is 0
+	std::vector<Color> table(height*TableWidth);
+	for (unsigned int i = 0; i < table.size(); i++) {
+
+		unsigned int value = i + 1;
+
+		table[i][0] = value & 0xff;
+		table[i][1] = (value >> 8) & 0xff;
+		table[i][2] = (value >> 16) & 0xff;
+		table[i][3] = (value >> 24) & 0xff;
+	}
+
+	if (!_idTexture)
+		_idTexture.reset(new gui::Texture(TableWidth, height, GL_RGBA));
+	else
+		_idTexture->resize(TableWidth, height);
+
+	_idTexture->loadData(&table[0]);
+}
+
+void
+MeshPainter::updateColor(unsigned int id) {
+
+	Labels::const_iterator i = _labels.find(id);
+
+	// the display lists do not contain the colors, and a dirty table will be
+	// uploaded completely
+	if (i == _labels.end() || !_useBuffers)
+		return;
+
+	gui::OpenGl::Guard guard;
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (_colorTableDirty || !_colorTexture)
+		return;
+
+	unsigned int tableIndex = i->second.tableIndex;
+
+	Color color = getDisplayColor(id, i->second);
+
+	// change a single texel
+	unsigned int x = tableIndex%TableWidth;
+	unsigned int y = tableIndex/TableWidth;
+
+	_colorTexture->loadData(&color, util::rect<unsigned int>(x, y, x + 1, y + 1));
+}
+
+MeshPainter::Color
+MeshPainter::getDisplayColor(unsigned int id, const Label& label) const {
+
+	Color color = _colorTable[label.tableIndex];
+
+	// halfway to white
+	if (id == _highlight && id != 0)
+		for (int i = 0; i < 3; i++)
+			color[i] = static_cast<unsigned char>((color[i] + 255)/2);
+
+	return color;
+}
+
+void
+MeshPainter::createPickResources() {
+
+	if (_pickFramebuffer != 0)
+		return;
+
+	// a framebuffer of a single pixel
+	glCheck(glGenRenderbuffersEXT(1, &_pickColorbuffer));
+	glCheck(glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, _pickColorbuffer));
+	glCheck(glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, 1, 1));
+
+	glCheck(glGenRenderbuffersEXT(1, &_pickDepthbuffer));
+	glCheck(glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, _pickDepthbuffer));
+	glCheck(glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, 1, 1));
+
+	glCheck(glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0));
+
+	GLint previousFramebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &previousFramebuffer);
+
+	glCheck(glGenFramebuffersEXT(1, &_pickFramebuffer));
+	glCheck(glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _pickFramebuffer));
+	glCheck(glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, _pickColorbuffer));
+	glCheck(glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, _pickDepthbuffer));
+
+	GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+
+	glCheck(glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, previousFramebuffer));
+
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT)
+		BOOST_THROW_EXCEPTION(gui::OpenGlError() << error_message("pick framebuffer is not complete") << STACK_TRACE);
+
+	_pickBuffer.reset(new gui::Buffer(1, 1, GL_RGBA, GL_UNSIGNED_BYTE));
+}
+
+void
+MeshPainter::deletePickResources() {
+
+	if (_pickFramebuffer == 0)
+		return;
+
+	glCheck(glDeleteFramebuffersEXT(1, &_pickFramebuffer));
+	glCheck(glDeleteRenderbuffersEXT(1, &_pickColorbuffer));
+	glCheck(glDeleteRenderbuffersEXT(1, &_pickDepthbuffer));
+
+	_pickFramebuffer = 0;
+	_pickColorbuffer = 0;
+	_pickDepthbuffer = 0;
+
+	_pickBuffer.reset();
+	_idTexture.reset();
 }
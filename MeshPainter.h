@@ -1,20 +1,463 @@
 #ifndef GUI_MESH_PAINTER_H__
 #define GUI_MESH_PAINTER_H__
 
-#include "RecordablePainter.h"
+#include <map>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <gui/Buffer.h>
+#include <gui/Texture.h>
+#include "BoundingBoxHierarchy.h"
+#include <gui/OpenGl.h>
+#include <gui/Painter.h>
 #include "Meshes.h"
 
-class MeshPainter : public gui::RecordablePainter {
+/**
+ * Draws a set of meshes, each in the color of its id.
+ *
+ * If the OpenGl implementation supports buffer objects, all meshes are
+ * packed into one vertex buffer and one index buffer on the GPU. Each vertex
+ * knows the entry of its mesh in a color table texture, such that recoloring
+ * a mesh (see setColor()) changes a single texel. When the meshes are set
+ * again, only meshes that are new or have changed (see Mesh::getRevision())
+ * are uploaded to the end of the buffers. The uploads are done by the
+ * UploadService, such that setMeshes() and draw() never wait for them. Until
+ * an upload is finished, the meshes are drawn as they were before, and draw()
+ * asks to be called again to show them as soon as they are ready. Otherwise,
+ * each mesh is recorded into a display list of its own, which is only
+ * recorded again if the mesh changed.
+ *
+ * Only visible meshes (see setVisible()) whose bounding box intersects the
+ * current view frustum are drawn, with buffer objects in a single
+ * glMultiDrawElements() call. The frustum is taken from the OpenGl
+ * projection and modelview matrices at the time of drawing, and the meshes
+ * are found through a bounding volume hierarchy over their bounding boxes.
+ * Meshes that have not been loaded, yet (see Meshes::addLazy()) take part in
+ * the hierarchy with the bounding box stored in the Meshes, and are only
+ * loaded by draw() as soon as they are in the view frustum.
+ *
+ * With buffer objects, the levels of detail of the meshes (see 
+ * Mesh::addLevelOfDetail()) are uploaded as well. For each mesh, the coarsest 
+ * level whose error is at most setMaxPixelError() pixels at the resolution of 
+ * drawing is drawn.
+ *
+ * With buffer objects and framebuffer objects, the mesh under a position can
+ * be found (see requestLabel()) by drawing the meshes around the position
+ * with a table of their ids into a single pixel, which is read back
+ * asynchronously.
+ */
+class MeshPainter : public gui::Painter {
 
 public:
 
+	MeshPainter();
+
+	/**
+	 * Waits for pending uploads, and frees the buffer objects and display
+	 * lists.
+	 */
+	~MeshPainter();
+
 	void setMeshes(boost::shared_ptr<Meshes> meshes);
 
+	/**
+	 * Change the color of the mesh with the given id.
+	 */
+	void setColor(unsigned int id, unsigned char r, unsigned char g, unsigned char b);
+
+	/**
+	 * Show or hide the mesh with the given id.
+	 */
+	void setVisible(unsigned int id, bool visible);
+
+	/**
+	 * Set the largest error (in pixels) of the levels of detail to draw.
+	 * Default is 1.
+	 */
+	void setMaxPixelError(float maxPixelError);
+
+	/**
+	 * Highlight the mesh with the given id, and remove the highlight from
+	 * the previously highlighted mesh. Pass 0 to highlight no mesh.
+	 */
+	void setHighlight(unsigned int id);
+
+	/**
+	 * Highlight the mesh found for the last call to requestLabel() as soon 
+	 * as it is known. The result is read in the next call to draw(), which 
+	 * asks to be called again if the highlight changed. Default is false.
+	 */
+	void setHighlightPicked(bool highlightPicked);
+
+	/**
+	 * Start finding the visible mesh under the given position (in the
+	 * coordinates of this painter, like the positions of pointer signals).
+	 * The position is seen as it was in the last call to draw(). The result
+	 * can be read with getLabel(), ideally some time later, to not wait for
+	 * the GPU.
+	 *
+	 * @return false, if meshes can not be found at the moment.
+	 */
+	bool requestLabel(const util::point<double>& position);
+
+	/**
+	 * Get the id of the mesh found for the last call to requestLabel(), or 0
+	 * if there was no mesh at the position or finding meshes is not
+	 * supported.
+	 */
+	unsigned int getLabel();
+
+	bool draw(
+			const util::rect<double>&  roi,
+			const util::point<double>& resolution);
+
 private:
 
-	void updateRecording();
+	typedef boost::array<unsigned char, 4> Color;
+
+	// a level of detail of a mesh in the slot of its label
+	struct Level {
+
+		// the indices of the level, relative to the slot
+		unsigned int firstIndex;
+		unsigned int numIndices;
+
+		float error;
+	};
+
+	// a vertex in the shared vertex buffer
+	struct Vertex {
+
+		Point3d  position;
+		Vector3d normal;
+
+		// the entry of the mesh in the color table
+		GLshort  tableCoordinates[2];
+	};
+
+	// a mesh and its slot in the shared buffers
+	struct Label {
+
+		Label() :
+			revision(0),
+			numVertices(0),
+			numIndices(0),
+			firstVertex(0),
+			vertexCapacity(0),
+			firstIndex(0),
+			indexCapacity(0),
+			tableIndex(0),
+			displayList(0),
+			hierarchyIndex(0),
+			loaded(false),
+			uploaded(false),
+			used(false) {}
+
+		// the mesh that was uploaded and its revision at that time
+		boost::weak_ptr<Mesh> mesh;
+		unsigned int          revision;
+
+		// the sizes of all levels of detail together
+		unsigned int numVertices;
+		unsigned int numIndices;
+
+		// the bounding box of all levels of detail
+		BoundingBox boundingBox;
+
+		std::vector<Level> levels;
+
+		// the slot in the shared buffers
+		unsigned int firstVertex;
+		unsigned int vertexCapacity;
+		unsigned int firstIndex;
+		unsigned int indexCapacity;
+
+		// the entry in the color table
+		unsigned int tableIndex;
+
+		// the display list of the mesh, if buffer objects are not supported
+		GLuint displayList;
+
+		// the index of the bounding box in the hierarchy
+		unsigned int hierarchyIndex;
+
+		// the mesh has been loaded, otherwise only its bounding box is known
+		bool loaded;
+
+		// the current mesh is in the buffers (or scheduled to be)
+		bool uploaded;
+
+		// mesh is still part of the current meshes
+		bool used;
+	};
+
+	typedef std::map<unsigned int, Label> Labels;
+
+	// a part of the labels of a scene, with their ids
+	typedef std::vector<std::pair<unsigned int, Label> > LabelBlock;
+
+	// the number of labels per block
+	static const unsigned int LabelBlockSize = 256;
+
+	// a vertex and an index buffer object, deleted with the last scene that
+	// uses them
+	struct Buffers {
+
+		Buffers() :
+			vertexBuffer(0),
+			indexBuffer(0) {}
+
+		~Buffers();
+
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+	};
+
+	// what draw() shows: the labels, their hierarchy, and the buffers they
+	// are in
+	struct Scene {
+
+		Scene() :
+			numLabels(0) {}
+
+		// get the label with the given index in the hierarchy and its id
+		const std::pair<unsigned int, Label>& getLabel(unsigned int index) const {
+
+			return (*labels[index/LabelBlockSize])[index%LabelBlockSize];
+		}
+
+		// the labels with their ids, in the order of the boxes of the
+		// hierarchy, in blocks that are shared with other scenes (the blocks
+		// and the hierarchy are not changed anymore)
+		std::vector<boost::shared_ptr<const LabelBlock> > labels;
+		unsigned int numLabels;
+
+		boost::shared_ptr<const BoundingBoxHierarchy> hierarchy;
+
+		boost::shared_ptr<Buffers> buffers;
+	};
+
+	// the data to write into the shared buffers on the upload thread, and
+	// the scene to show afterwards
+	struct Upload {
+
+		Upload() :
+			vertexCapacity(0),
+			indexCapacity(0),
+			firstVertex(0),
+			firstIndex(0) {}
+
+		boost::shared_ptr<Buffers> buffers;
+
+		// the sizes to create the buffers with, 0 to write into existing
+		// buffers
+		unsigned int vertexCapacity;
+		unsigned int indexCapacity;
+
+		// where the data goes in the buffers
+		unsigned int firstVertex;
+		unsigned int firstIndex;
+
+		std::vector<Vertex>       vertices;
+		std::vector<unsigned int> indices;
+
+		boost::shared_ptr<Scene> scene;
+
+		// the color table entries of removed labels, free as soon as the
+		// scene is shown
+		std::vector<unsigned int> freedTableIndices;
+	};
+
+	// update the labels, the hierarchy, and the buffers or display lists to 
+	// the current meshes (with _updateMutex locked)
+	void update();
+
+	// draw the current scene (with _mutex locked), and remember the visible 
+	// meshes that have not been loaded, yet
+	bool drawScene(const util::point<double>& resolution);
+
+	// load the meshes with the given ids and show them
+	void loadMeshes(const std::vector<unsigned int>& ids);
+
+	// find new, changed, and removed meshes
+	void updateLabels(std::vector<Labels::iterator>& changed, std::vector<unsigned int>& freedTableIndices);
+
+	// record the given labels into their display lists
+	void updateDisplayLists(const std::vector<Labels::iterator>& changed);
+
+	// draw the given labels of a scene from their display lists
+	void drawDisplayLists(const Scene& scene, const std::vector<unsigned int>& visible);
+
+	// draw the given labels of a scene from its buffers, with the table
+	// coordinates mapped to the bound table texture
+	void drawBuffers(const Scene& scene, const std::vector<unsigned int>& visible, const gui::Texture& table);
+
+	// find the level of detail to draw for a label
+	unsigned int selectLevel(const Label& label) const;
+
+	// read the id of the mesh found by the last rendered pick (with _mutex 
+	// locked)
+	unsigned int readPickedLabel();
+
+	// render the id of the mesh at the given window position into the pick
+	// framebuffer, and start reading it into the pick buffer
+	void renderLabel(double x, double y);
+
+	// create the framebuffer, texture, and pixel buffer for finding meshes
+	void createPickResources();
+
+	void deletePickResources();
+
+	// find slots for the given labels in the shared buffers, and stage their
+	// data in the upload, returns true if all labels got new slots
+	bool updateBuffers(const std::vector<Labels::iterator>& changed, Upload& upload);
+
+	// pack all labels into new buffers, and stage their data in the upload
+	void rebuildBuffers(Upload& upload);
+
+	// append the data of a label for its slot to the upload
+	void stage(const Label& label, Upload& upload);
+
+	// write the staged data into the buffers, on the upload thread
+	static void uploadBuffers(boost::shared_ptr<Upload> upload);
+
+	// show the scene of a finished upload
+	void onUploaded(boost::shared_ptr<Upload> upload);
+
+	// refit the bounding volume hierarchy to the given labels, or rebuild
+	// it if labels were added or removed, returns true if it was rebuilt
+	bool updateHierarchy(const std::vector<Labels::iterator>& changed);
+
+	// create a scene of the current labels, the hierarchy, and the buffers
+	// for drawing, sharing the blocks of unchanged labels with the previous
+	// scene (unless all labels changed)
+	boost::shared_ptr<Scene> createScene(const std::vector<Labels::iterator>& changed, bool allChanged);
+
+	// replace the drawn scene, and free the given color table entries (with
+	// _mutex locked), returns the previous scene
+	boost::shared_ptr<Scene> showScene(boost::shared_ptr<Scene> scene, const std::vector<unsigned int>& freedTableIndices);
+
+	// get a free entry in the color table for the label with the given id
+	unsigned int allocateTableIndex(unsigned int id);
+
+	// make sure the color table texture is big enough and up to date
+	void updateColorTable();
+
+	// make sure the id table texture has the size of the color table
+	void updateIdTable();
+
+	// upload the color of a single label into the color table texture
+	void updateColor(unsigned int id);
+
+	// the color a label is drawn with
+	Color getDisplayColor(unsigned int id, const Label& label) const;
 
 	boost::shared_ptr<Meshes> _meshes;
+
+	// the labels as they will be drawn after the scheduled uploads
+	Labels _labels;
+
+	// the shared buffers the labels are (being) uploaded to
+	boost::shared_ptr<Buffers> _buffers;
+
+	// the sizes of the shared buffers and of their used parts (in vertices
+	// and indices)
+	unsigned int _vertexCapacity;
+	unsigned int _indexCapacity;
+	unsigned int _verticesEnd;
+	unsigned int _indicesEnd;
+
+	// the parts of the used buffers that belong to no label
+	unsigned int _wastedVertices;
+	unsigned int _wastedIndices;
+
+	// the scene that is drawn
+	boost::shared_ptr<Scene> _scene;
+
+	// protects the scene and the tables, which are used by draw(), the
+	// upload thread, and setMeshes()
+	boost::mutex _mutex;
+
+	// the colors of the labels, the ids of the labels, and the unused
+	// entries
+	std::vector<Color>        _colorTable;
+	std::vector<unsigned int> _tableIds;
+	std::vector<unsigned int> _freeTableIndices;
+
+	// the hidden labels, by their entries in the color table
+	std::vector<char> _hidden;
+
+	boost::scoped_ptr<gui::Texture> _colorTexture;
+
+	// the color table has to be uploaded completely
+	bool _colorTableDirty;
+
+	// the id of the highlighted label, or 0
+	unsigned int _highlight;
+
+	// highlight the label found by the last pick
+	bool _highlightPicked;
+
+	// the matrices and viewport of the last call to draw()
+	float _projection[16];
+	float _modelview[16];
+	GLint _viewport[4];
+	bool  _drawn;
+
+	// the framebuffer to render a single pixel of label ids, its
+	// renderbuffers, and the table of ids (as RGBA colors of table indices
+	// plus one)
+	GLuint _pickFramebuffer;
+	GLuint _pickColorbuffer;
+	GLuint _pickDepthbuffer;
+	boost::scoped_ptr<gui::Texture> _idTexture;
+
+	// the pixel buffer to read the rendered pixel into
+	boost::scoped_ptr<gui::Buffer> _pickBuffer;
+
+	// a pixel was rendered and is read into the pick buffer
+	bool _pickPending;
+
+	// the last found label
+	unsigned int _pickedLabel;
+
+	// the resolution of the last call to draw()
+	double _pixelsPerUnit;
+
+	float _maxPixelError;
+
+	// the hierarchy over the boxes of _labels, copied before a change if it
+	// is used by a scene
+	boost::shared_ptr<BoundingBoxHierarchy> _hierarchy;
+
+	// the blocks of labels of the last created scene, copied before a change
+	// if they are used by a scene
+	std::vector<boost::shared_ptr<LabelBlock> > _labelBlocks;
+
+	// labels were added or removed since the hierarchy was built
+	bool _hierarchyDirty;
+
+	// the number of scheduled uploads whose scenes are not shown, yet
+	unsigned int _uploadsPending;
+
+	// serializes the updates of the labels by setMeshes() and draw()
+	boost::mutex _updateMutex;
+
+	// buffers reused between calls
+	std::vector<unsigned int>                           _visible;
+	std::vector<unsigned int>                           _missing;
+	std::vector<std::pair<unsigned int, unsigned int> > _ranges;
+	std::vector<GLsizei>                                _counts;
+	std::vector<const GLvoid*>                          _offsets;
+
+	// buffer objects and framebuffer objects are supported (checked when the
+	// first meshes are set)
+	bool _useBuffers;
+	bool _usePicking;
+	bool _buffersChecked;
 };
 
 #endif // GUI_MESH_PAINTER_H__
@@ -4,13 +4,30 @@ MeshView::MeshView() {
 
 	registerInput(_meshes, "meshes");
 	registerOutput(_painter, "painter");
+
+	_painter.registerCallback(&MeshView::onMouseMove, this);
 }
 
 void
 MeshView::updateOutputs() {
 
-	if (!_painter)
+	if (!_painter) {
+
 		_painter = new MeshPainter();
+		_painter->setHighlightPicked(true);
+	}
 
 	_painter->setMeshes(_meshes);
 }
+
+void
+MeshView::onMouseMove(gui::MouseMove& signal) {
+
+	if (!_painter)
+		return;
+
+	// the painter reads the mesh under the position with the next redraw, 
+	// and highlights it
+	if (_painter->requestLabel(signal.position))
+		setDirty(_painter);
+}
@@ -2,6 +2,7 @@
 #define GUI_MESH_VIEW_H__
 
 #include <pipeline/SimpleProcessNode.h>
+#include <gui/MouseSignals.h>
 #include "MeshPainter.h"
 
 class MeshView : public pipeline::SimpleProcessNode<> {
@@ -14,6 +15,9 @@ private:
 
 	void updateOutputs();
 
+	// highlight the mesh under the mouse
+	void onMouseMove(gui::MouseMove& signal);
+
 	pipeline::Input<Meshes>       _meshes;
 	pipeline::Output<MeshPainter> _painter;
 };
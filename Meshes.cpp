@@ -0,0 +1,338 @@
+#include "Meshes.h"
+
+namespace {
+
+// the index has at least this many slots
+const unsigned int MinIndexBits = 4;
+
+} // anonymous namespace
+
+const unsigned int Meshes::Invalid;
+
+Meshes::Meshes() :
+	_index(1u << MinIndexBits, Invalid),
+	_indexBits(MinIndexBits),
+	_numLeaves(0),
+	_hierarchyDirty(true) {}
+
+void
+Meshes::add(unsigned int id, boost::shared_ptr<Mesh> mesh) {
+
+	unsigned int position = find(id);
+
+	if (position == Invalid) {
+
+		position = _ids.size();
+
+		_ids.push_back(id);
+		_meshes.push_back(mesh);
+		_loaders.push_back(Loader());
+		_loaderBoundingBoxes.push_back(BoundingBox());
+
+		insertIndex(id, position);
+
+	} else {
+
+		_meshes[position] = mesh;
+		_loaders[position] = Loader();
+	}
+
+	setMeshBoundingBoxDirty(position);
+}
+
+void
+Meshes::addLazy(
+		unsigned int id,
+		const Loader& loader,
+		const BoundingBox& boundingBox) {
+
+	unsigned int position = find(id);
+
+	if (position == Invalid) {
+
+		position = _ids.size();
+
+		_ids.push_back(id);
+		_meshes.push_back(boost::shared_ptr<Mesh>());
+		_loaders.push_back(loader);
+		_loaderBoundingBoxes.push_back(boundingBox);
+
+		insertIndex(id, position);
+
+	} else {
+
+		_meshes[position].reset();
+		_loaders[position] = loader;
+		_loaderBoundingBoxes[position] = boundingBox;
+	}
+
+	setMeshBoundingBoxDirty(position);
+}
+
+void
+Meshes::remove(unsigned int id) {
+
+	unsigned int position = find(id);
+
+	if (position == Invalid)
+		return;
+
+	eraseIndex(id);
+
+	// move the last mesh into the gap
+	unsigned int last = _ids.size() - 1;
+
+	if (position != last) {
+
+		_ids[position]                 = _ids[last];
+		_meshes[position]              = _meshes[last];
+		_loaders[position]             = _loaders[last];
+		_loaderBoundingBoxes[position] = _loaderBoundingBoxes[last];
+
+		_index[findSlot(_ids[position])] = position;
+	}
+
+	_ids.pop_back();
+	_meshes.pop_back();
+	_loaders.pop_back();
+	_loaderBoundingBoxes.pop_back();
+
+	setMeshBoundingBoxDirty(position);
+	setMeshBoundingBoxDirty(last);
+}
+
+boost::shared_ptr<Mesh>
+Meshes::get(unsigned int id) {
+
+	unsigned int position = find(id);
+
+	if (position == Invalid)
+		return boost::shared_ptr<Mesh>();
+
+	if (!_meshes[position] && _loaders[position]) {
+
+		_meshes[position] = _loaders[position]();
+		_loaders[position] = Loader();
+
+		setMeshBoundingBoxDirty(position);
+	}
+
+	return _meshes[position];
+}
+
+bool
+Meshes::isLoaded(unsigned int id) const {
+
+	unsigned int position = find(id);
+
+	return position != Invalid && (_meshes[position] || !_loaders[position]);
+}
+
+BoundingBox
+Meshes::getMeshBoundingBox(unsigned int id) const {
+
+	return getBoundingBoxAt(find(id));
+}
+
+void
+Meshes::setMeshChanged(unsigned int id) {
+
+	unsigned int position = find(id);
+
+	if (position != Invalid)
+		setMeshBoundingBoxDirty(position);
+}
+
+void
+Meshes::clear() {
+
+	_ids.clear();
+	_meshes.clear();
+	_loaders.clear();
+	_loaderBoundingBoxes.clear();
+
+	_index.assign(1u << MinIndexBits, Invalid);
+	_indexBits = MinIndexBits;
+
+	_hierarchy.clear();
+	_numLeaves = 0;
+	_dirtyPositions.clear();
+	_hierarchyDirty = true;
+
+	resetBoundingBox();
+}
+
+BoundingBox
+Meshes::computeBoundingBox() const {
+
+	if (_hierarchyDirty || _ids.size() > _numLeaves)
+		rebuildHierarchy();
+	else
+		for (unsigned int i = 0; i < _dirtyPositions.size(); i++)
+			updateHierarchy(_dirtyPositions[i]);
+
+	_dirtyPositions.clear();
+
+	if (_hierarchy.size() < 2)
+		return BoundingBox();
+
+	return _hierarchy[1];
+}
+
+unsigned int
+Meshes::find(unsigned int id) const {
+
+	unsigned int slot = findSlot(id);
+
+	if (slot == Invalid)
+		return Invalid;
+
+	return _index[slot];
+}
+
+unsigned int
+Meshes::home(unsigned int id) const {
+
+	// Fibonacci hashing, spreads consecutive ids over the whole index
+	return (id*2654435769u) >> (32 - _indexBits);
+}
+
+unsigned int
+Meshes::findSlot(unsigned int id) const {
+
+	unsigned int mask = _index.size() - 1;
+
+	for (unsigned int slot = home(id); _index[slot] != Invalid; slot = (slot + 1) & mask)
+		if (_ids[_index[slot]] == id)
+			return slot;
+
+	return Invalid;
+}
+
+void
+Meshes::insertIndex(unsigned int id, unsigned int position) {
+
+	// keep the load factor at most 1/2
+	if (2*_ids.size() > _index.size())
+		growIndex();
+
+	unsigned int mask = _index.size() - 1;
+
+	unsigned int slot = home(id);
+	while (_index[slot] != Invalid)
+		slot = (slot + 1) & mask;
+
+	_index[slot] = position;
+}
+
+void
+Meshes::eraseIndex(unsigned int id) {
+
+	unsigned int mask = _index.size() - 1;
+
+	unsigned int gap = findSlot(id);
+
+	// move later entries of the same probe sequence into the gap, such that
+	// lookups don't stop early
+	for (unsigned int slot = (gap + 1) & mask; _index[slot] != Invalid; slot = (slot + 1) & mask) {
+
+		unsigned int slotHome = home(_ids[_index[slot]]);
+
+		// the entry can move to the gap, if the gap lies between its home and
+		// its current slot
+		if (((slot - slotHome) & mask) >= ((slot - gap) & mask)) {
+
+			_index[gap] = _index[slot];
+			gap = slot;
+		}
+	}
+
+	_index[gap] = Invalid;
+}
+
+void
+Meshes::growIndex() {
+
+	_indexBits++;
+	_index.assign(1u << _indexBits, Invalid);
+
+	unsigned int mask = _index.size() - 1;
+
+	// all but the mesh that is about to be inserted
+	for (unsigned int position = 0; position + 1 < _ids.size(); position++) {
+
+		unsigned int slot = home(_ids[position]);
+		while (_index[slot] != Invalid)
+			slot = (slot + 1) & mask;
+
+		_index[slot] = position;
+	}
+}
+
+BoundingBox
+Meshes::getBoundingBoxAt(unsigned int position) const {
+
+	if (position >= _ids.size())
+		return BoundingBox();
+
+	if (_meshes[position])
+		return _meshes[position]->getBoundingBox();
+
+	// don't load meshes just for their bounding boxes
+	return _loaderBoundingBoxes[position];
+}
+
+void
+Meshes::setMeshBoundingBoxDirty(unsigned int position) {
+
+	if (!_hierarchyDirty) {
+
+		// it is cheaper to rebuild the hierarchy than to update it leaf by
+		// leaf
+		if (_dirtyPositions.size() >= _ids.size())
+			_hierarchyDirty = true;
+		else
+			_dirtyPositions.push_back(position);
+	}
+
+	setBoundingBoxDirty();
+}
+
+void
+Meshes::updateHierarchy(unsigned int position) const {
+
+	if (position >= _numLeaves)
+		return;
+
+	unsigned int node = _numLeaves + position;
+
+	_hierarchy[node] = getBoundingBoxAt(position);
+
+	for (node /= 2; node >= 1; node /= 2) {
+
+		_hierarchy[node] = _hierarchy[2*node];
+		_hierarchy[node] += _hierarchy[2*node + 1];
+	}
+}
+
+void
+Meshes::rebuildHierarchy() const {
+
+	// leave room to add meshes without rebuilding
+	_numLeaves = 1;
+	while (_numLeaves < _ids.size())
+		_numLeaves *= 2;
+
+	_hierarchy.assign(2*_numLeaves, BoundingBox());
+
+	for (unsigned int position = 0; position < _ids.size(); position++)
+		_hierarchy[_numLeaves + position] = getBoundingBoxAt(position);
+
+	for (unsigned int node = _numLeaves - 1; node >= 1; node--) {
+
+		_hierarchy[node] = _hierarchy[2*node];
+		_hierarchy[node] += _hierarchy[2*node + 1];
+	}
+
+	_hierarchyDirty = false;
+}
@@ -1,55 +1,150 @@
 #ifndef GUI_MESHES_H__
 #define GUI_MESHES_H__
 
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <pipeline/Data.h>
 #include <imageprocessing/Volume.h>
 #include "Mesh.h"
 
+/**
+ * A set of meshes, identified by their ids (usually the label of the object
+ * they show).
+ *
+ * Lookups by id use an open-addressing hash index. The bounding box of the
+ * set is kept in a binary tree over the bounding boxes of the meshes, such
+ * that adding, removing, or changing a mesh updates it in logarithmic time.
+ */
 class Meshes : public pipeline::Data, public Volume {
 
 public:
 
-	Meshes() {}
+	Meshes();
+
+	/**
+	 * Add a mesh with the given id. If there is a mesh with this id already,
+	 * it is replaced.
+	 */
+	void add(unsigned int id, boost::shared_ptr<Mesh> mesh);
+
+	/**
+	 * Add a mesh with the given id that is created by the given loader when
+	 * it is requested the first time through get(). The bounding box of the
+	 * mesh has to be known in advance. If there is a mesh with this id
+	 * already, it is replaced.
+	 */
+	void addLazy(
+			unsigned int id,
+			const boost::function<boost::shared_ptr<Mesh>()>& loader,
+			const BoundingBox& boundingBox);
+
+	/**
+	 * Remove the mesh with the given id. The order of the remaining ids (see
+	 * getMeshIds()) might change.
+	 */
+	void remove(unsigned int id);
+
+	/**
+	 * Get the mesh with the given id, or an empty pointer if there is none.
+	 * Meshes that have been added with addLazy() are loaded here.
+	 */
+	boost::shared_ptr<Mesh> get(unsigned int id);
+
+	/**
+	 * Check whether there is a mesh with the given id.
+	 */
+	bool contains(unsigned int id) const { return find(id) != Invalid; }
+
+	/**
+	 * Check whether the mesh with the given id is in memory, i.e., get() 
+	 * will not have to load it.
+	 */
+	bool isLoaded(unsigned int id) const;
+
+	/**
+	 * Get the bounding box of the mesh with the given id, without loading 
+	 * it.
+	 */
+	BoundingBox getMeshBoundingBox(unsigned int id) const;
+
+	/**
+	 * Tell this set that the vertices of the mesh with the given id have
+	 * been changed after it was added, such that its bounding box is updated.
+	 */
+	void setMeshChanged(unsigned int id);
+
+	/**
+	 * Get the ids of all meshes in this set, without duplicates.
+	 */
+	const std::vector<unsigned int>& getMeshIds() const { return _ids; }
+
+	void clear();
 
-	void add(unsigned int id, boost::shared_ptr<Mesh> mesh) {
+private:
 
-		_meshes[id] = mesh;
-		_ids.push_back(id);
+	typedef boost::function<boost::shared_ptr<Mesh>()> Loader;
 
-		setBoundingBoxDirty();
-	}
+	static const unsigned int Invalid = 0xffffffff;
 
-	boost::shared_ptr<Mesh> get(unsigned int id) {
+	BoundingBox computeBoundingBox() const;
 
-		if (_meshes.count(id))
-			return _meshes[id];
+	// the position of the mesh with the given id in the dense arrays, or
+	// Invalid
+	unsigned int find(unsigned int id) const;
 
-		return boost::shared_ptr<Mesh>();
-	}
+	// the first slot of the index to look for the given id
+	unsigned int home(unsigned int id) const;
 
-	const std::vector<unsigned int>& getMeshIds() const {
+	// the slot of the index that holds the given id, or Invalid
+	unsigned int findSlot(unsigned int id) const;
 
-		return _ids;
-	}
+	// add a mesh position to the index
+	void insertIndex(unsigned int id, unsigned int position);
 
-	void clear() { _meshes.clear(); _ids.clear(); resetBoundingBox(); }
+	// remove an id from the index, keeping the probe sequences intact
+	void eraseIndex(unsigned int id);
 
-private:
+	// double the size of the index
+	void growIndex();
+
+	// the bounding box of the mesh at the given position
+	BoundingBox getBoundingBoxAt(unsigned int position) const;
+
+	// mark the bounding box of the mesh at the given position as changed
+	void setMeshBoundingBoxDirty(unsigned int position);
+
+	// update the leaf of the given position and all boxes above it
+	void updateHierarchy(unsigned int position) const;
+
+	// recompute the whole bounding box hierarchy
+	void rebuildHierarchy() const;
 
-	BoundingBox computeBoundingBox() const {
+	// the meshes in dense arrays, in the order they have been added (until
+	// one is removed)
+	std::vector<unsigned int>            _ids;
+	std::vector<boost::shared_ptr<Mesh> > _meshes;
 
-		BoundingBox boundingBox;
+	// for meshes that have not been loaded, yet: the loader and the bounding
+	// box
+	std::vector<Loader>      _loaders;
+	std::vector<BoundingBox> _loaderBoundingBoxes;
 
-		std::map<unsigned int, boost::shared_ptr<Mesh> >::const_iterator i;
-		for (i = _meshes.begin(); i != _meshes.end(); i++)
-			boundingBox += i->second->getBoundingBox();
+	// hash index from ids to positions in the dense arrays (Invalid for empty
+	// slots), with linear probing
+	std::vector<unsigned int> _index;
+	unsigned int              _indexBits;
 
-		return boundingBox;
-	}
+	// binary tree of bounding boxes, the root is at 1, the children of node
+	// i are at 2i and 2i+1, and the leaf of position p is at _numLeaves + p
+	mutable std::vector<BoundingBox> _hierarchy;
+	mutable unsigned int             _numLeaves;
 
-	std::map<unsigned int, boost::shared_ptr<Mesh> > _meshes;
+	// positions whose leaves have to be updated
+	mutable std::vector<unsigned int> _dirtyPositions;
 
-	std::vector<unsigned int> _ids;
+	// the whole hierarchy has to be rebuilt
+	mutable bool _hierarchyDirty;
 };
 
 #endif // GUI_MESHES_H__
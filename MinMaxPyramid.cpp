@@ -0,0 +1,3 @@
+#include "MinMaxPyramid.h"
+
+logger::LogChannel minmaxpyramidlog("minmaxpyramidlog", "[MinMaxPyramid] ");
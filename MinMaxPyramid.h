@@ -0,0 +1,207 @@
+#ifndef GUI_MIN_MAX_PYRAMID_H__
+#define GUI_MIN_MAX_PYRAMID_H__
+
+#include <algorithm>
+#include <vector>
+#include <util/Logger.h>
+
+extern logger::LogChannel minmaxpyramidlog;
+
+/**
+ * A pyramid of the minimal and maximal values of bricks of voxels of a dense
+ * volume (see VolumeSampler). The bricks of the finest level have a size of
+ * 8x8x8 voxels, each coarser level combines 2x2x2 bricks of the level below.
+ *
+ * The pyramid does not depend on the threshold or label to extract, such
+ * that it can be built once per volume and used for any number of surface
+ * extractions (see MarchingCubes::setMinMaxPyramid()).
+ */
+template <typename ValueType>
+class MinMaxPyramid {
+
+public:
+
+	// the size of the bricks of the finest level in voxels
+	static const unsigned int BrickSize = 8;
+
+	/**
+	 * Build the pyramid for the given dense volume.
+	 */
+	template <typename Volume>
+	MinMaxPyramid(const Volume& volume);
+
+	/**
+	 * Get the minimal and maximal value of the voxels in [minX, maxX]x[minY,
+	 * maxY]x[minZ, maxZ] (inclusive). The result is conservative, i.e., the
+	 * range might be larger than the actual range of values.
+	 */
+	void getRange(
+			unsigned int minX, unsigned int minY, unsigned int minZ,
+			unsigned int maxX, unsigned int maxY, unsigned int maxZ,
+			ValueType& min, ValueType& max) const;
+
+private:
+
+	struct Level {
+
+		// the size of a brick in voxels
+		unsigned int brickSize;
+
+		// the number of bricks in each dimension
+		unsigned int width, height, depth;
+
+		std::vector<ValueType> min;
+		std::vector<ValueType> max;
+
+		inline unsigned int index(unsigned int x, unsigned int y, unsigned int z) const {
+
+			return (z*height + y)*width + x;
+		}
+	};
+
+	std::vector<Level> _levels;
+};
+
+template <typename ValueType>
+const unsigned int MinMaxPyramid<ValueType>::BrickSize;
+
+template <typename ValueType>
+template <typename Volume>
+MinMaxPyramid<ValueType>::MinMaxPyramid(const Volume& volume) {
+
+	unsigned int width  = volume.getVoxelsX();
+	unsigned int height = volume.getVoxelsY();
+	unsigned int depth  = volume.getVoxelsZ();
+
+	if (width == 0 || height == 0 || depth == 0)
+		return;
+
+	// the finest level, from the voxels
+	Level level;
+	level.brickSize = BrickSize;
+	level.width  = (width  + BrickSize - 1)/BrickSize;
+	level.height = (height + BrickSize - 1)/BrickSize;
+	level.depth  = (depth  + BrickSize - 1)/BrickSize;
+	level.min.resize(level.width*level.height*level.depth);
+	level.max.resize(level.width*level.height*level.depth);
+
+	std::vector<bool> initialized(level.min.size(), false);
+
+	for (unsigned int z = 0; z < depth; z++) {
+
+		const ValueType* section = volume.getSection(z);
+
+		for (unsigned int y = 0; y < height; y++) {
+
+			const ValueType* row = section + y*width;
+
+			for (unsigned int bx = 0; bx < level.width; bx++) {
+
+				const ValueType* begin = row + bx*BrickSize;
+				const ValueType* end   = row + std::min(width, (bx + 1)*BrickSize);
+
+				ValueType min = *std::min_element(begin, end);
+				ValueType max = *std::max_element(begin, end);
+
+				unsigned int i = level.index(bx, y/BrickSize, z/BrickSize);
+
+				if (!initialized[i]) {
+
+					level.min[i] = min;
+					level.max[i] = max;
+					initialized[i] = true;
+
+				} else {
+
+					level.min[i] = std::min(level.min[i], min);
+					level.max[i] = std::max(level.max[i], max);
+				}
+			}
+		}
+	}
+
+	_levels.push_back(level);
+
+	// coarser levels, until one brick covers the volume
+	while (level.width > 1 || level.height > 1 || level.depth > 1) {
+
+		const Level& finer = _levels.back();
+
+		Level coarser;
+		coarser.brickSize = 2*finer.brickSize;
+		coarser.width  = (finer.width  + 1)/2;
+		coarser.height = (finer.height + 1)/2;
+		coarser.depth  = (finer.depth  + 1)/2;
+		coarser.min.resize(coarser.width*coarser.height*coarser.depth);
+		coarser.max.resize(coarser.width*coarser.height*coarser.depth);
+
+		for (unsigned int z = 0; z < coarser.depth; z++)
+			for (unsigned int y = 0; y < coarser.height; y++)
+				for (unsigned int x = 0; x < coarser.width; x++) {
+
+					unsigned int i = coarser.index(x, y, z);
+					unsigned int j = finer.index(2*x, 2*y, 2*z);
+
+					coarser.min[i] = finer.min[j];
+					coarser.max[i] = finer.max[j];
+
+					for (unsigned int dz = 0; dz < 2 && 2*z + dz < finer.depth; dz++)
+						for (unsigned int dy = 0; dy < 2 && 2*y + dy < finer.height; dy++)
+							for (unsigned int dx = 0; dx < 2 && 2*x + dx < finer.width; dx++) {
+
+								j = finer.index(2*x + dx, 2*y + dy, 2*z + dz);
+
+								coarser.min[i] = std::min(coarser.min[i], finer.min[j]);
+								coarser.max[i] = std::max(coarser.max[i], finer.max[j]);
+							}
+				}
+
+		_levels.push_back(coarser);
+		level = coarser;
+	}
+
+	LOG_DEBUG(minmaxpyramidlog)
+			<< "built pyramid with " << _levels.size() << " levels for "
+			<< width << "x" << height << "x" << depth << " voxels" << std::endl;
+}
+
+template <typename ValueType>
+void
+MinMaxPyramid<ValueType>::getRange(
+		unsigned int minX, unsigned int minY, unsigned int minZ,
+		unsigned int maxX, unsigned int maxY, unsigned int maxZ,
+		ValueType& min, ValueType& max) const {
+
+	// find the finest level on which the range overlaps with at most three
+	// bricks in each dimension
+	unsigned int extent = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ)) + 1;
+
+	unsigned int l = 0;
+	while (l + 1 < _levels.size() && 2*_levels[l].brickSize < extent)
+		l++;
+
+	const Level& level = _levels[l];
+
+	unsigned int beginX = minX/level.brickSize;
+	unsigned int beginY = minY/level.brickSize;
+	unsigned int beginZ = minZ/level.brickSize;
+	unsigned int endX   = std::min(maxX/level.brickSize + 1, level.width);
+	unsigned int endY   = std::min(maxY/level.brickSize + 1, level.height);
+	unsigned int endZ   = std::min(maxZ/level.brickSize + 1, level.depth);
+
+	min = level.min[level.index(beginX, beginY, beginZ)];
+	max = level.max[level.index(beginX, beginY, beginZ)];
+
+	for (unsigned int z = beginZ; z < endZ; z++)
+		for (unsigned int y = beginY; y < endY; y++)
+			for (unsigned int x = beginX; x < endX; x++) {
+
+				unsigned int i = level.index(x, y, z);
+
+				min = std::min(min, level.min[i]);
+				max = std::max(max, level.max[i]);
+			}
+}
+
+#endif // GUI_MIN_MAX_PYRAMID_H__
+
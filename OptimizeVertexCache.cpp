@@ -0,0 +1,51 @@
+#include <boost/make_shared.hpp>
+#include <boost/timer/timer.hpp>
+#include <util/Logger.h>
+#include "VertexCacheOptimizer.h"
+#include "OptimizeVertexCache.h"
+
+static logger::LogChannel optimizevertexcachelog("optimizevertexcachelog", "[OptimizeVertexCache] ");
+
+OptimizeVertexCache::OptimizeVertexCache() {
+
+	registerInput(_surfaces, "surfaces");
+	registerOutput(_optimized, "optimized surfaces");
+}
+
+void
+OptimizeVertexCache::updateOutputs() {
+
+	boost::timer::cpu_timer timer;
+
+	_optimized = new Meshes;
+
+	foreach (unsigned int id, _surfaces->getMeshIds())
+		_optimized->add(id, optimize(*_surfaces->get(id)));
+
+	LOG_DEBUG(optimizevertexcachelog)
+			<< "optimized " << _surfaces->getMeshIds().size() << " meshes:"
+			<< timer.format() << std::endl;
+}
+
+boost::shared_ptr<Mesh>
+OptimizeVertexCache::optimize(const Mesh& mesh) const {
+
+	VertexCacheOptimizer optimizer;
+
+	boost::shared_ptr<Mesh> optimized = boost::make_shared<Mesh>(mesh);
+	optimizer.optimize(*optimized);
+
+	// the levels of detail are shared with the input mesh
+	optimized->clearLevelsOfDetail();
+
+	for (unsigned int level = 1; level < mesh.getNumLevelsOfDetail(); level++) {
+
+		boost::shared_ptr<Mesh> levelOfDetail = boost::make_shared<Mesh>(mesh.getLevelOfDetail(level));
+		levelOfDetail->clearLevelsOfDetail();
+		optimizer.optimize(*levelOfDetail);
+
+		optimized->addLevelOfDetail(levelOfDetail, mesh.getLevelOfDetailError(level));
+	}
+
+	return optimized;
+}
@@ -0,0 +1,32 @@
+#ifndef GUI_OPTIMIZE_VERTEX_CACHE_H__
+#define GUI_OPTIMIZE_VERTEX_CACHE_H__
+
+#include <pipeline/SimpleProcessNode.h>
+#include "Meshes.h"
+
+/**
+ * Reorders the triangles and vertices of a set of meshes (and of their 
+ * levels of detail) with VertexCacheOptimizer, for faster drawing. Intended 
+ * to be placed after the surface extraction or decimation, before the 
+ * meshes are drawn.
+ *
+ * The input meshes are not changed, the optimized meshes are copies.
+ */
+class OptimizeVertexCache : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	OptimizeVertexCache();
+
+private:
+
+	void updateOutputs();
+
+	// get an optimized copy of a mesh and its levels of detail
+	boost::shared_ptr<Mesh> optimize(const Mesh& mesh) const;
+
+	pipeline::Input<Meshes>  _surfaces;
+	pipeline::Output<Meshes> _optimized;
+};
+
+#endif // GUI_OPTIMIZE_VERTEX_CACHE_H__
@@ -0,0 +1,928 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/timer/timer.hpp>
+#include <util/Logger.h>
+#include "MeshNormals.h"
+#include "QuadricDecimation.h"
+#include "ThreadPool.h"
+
+static logger::LogChannel quadricdecimationlog("quadricdecimationlog", "[QuadricDecimation] ");
+
+namespace {
+
+const unsigned int Invalid = std::numeric_limits<unsigned int>::max();
+
+// the maximal number of neighbors a vertex can get by a collapse
+const unsigned int MaxNeighbors = 16;
+
+struct PointLess {
+
+	bool operator()(const Point3d& a, const Point3d& b) const {
+
+		if (a.x != b.x) return a.x < b.x;
+		if (a.y != b.y) return a.y < b.y;
+		return a.z < b.z;
+	}
+};
+
+struct PositionLess {
+
+	bool operator()(const std::pair<Point3d, unsigned int>& a, const std::pair<Point3d, unsigned int>& b) const {
+
+		return PointLess()(a.first, b.first);
+	}
+};
+
+/**
+ * The sum of squared distances to a set of planes, as a symmetric 4x4
+ * matrix.
+ */
+struct Quadric {
+
+	Quadric() :
+		a2(0), ab(0), ac(0), ad(0),
+		b2(0), bc(0), bd(0),
+		c2(0), cd(0),
+		d2(0) {}
+
+	// the squared distance to the plane ax + by + cz + d = 0, with (a, b, c)
+	// of unit length
+	Quadric(double a, double b, double c, double d) :
+		a2(a*a), ab(a*b), ac(a*c), ad(a*d),
+		b2(b*b), bc(b*c), bd(b*d),
+		c2(c*c), cd(c*d),
+		d2(d*d) {}
+
+	Quadric& operator+=(const Quadric& other) {
+
+		a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+		b2 += other.b2; bc += other.bc; bd += other.bd;
+		c2 += other.c2; cd += other.cd;
+		d2 += other.d2;
+
+		return *this;
+	}
+
+	double error(const Point3d& p) const {
+
+		double x = p.x, y = p.y, z = p.z;
+
+		return
+				a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x +
+				b2*y*y + 2*bc*y*z + 2*bd*y +
+				c2*z*z + 2*cd*z +
+				d2;
+	}
+
+	// Find the point of minimal error. Returns false, if there is no unique
+	// minimum (e.g., for coplanar planes).
+	bool minimum(Point3d& p) const {
+
+		double det =
+				a2*(b2*c2 - bc*bc) -
+				ab*(ab*c2 - bc*ac) +
+				ac*(ab*bc - b2*ac);
+
+		if (std::abs(det) < 1e-10)
+			return false;
+
+		// solve with Cramer's rule
+		double x = -(ad*(b2*c2 - bc*bc) - ab*(bd*c2 - bc*cd) + ac*(bd*bc - b2*cd))/det;
+		double y = -(a2*(bd*c2 - cd*bc) - ad*(ab*c2 - bc*ac) + ac*(ab*cd - bd*ac))/det;
+		double z = -(a2*(b2*cd - bc*bd) - ab*(ab*cd - bd*ac) + ad*(ab*bc - b2*ac))/det;
+
+		p = Point3d(x, y, z);
+
+		return true;
+	}
+
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+/**
+ * Merge vertex 'from' into vertex 'to' and move 'to' to the given position.
+ */
+struct Collapse {
+
+	float error;
+
+	unsigned int from, to;
+
+	// the versions of the vertices this collapse was computed for
+	unsigned int fromVersion, toVersion;
+
+	Point3d position;
+
+	// order a priority queue by increasing error
+	bool operator<(const Collapse& other) const { return error > other.error; }
+};
+
+inline Vector3d normal(const Point3d& p0, const Point3d& p1, const Point3d& p2) {
+
+	Vector3d e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+	Vector3d e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+
+	return Vector3d(
+			e1.y*e2.z - e1.z*e2.y,
+			e1.z*e2.x - e1.x*e2.z,
+			e1.x*e2.y - e1.y*e2.x);
+}
+
+inline float dot(const Vector3d& a, const Vector3d& b) {
+
+	return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+/**
+ * The squared distance of p to the triangle (a, b, c), found with the
+ * closest point of the triangle (Ericson, "Real-Time Collision Detection",
+ * 5.1.5).
+ */
+double squaredDistance(const Point3d& p, const Point3d& a, const Point3d& b, const Point3d& c) {
+
+	double abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+	double acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+	double apx = p.x - a.x, apy = p.y - a.y, apz = p.z - a.z;
+
+	double d1 = abx*apx + aby*apy + abz*apz;
+	double d2 = acx*apx + acy*apy + acz*apz;
+
+	double v, w;
+
+	if (d1 <= 0 && d2 <= 0) {
+
+		v = 0; w = 0;
+
+	} else {
+
+		double bpx = p.x - b.x, bpy = p.y - b.y, bpz = p.z - b.z;
+		double d3 = abx*bpx + aby*bpy + abz*bpz;
+		double d4 = acx*bpx + acy*bpy + acz*bpz;
+
+		double cpx = p.x - c.x, cpy = p.y - c.y, cpz = p.z - c.z;
+		double d5 = abx*cpx + aby*cpy + abz*cpz;
+		double d6 = acx*cpx + acy*cpy + acz*cpz;
+
+		double va = d3*d6 - d5*d4;
+		double vb = d5*d2 - d1*d6;
+		double vc = d1*d4 - d3*d2;
+
+		if (d3 >= 0 && d4 <= d3) {
+
+			// vertex b
+			v = 1; w = 0;
+
+		} else if (d6 >= 0 && d5 <= d6) {
+
+			// vertex c
+			v = 0; w = 1;
+
+		} else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+
+			// edge ab
+			v = d1/(d1 - d3); w = 0;
+
+		} else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+
+			// edge ac
+			v = 0; w = d2/(d2 - d6);
+
+		} else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+
+			// edge bc
+			w = (d4 - d3)/((d4 - d3) + (d5 - d6));
+			v = 1 - w;
+
+		} else {
+
+			// inside the face
+			double denominator = va + vb + vc;
+
+			if (denominator == 0) {
+
+				v = 0; w = 0;
+
+			} else {
+
+				v = vb/denominator;
+				w = vc/denominator;
+			}
+		}
+	}
+
+	double dx = apx - v*abx - w*acx;
+	double dy = apy - v*aby - w*acy;
+	double dz = apz - v*abz - w*acz;
+
+	return dx*dx + dy*dy + dz*dz;
+}
+
+/**
+ * The state of the decimation of one mesh.
+ */
+class EdgeCollapser {
+
+public:
+
+	EdgeCollapser(const Mesh& mesh, const std::vector<Point3d>& lockedPositions);
+
+	// Collapse edges until the number of triangles is at most
+	// targetTriangles or the next collapse has an error larger than
+	// maxError.
+	void collapse(unsigned int targetTriangles, double maxError);
+
+	// Create a mesh of the remaining triangles.
+	boost::shared_ptr<Mesh> createMesh() const;
+
+	// The largest distance of an original vertex to the closest triangle
+	// found by walking over the surface from the vertex it was merged into.
+	// This is an upper bound of the distance of the original vertices to the
+	// decimated surface.
+	float computeError() const;
+
+private:
+
+	// Find the best way to collapse the edge (a, b) and queue it.
+	void queueCollapse(unsigned int a, unsigned int b);
+
+	// Check whether a queued collapse can be applied to the current mesh.
+	bool isValid(const Collapse& collapse);
+
+	void apply(const Collapse& collapse);
+
+	// Find the neighbors of a vertex.
+	void getNeighbors(unsigned int v, std::vector<unsigned int>& neighbors) const;
+
+	inline bool contains(const Triangle& triangle, unsigned int v) const {
+
+		return triangle.v0 == v || triangle.v1 == v || triangle.v2 == v;
+	}
+
+	// Remember the given triangle, if it is closer to p than the closest
+	// triangle so far.
+	inline void updateClosest(const Point3d& p, unsigned int t, double& distance, unsigned int& closest) const {
+
+		if (_removed[t])
+			return;
+
+		const Triangle& triangle = _triangles[t];
+
+		double d = squaredDistance(p, _positions[triangle.v0], _positions[triangle.v1], _positions[triangle.v2]);
+
+		if (d < distance) {
+
+			distance = d;
+			closest  = t;
+		}
+	}
+
+	// the vertices of the mesh to decimate
+	const Point3d* _originalPositions;
+
+	std::vector<Point3d>  _positions;
+	std::vector<Quadric>  _quadrics;
+	std::vector<char>     _locked;
+	std::vector<char>     _alive;
+	std::vector<unsigned int> _versions;
+
+	// the vertex each vertex was merged into, or the vertex itself
+	std::vector<unsigned int> _mergedInto;
+
+	std::vector<Triangle> _triangles;
+	std::vector<char>     _removed;
+	unsigned int          _numTriangles;
+
+	// the triangles around each vertex, might contain removed triangles
+	std::vector<std::vector<unsigned int> > _vertexTriangles;
+
+	std::priority_queue<Collapse> _queue;
+
+	// temporary neighbor lists
+	std::vector<unsigned int> _neighborsFrom;
+	std::vector<unsigned int> _neighborsTo;
+};
+
+EdgeCollapser::EdgeCollapser(const Mesh& mesh, const std::vector<Point3d>& lockedPositions) :
+	_originalPositions(mesh.getVertices()),
+	_positions(mesh.getVertices(), mesh.getVertices() + mesh.getNumVertices()),
+	_quadrics(mesh.getNumVertices()),
+	_locked(mesh.getNumVertices(), 0),
+	_alive(mesh.getNumVertices(), 1),
+	_versions(mesh.getNumVertices(), 0),
+	_mergedInto(mesh.getNumVertices()),
+	_triangles(mesh.getTriangles(), mesh.getTriangles() + mesh.getNumTriangles()),
+	_removed(mesh.getNumTriangles(), 0),
+	_numTriangles(mesh.getNumTriangles()),
+	_vertexTriangles(mesh.getNumVertices()) {
+
+	for (unsigned int i = 0; i < _mergedInto.size(); i++)
+		_mergedInto[i] = i;
+
+	// the quadrics of the planes around each vertex
+
+	for (unsigned int i = 0; i < _triangles.size(); i++) {
+
+		const Triangle& triangle = _triangles[i];
+
+		_vertexTriangles[triangle.v0].push_back(i);
+		_vertexTriangles[triangle.v1].push_back(i);
+		_vertexTriangles[triangle.v2].push_back(i);
+
+		const Point3d& p0 = _positions[triangle.v0];
+
+		Vector3d n = normal(p0, _positions[triangle.v1], _positions[triangle.v2]);
+
+		double length = std::sqrt(dot(n, n));
+
+		if (length == 0)
+			continue;
+
+		Quadric plane(n.x/length, n.y/length, n.z/length, -(n.x*p0.x + n.y*p0.y + n.z*p0.z)/length);
+
+		_quadrics[triangle.v0] += plane;
+		_quadrics[triangle.v1] += plane;
+		_quadrics[triangle.v2] += plane;
+	}
+
+	// lock the vertices on the border of the mesh, i.e., the ones of edges
+	// with only one triangle
+
+	std::vector<boost::uint64_t> edges;
+	edges.reserve(3*_triangles.size());
+
+	for (unsigned int i = 0; i < _triangles.size(); i++) {
+
+		const unsigned int corners[3] = { _triangles[i].v0, _triangles[i].v1, _triangles[i].v2 };
+
+		for (int j = 0; j < 3; j++) {
+
+			boost::uint64_t a = std::min(corners[j], corners[(j + 1)%3]);
+			boost::uint64_t b = std::max(corners[j], corners[(j + 1)%3]);
+
+			edges.push_back((a << 32) | b);
+		}
+	}
+
+	std::sort(edges.begin(), edges.end());
+
+	for (unsigned int i = 0; i < edges.size();) {
+
+		unsigned int j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+
+		if (j - i == 1) {
+
+			_locked[edges[i] >> 32] = 1;
+			_locked[edges[i] & 0xffffffff] = 1;
+		}
+
+		i = j;
+	}
+
+	// lock the vertices at the given positions
+
+	if (!lockedPositions.empty())
+		for (unsigned int i = 0; i < _positions.size(); i++)
+			if (std::binary_search(lockedPositions.begin(), lockedPositions.end(), _positions[i], PointLess()))
+				_locked[i] = 1;
+
+	// queue each edge once (edges are oriented consistently in neighboring
+	// triangles)
+
+	for (unsigned int i = 0; i < _triangles.size(); i++) {
+
+		const unsigned int corners[3] = { _triangles[i].v0, _triangles[i].v1, _triangles[i].v2 };
+
+		for (int j = 0; j < 3; j++)
+			if (corners[j] < corners[(j + 1)%3])
+				queueCollapse(corners[j], corners[(j + 1)%3]);
+	}
+}
+
+void
+EdgeCollapser::collapse(unsigned int targetTriangles, double maxError) {
+
+	while (_numTriangles > targetTriangles && !_queue.empty()) {
+
+		Collapse collapse = _queue.top();
+
+		if (collapse.error > maxError)
+			break;
+
+		_queue.pop();
+
+		if (isValid(collapse))
+			apply(collapse);
+	}
+}
+
+boost::shared_ptr<Mesh>
+EdgeCollapser::createMesh() const {
+
+	// number the remaining vertices in their original order
+
+	std::vector<unsigned int> ids(_positions.size(), Invalid);
+
+	for (unsigned int i = 0; i < _triangles.size(); i++)
+		if (!_removed[i]) {
+
+			ids[_triangles[i].v0] = 0;
+			ids[_triangles[i].v1] = 0;
+			ids[_triangles[i].v2] = 0;
+		}
+
+	unsigned int numVertices = 0;
+	for (unsigned int i = 0; i < ids.size(); i++)
+		if (ids[i] == 0)
+			ids[i] = numVertices++;
+
+	boost::shared_ptr<Mesh> mesh = boost::make_shared<Mesh>(numVertices, _numTriangles);
+
+	for (unsigned int i = 0; i < ids.size(); i++)
+		if (ids[i] != Invalid)
+			mesh->getVertices()[ids[i]] = _positions[i];
+
+	unsigned int next = 0;
+	for (unsigned int i = 0; i < _triangles.size(); i++)
+		if (!_removed[i])
+			mesh->getTriangles()[next++] = Triangle(
+					ids[_triangles[i].v0],
+					ids[_triangles[i].v1],
+					ids[_triangles[i].v2]);
+
+	mesh->setVerticesChanged();
+
+	// meshes are decimated in parallel already
+	MeshNormals(MeshNormals::AreaWeighted, 1).computeNormals(*mesh);
+
+	return mesh;
+}
+
+float
+EdgeCollapser::computeError() const {
+
+	// follow the merges to the remaining vertices
+	std::vector<unsigned int> remaining(_mergedInto);
+
+	for (unsigned int v = 0; v < remaining.size(); v++) {
+
+		unsigned int r = remaining[v];
+		while (remaining[r] != r)
+			r = remaining[r];
+
+		for (unsigned int u = v; remaining[u] != r;) {
+
+			unsigned int next = remaining[u];
+			remaining[u] = r;
+			u = next;
+		}
+	}
+
+	double maxError = 0;
+
+	for (unsigned int v = 0; v < remaining.size(); v++) {
+
+		unsigned int r = remaining[v];
+
+		const Point3d& p = _originalPositions[v];
+
+		// still a vertex of the decimated mesh
+		if (r == v && _positions[v].x == p.x && _positions[v].y == p.y && _positions[v].z == p.z)
+			continue;
+
+		double error = std::numeric_limits<double>::max();
+		unsigned int closest = Invalid;
+
+		for (unsigned int i = 0; i < _vertexTriangles[r].size(); i++)
+			updateClosest(p, _vertexTriangles[r][i], error, closest);
+
+		// walk over the surface towards the closest triangle, until the
+		// vertex is not farther than the largest error so far
+		for (unsigned int previous = Invalid; closest != previous && error > maxError;) {
+
+			previous = closest;
+
+			const unsigned int* corners = &_triangles[previous].v0;
+
+			for (int j = 0; j < 3; j++)
+				for (unsigned int i = 0; i < _vertexTriangles[corners[j]].size(); i++)
+					updateClosest(p, _vertexTriangles[corners[j]][i], error, closest);
+		}
+
+		// the vertex is not part of any triangle anymore
+		if (error == std::numeric_limits<double>::max())
+			continue;
+
+		maxError = std::max(maxError, error);
+	}
+
+	return std::sqrt(maxError);
+}
+
+void
+EdgeCollapser::queueCollapse(unsigned int a, unsigned int b) {
+
+	if (_locked[a] && _locked[b])
+		return;
+
+	Collapse collapse;
+
+	Quadric quadric = _quadrics[a];
+	quadric += _quadrics[b];
+
+	if (_locked[a] || _locked[b]) {
+
+		// keep the locked vertex where it is
+		collapse.from     = (_locked[a] ? b : a);
+		collapse.to       = (_locked[a] ? a : b);
+		collapse.position = _positions[collapse.to];
+		collapse.error    = quadric.error(collapse.position);
+
+	} else {
+
+		collapse.from = a;
+		collapse.to   = b;
+
+		const Point3d& pa = _positions[a];
+		const Point3d& pb = _positions[b];
+
+		Point3d candidates[4] = {
+			pa,
+			pb,
+			Point3d((pa.x + pb.x)/2, (pa.y + pb.y)/2, (pa.z + pb.z)/2),
+			Point3d()
+		};
+
+		int numCandidates = (quadric.minimum(candidates[3]) ? 4 : 3);
+
+		collapse.error = std::numeric_limits<float>::max();
+
+		for (int i = 0; i < numCandidates; i++) {
+
+			float error = quadric.error(candidates[i]);
+
+			if (error < collapse.error) {
+
+				collapse.error    = error;
+				collapse.position = candidates[i];
+			}
+		}
+	}
+
+	// numerical noise can make the error of coplanar planes negative
+	collapse.error = std::max(0.0f, collapse.error);
+
+	collapse.fromVersion = _versions[collapse.from];
+	collapse.toVersion   = _versions[collapse.to];
+
+	_queue.push(collapse);
+}
+
+bool
+EdgeCollapser::isValid(const Collapse& collapse) {
+
+	unsigned int from = collapse.from;
+	unsigned int to   = collapse.to;
+
+	if (!_alive[from] || !_alive[to])
+		return false;
+
+	if (_versions[from] != collapse.fromVersion || _versions[to] != collapse.toVersion)
+		return false;
+
+	// The vertices shared by the neighborhoods of the two vertices have to be
+	// exactly the opposite vertices of the triangles on the edge, otherwise
+	// the collapse would create a non-manifold mesh.
+
+	getNeighbors(from, _neighborsFrom);
+	getNeighbors(to,   _neighborsTo);
+
+	if (!std::binary_search(_neighborsFrom.begin(), _neighborsFrom.end(), to))
+		return false;
+
+	unsigned int sharedNeighbors = 0;
+	for (unsigned int i = 0; i < _neighborsFrom.size(); i++)
+		if (std::binary_search(_neighborsTo.begin(), _neighborsTo.end(), _neighborsFrom[i]))
+			sharedNeighbors++;
+
+	unsigned int edgeTriangles = 0;
+	for (unsigned int i = 0; i < _vertexTriangles[from].size(); i++) {
+
+		unsigned int t = _vertexTriangles[from][i];
+
+		if (!_removed[t] && contains(_triangles[t], to))
+			edgeTriangles++;
+	}
+
+	if (sharedNeighbors != edgeTriangles)
+		return false;
+
+	// Vertices with many neighbors lead to thin triangles and make further 
+	// collapses around them expensive.
+	if (_neighborsFrom.size() + _neighborsTo.size() - sharedNeighbors - 2 > MaxNeighbors)
+		return false;
+
+	// The triangles that remain must not flip.
+
+	const unsigned int vertices[2] = { from, to };
+
+	for (int k = 0; k < 2; k++) {
+
+		unsigned int v     = vertices[k];
+		unsigned int other = vertices[1 - k];
+
+		for (unsigned int i = 0; i < _vertexTriangles[v].size(); i++) {
+
+			unsigned int t = _vertexTriangles[v][i];
+
+			if (_removed[t] || contains(_triangles[t], other))
+				continue;
+
+			const Triangle& triangle = _triangles[t];
+
+			Point3d p[3] = {
+				_positions[triangle.v0],
+				_positions[triangle.v1],
+				_positions[triangle.v2]
+			};
+
+			Vector3d before = normal(p[0], p[1], p[2]);
+
+			if (triangle.v0 == v) p[0] = collapse.position;
+			if (triangle.v1 == v) p[1] = collapse.position;
+			if (triangle.v2 == v) p[2] = collapse.position;
+
+			Vector3d after = normal(p[0], p[1], p[2]);
+
+			if (dot(before, after) <= 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void
+EdgeCollapser::apply(const Collapse& collapse) {
+
+	unsigned int from = collapse.from;
+	unsigned int to   = collapse.to;
+
+	_positions[to] = collapse.position;
+	_quadrics[to] += _quadrics[from];
+	_alive[from] = 0;
+	_versions[to]++;
+	_mergedInto[from] = to;
+
+	// remove the triangles on the edge, let the others use 'to' instead of
+	// 'from'
+
+	std::vector<unsigned int>& toTriangles = _vertexTriangles[to];
+
+	for (unsigned int i = 0; i < _vertexTriangles[from].size(); i++) {
+
+		unsigned int t = _vertexTriangles[from][i];
+
+		if (_removed[t])
+			continue;
+
+		Triangle& triangle = _triangles[t];
+
+		if (contains(triangle, to)) {
+
+			_removed[t] = 1;
+			_numTriangles--;
+			continue;
+		}
+
+		if (triangle.v0 == from) triangle.v0 = to;
+		if (triangle.v1 == from) triangle.v1 = to;
+		if (triangle.v2 == from) triangle.v2 = to;
+
+		toTriangles.push_back(t);
+	}
+
+	std::vector<unsigned int>().swap(_vertexTriangles[from]);
+
+	// forget about removed triangles
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < toTriangles.size(); i++)
+		if (!_removed[toTriangles[i]])
+			toTriangles[kept++] = toTriangles[i];
+	toTriangles.resize(kept);
+
+	// the errors of all edges around 'to' changed
+
+	getNeighbors(to, _neighborsTo);
+
+	for (unsigned int i = 0; i < _neighborsTo.size(); i++)
+		queueCollapse(to, _neighborsTo[i]);
+}
+
+void
+EdgeCollapser::getNeighbors(unsigned int v, std::vector<unsigned int>& neighbors) const {
+
+	neighbors.clear();
+
+	for (unsigned int i = 0; i < _vertexTriangles[v].size(); i++) {
+
+		unsigned int t = _vertexTriangles[v][i];
+
+		if (_removed[t])
+			continue;
+
+		const Triangle& triangle = _triangles[t];
+
+		if (triangle.v0 != v) neighbors.push_back(triangle.v0);
+		if (triangle.v1 != v) neighbors.push_back(triangle.v1);
+		if (triangle.v2 != v) neighbors.push_back(triangle.v2);
+	}
+
+	std::sort(neighbors.begin(), neighbors.end());
+	neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+}
+
+} // anonymous namespace
+
+QuadricDecimation::QuadricDecimation(float targetRatio, float maxError) :
+	_targetRatio(targetRatio),
+	_maxError(maxError) {}
+
+boost::shared_ptr<Mesh>
+QuadricDecimation::decimate(const Mesh& mesh) const {
+
+	float error;
+
+	return decimate(mesh, std::vector<Point3d>(), error);
+}
+
+boost::shared_ptr<Meshes>
+QuadricDecimation::decimate(Meshes& meshes, unsigned int numThreads) const {
+
+	std::vector<float> errors;
+
+	return decimate(meshes, numThreads, errors);
+}
+
+void
+QuadricDecimation::createLevelsOfDetail(Meshes& meshes, unsigned int numLevels, unsigned int numThreads) const {
+
+	boost::timer::cpu_timer timer;
+
+	const std::vector<unsigned int> ids = meshes.getMeshIds();
+
+	// the errors of the previous levels with respect to the meshes
+	std::vector<float> totalErrors(ids.size(), 0);
+	std::vector<float> errors;
+
+	// decimate each level from the previous one
+	boost::shared_ptr<Meshes> previous;
+
+	for (unsigned int level = 1; level <= numLevels; level++) {
+
+		boost::shared_ptr<Meshes> current = decimate(level == 1 ? meshes : *previous, numThreads, errors);
+
+		for (unsigned int i = 0; i < ids.size(); i++) {
+
+			boost::shared_ptr<Mesh> mesh   = meshes.get(ids[i]);
+			boost::shared_ptr<Mesh> coarse = current->get(ids[i]);
+
+			const Mesh& finer = mesh->getLevelOfDetail(mesh->getNumLevelsOfDetail() - 1);
+
+			totalErrors[i] += errors[i];
+
+			// the decimation got stuck
+			if (coarse->getNumTriangles() == finer.getNumTriangles())
+				continue;
+
+			mesh->addLevelOfDetail(coarse, totalErrors[i]);
+		}
+
+		previous = current;
+	}
+
+	LOG_DEBUG(quadricdecimationlog)
+			<< "created " << numLevels << " levels of detail for "
+			<< ids.size() << " meshes:" << timer.format() << std::endl;
+}
+
+boost::shared_ptr<Meshes>
+QuadricDecimation::decimate(Meshes& meshes, unsigned int numThreads, std::vector<float>& errors) const {
+
+	boost::timer::cpu_timer timer;
+
+	const std::vector<unsigned int>& ids = meshes.getMeshIds();
+
+	// find the positions of vertices that are part of more than one mesh
+
+	std::vector<std::pair<Point3d, unsigned int> > positions;
+
+	std::size_t numVertices = 0;
+	for (unsigned int i = 0; i < ids.size(); i++)
+		numVertices += meshes.get(ids[i])->getNumVertices();
+	positions.reserve(numVertices);
+
+	for (unsigned int i = 0; i < ids.size(); i++) {
+
+		const Mesh& mesh = *meshes.get(ids[i]);
+
+		for (unsigned int j = 0; j < mesh.getNumVertices(); j++)
+			positions.push_back(std::make_pair(mesh.getVertex(j), i));
+	}
+
+	std::sort(positions.begin(), positions.end(), PositionLess());
+
+	PointLess less;
+	std::vector<Point3d> lockedPositions;
+
+	for (std::size_t i = 0; i < positions.size();) {
+
+		std::size_t j = i + 1;
+		bool shared = false;
+
+		while (j < positions.size() && !less(positions[i].first, positions[j].first)) {
+
+			if (positions[j].second != positions[i].second)
+				shared = true;
+			j++;
+		}
+
+		if (shared)
+			lockedPositions.push_back(positions[i].first);
+
+		i = j;
+	}
+
+	std::vector<std::pair<Point3d, unsigned int> >().swap(positions);
+
+	// decimate each mesh in its own job
+
+	std::vector<boost::shared_ptr<Mesh> > results(ids.size());
+	errors.resize(ids.size());
+
+	{
+		ThreadPool pool(numThreads);
+
+		for (unsigned int i = 0; i < ids.size(); i++)
+			pool.schedule(
+					boost::bind(
+							&QuadricDecimation::decimateJob,
+							this,
+							boost::cref(*meshes.get(ids[i])),
+							boost::cref(lockedPositions),
+							boost::ref(results[i]),
+							boost::ref(errors[i])));
+
+		pool.wait();
+	}
+
+	boost::shared_ptr<Meshes> decimated = boost::make_shared<Meshes>();
+
+	for (unsigned int i = 0; i < ids.size(); i++)
+		decimated->add(ids[i], results[i]);
+
+	LOG_DEBUG(quadricdecimationlog)
+			<< "decimated " << ids.size() << " meshes with "
+			<< lockedPositions.size() << " shared vertices:" << timer.format() << std::endl;
+
+	return decimated;
+}
+
+boost::shared_ptr<Mesh>
+QuadricDecimation::decimate(const Mesh& mesh, const std::vector<Point3d>& lockedPositions, float& error) const {
+
+	boost::timer::cpu_timer timer;
+
+	EdgeCollapser collapser(mesh, lockedPositions);
+
+	collapser.collapse(
+			static_cast<unsigned int>(_targetRatio*mesh.getNumTriangles()),
+			static_cast<double>(_maxError)*_maxError);
+
+	boost::shared_ptr<Mesh> decimated = collapser.createMesh();
+
+	error = collapser.computeError();
+
+	LOG_ALL(quadricdecimationlog)
+			<< "decimated a mesh from " << mesh.getNumTriangles() << " to "
+			<< decimated->getNumTriangles() << " triangles:" << timer.format() << std::endl;
+
+	return decimated;
+}
+
+void
+QuadricDecimation::decimateJob(
+		const Mesh& mesh,
+		const std::vector<Point3d>& lockedPositions,
+		boost::shared_ptr<Mesh>& result,
+		float& error) const {
+
+	result = decimate(mesh, lockedPositions, error);
+}
+
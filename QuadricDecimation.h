@@ -0,0 +1,89 @@
+#ifndef GUI_QUADRIC_DECIMATION_H__
+#define GUI_QUADRIC_DECIMATION_H__
+
+#include <limits>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "Mesh.h"
+#include "Meshes.h"
+
+/**
+ * Simplifies meshes by collapsing edges in the order of the error they
+ * introduce, measured with quadric error metrics (Garland and Heckbert,
+ * "Surface Simplification Using Quadric Error Metrics").
+ *
+ * The error of a vertex is the sum of squared distances to the planes of the
+ * original triangles that have been merged into it. Edges are collapsed until
+ * the mesh has the target number of triangles or the error of the next
+ * collapse would exceed the maximal error.
+ *
+ * The error reported for a decimation is measured after the collapses: For
+ * each vertex of the original mesh, the closest triangle is searched by
+ * walking over the decimated surface, starting at the vertex it has been
+ * merged into. The error is the largest of these distances, an upper bound of
+ * the distance of the original vertices to the decimated surface.
+ *
+ * Vertices on the border of a mesh do not move. When a set of meshes is
+ * decimated, the same holds for vertices that are part of more than one mesh
+ * (like the vertices on the boundary between two adjacent labels), such that
+ * the decimated meshes still fit together.
+ */
+class QuadricDecimation {
+
+public:
+
+	/**
+	 * Create a decimation.
+	 *
+	 * @param targetRatio
+	 *              The fraction of triangles to keep.
+	 * @param maxError
+	 *              The maximal distance a vertex may have to the planes of
+	 *              the original triangles it replaces (in units of the mesh).
+	 */
+	QuadricDecimation(
+			float targetRatio = 0.1,
+			float maxError = std::numeric_limits<float>::max());
+
+	/**
+	 * Create a decimated copy of the given mesh.
+	 */
+	boost::shared_ptr<Mesh> decimate(const Mesh& mesh) const;
+
+	/**
+	 * Create decimated copies of all the given meshes, using the given number
+	 * of threads (0 for one per hardware thread).
+	 */
+	boost::shared_ptr<Meshes> decimate(Meshes& meshes, unsigned int numThreads = 0) const;
+
+	/**
+	 * Add the given number of levels of detail to each of the given meshes 
+	 * (see Mesh::addLevelOfDetail()). Each level is a decimation of the 
+	 * previous one, its error is the sum of the errors of the decimations 
+	 * that lead to it. Levels that do not remove any triangles are left out.
+	 */
+	void createLevelsOfDetail(Meshes& meshes, unsigned int numLevels, unsigned int numThreads = 0) const;
+
+private:
+
+	// Create decimated copies of all the given meshes, and get the error of 
+	// each decimation (in the order of the mesh ids).
+	boost::shared_ptr<Meshes> decimate(Meshes& meshes, unsigned int numThreads, std::vector<float>& errors) const;
+
+	// Decimate a mesh, keeping the vertices at the given (sorted) positions.
+	boost::shared_ptr<Mesh> decimate(const Mesh& mesh, const std::vector<Point3d>& lockedPositions, float& error) const;
+
+	// Job to decimate one of several meshes.
+	void decimateJob(
+			const Mesh& mesh,
+			const std::vector<Point3d>& lockedPositions,
+			boost::shared_ptr<Mesh>& result,
+			float& error) const;
+
+	float _targetRatio;
+
+	float _maxError;
+};
+
+#endif // GUI_QUADRIC_DECIMATION_H__
+
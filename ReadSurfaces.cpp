@@ -0,0 +1,14 @@
+#include "MeshFile.h"
+#include "ReadSurfaces.h"
+
+ReadSurfaces::ReadSurfaces(const std::string& filename) :
+	_filename(filename) {
+
+	registerOutput(_surfaces, "surfaces");
+}
+
+void
+ReadSurfaces::updateOutputs() {
+
+	_surfaces = MeshFile::read(_filename);
+}
@@ -0,0 +1,32 @@
+#ifndef GUI_READ_SURFACES_H__
+#define GUI_READ_SURFACES_H__
+
+#include <string>
+#include <pipeline/SimpleProcessNode.h>
+#include "Meshes.h"
+
+/**
+ * Reads a set of meshes from a MeshFile. The file is mapped into memory and 
+ * each mesh is read only when it is requested from the output "surfaces" 
+ * for the first time.
+ */
+class ReadSurfaces : public pipeline::SimpleProcessNode<> {
+
+public:
+
+	/**
+	 * Create a new node to read the meshes of the given mesh file.
+	 */
+	ReadSurfaces(const std::string& filename);
+
+private:
+
+	void updateOutputs();
+
+	pipeline::Output<Meshes> _surfaces;
+
+	std::string _filename;
+};
+
+#endif // GUI_READ_SURFACES_H__
+
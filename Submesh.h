@@ -0,0 +1,110 @@
+#ifndef GUI_SUBMESH_H__
+#define GUI_SUBMESH_H__
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <imageprocessing/Volume.h>
+#include "Mesh.h"
+
+/**
+ * A selection of triangles of a mesh that shares the vertices and normals of
+ * the mesh. Only the triangles of the selection are stored. Their vertex
+ * indices refer to the vertices of the mesh, such that the triangles can be
+ * drawn with the vertex and normal arrays of the mesh.
+ *
+ * Use Mesh::createSubmesh() to get an independent mesh instead.
+ */
+class Submesh : public Volume {
+
+public:
+
+	/**
+	 * Create a submesh from a selection of triangles of the given mesh.
+	 *
+	 * @param mesh
+	 *              The mesh to select triangles from.
+	 * @param triangles
+	 *              Indices of the triangles to use in the submesh.
+	 */
+	Submesh(boost::shared_ptr<const Mesh> mesh, const std::vector<unsigned int>& triangles) :
+		_mesh(mesh),
+		_triangles(triangles.size()) {
+
+		for (unsigned int i = 0; i < triangles.size(); i++)
+			_triangles[i] = _mesh->getTriangle(triangles[i]);
+	}
+
+	/**
+	 * The mesh this submesh shares the vertices with.
+	 */
+	boost::shared_ptr<const Mesh> getMesh() const { return _mesh; }
+
+	/**
+	 * The number of triangles of this submesh.
+	 */
+	unsigned int getNumTriangles() const { return _triangles.size(); }
+
+	/**
+	 * Get a triangle of this submesh by index. The vertex indices refer to
+	 * the vertices of getMesh().
+	 */
+	const Triangle& getTriangle(unsigned int index) const { return _triangles[index]; }
+
+	/**
+	 * Get the array of all triangles of this submesh.
+	 */
+	const Triangle* getTriangles() const { return _triangles.empty() ? 0 : &_triangles[0]; }
+
+	/**
+	 * Get a vertex of the mesh by index.
+	 */
+	const Point3d&  getVertex(unsigned int index) const { return _mesh->getVertex(index); }
+
+	/**
+	 * Get a vertex' normal of the mesh by index.
+	 */
+	const Vector3d& getNormal(unsigned int index) const { return _mesh->getNormal(index); }
+
+private:
+
+	BoundingBox computeBoundingBox() const {
+
+		float minX, minY, minZ;
+		float maxX, maxY, maxZ;
+
+		minX = minY = minZ =  std::numeric_limits<float>::max();
+		maxX = maxY = maxZ = -std::numeric_limits<float>::max();
+
+		const Point3d* vertices = _mesh->getVertices();
+
+		for (unsigned int i = 0; i < _triangles.size(); i++) {
+
+			const unsigned int corners[3] = { _triangles[i].v0, _triangles[i].v1, _triangles[i].v2 };
+
+			for (int j = 0; j < 3; j++) {
+
+				const Point3d& p = vertices[corners[j]];
+
+				minX = std::min(p.x, minX);
+				minY = std::min(p.y, minY);
+				minZ = std::min(p.z, minZ);
+				maxX = std::max(p.x, maxX);
+				maxY = std::max(p.y, maxY);
+				maxZ = std::max(p.z, maxZ);
+			}
+		}
+
+		return BoundingBox(
+				minX, minY, minZ,
+				maxX, maxY, maxZ);
+	}
+
+	boost::shared_ptr<const Mesh> _mesh;
+
+	std::vector<Triangle> _triangles;
+};
+
+#endif // GUI_SUBMESH_H__
+
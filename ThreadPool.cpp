@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads) :
+	_numThreads(numThreads),
+	_pending(0),
+	_stop(false) {
+
+	if (_numThreads == 0)
+		_numThreads = std::max(1u, boost::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < _numThreads; i++)
+		_threads.create_thread(boost::bind(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		while (_pending > 0)
+			_jobsDone.wait(lock);
+
+		_stop = true;
+	}
+
+	_jobAvailable.notify_all();
+	_threads.join_all();
+}
+
+void
+ThreadPool::schedule(const boost::function<void()>& job) {
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		_jobs.push_back(job);
+		_pending++;
+	}
+
+	_jobAvailable.notify_one();
+}
+
+void
+ThreadPool::wait() {
+
+	boost::exception_ptr exception;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		while (_pending > 0)
+			_jobsDone.wait(lock);
+
+		exception = _exception;
+		_exception = boost::exception_ptr();
+	}
+
+	if (exception)
+		boost::rethrow_exception(exception);
+}
+
+void
+ThreadPool::work() {
+
+	while (true) {
+
+		boost::function<void()> job;
+
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+
+			while (_jobs.empty() && !_stop)
+				_jobAvailable.wait(lock);
+
+			if (_jobs.empty())
+				return;
+
+			job = _jobs.front();
+			_jobs.pop_front();
+		}
+
+		boost::exception_ptr exception;
+
+		try {
+
+			job();
+
+		} catch (...) {
+
+			exception = boost::current_exception();
+		}
+
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+
+			if (exception && !_exception)
+				_exception = exception;
+
+			_pending--;
+		}
+
+		_jobsDone.notify_all();
+	}
+}
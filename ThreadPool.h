@@ -0,0 +1,72 @@
+#ifndef GUI_THREAD_POOL_H__
+#define GUI_THREAD_POOL_H__
+
+#include <deque>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * A fixed set of worker threads that process jobs in the order they have
+ * been scheduled.
+ */
+class ThreadPool {
+
+public:
+
+	/**
+	 * Create a thread pool.
+	 *
+	 * @param numThreads
+	 *              The number of worker threads. If 0, one thread per
+	 *              hardware thread is created.
+	 */
+	ThreadPool(unsigned int numThreads = 0);
+
+	/**
+	 * Waits for all scheduled jobs and joins the worker threads.
+	 */
+	~ThreadPool();
+
+	/**
+	 * Add a job to be processed by one of the worker threads.
+	 */
+	void schedule(const boost::function<void()>& job);
+
+	/**
+	 * Block until all scheduled jobs have been processed. If a job threw an
+	 * exception, the first one is rethrown here.
+	 */
+	void wait();
+
+	/**
+	 * The number of worker threads of this pool.
+	 */
+	unsigned int size() const { return _numThreads; }
+
+private:
+
+	void work();
+
+	unsigned int _numThreads;
+
+	boost::thread_group _threads;
+
+	// the jobs that have not been started, yet
+	std::deque<boost::function<void()> > _jobs;
+
+	// the number of scheduled jobs that have not finished, yet
+	unsigned int _pending;
+
+	// the first exception thrown by a job
+	boost::exception_ptr _exception;
+
+	bool _stop;
+
+	boost::mutex              _mutex;
+	boost::condition_variable _jobAvailable;
+	boost::condition_variable _jobsDone;
+};
+
+#endif // GUI_THREAD_POOL_H__
+
@@ -0,0 +1,206 @@
+#include <boost/bind.hpp>
+#include <util/Logger.h>
+#include "UploadService.h"
+
+static logger::LogChannel uploadservicelog("uploadservicelog", "[UploadService] ");
+
+namespace {
+
+// how long to wait for the GPU at a time, if there are no new jobs (in
+// nanoseconds)
+const GLuint64 FenceTimeout = 1000000;
+
+} // anonymous namespace
+
+UploadService&
+UploadService::getInstance() {
+
+	static UploadService uploadService;
+
+	return uploadService;
+}
+
+UploadService::UploadService() :
+	_pending(0),
+	_stop(false) {
+
+	_thread = boost::thread(boost::bind(&UploadService::work, this));
+}
+
+UploadService::~UploadService() {
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		while (_pending > 0)
+			_jobsDone.wait(lock);
+
+		_stop = true;
+	}
+
+	_jobAvailable.notify_all();
+	_thread.join();
+}
+
+void
+UploadService::schedule(const Job& job, const Callback& callback) {
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		_jobs.push_back(std::make_pair(job, callback));
+		_pending++;
+	}
+
+	_jobAvailable.notify_one();
+}
+
+void
+UploadService::flush() {
+
+	boost::exception_ptr exception;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		while (_pending > 0)
+			_jobsDone.wait(lock);
+
+		exception = _exception;
+		_exception = boost::exception_ptr();
+	}
+
+	if (exception)
+		boost::rethrow_exception(exception);
+}
+
+void
+UploadService::work() {
+
+	// the context of the upload thread, active for the lifetime of the thread
+	gui::OpenGl::Guard guard;
+
+	bool useFences = glewIsSupported("GL_ARB_sync");
+
+	if (!useFences)
+		LOG_USER(uploadservicelog) << "fences not supported, waiting for uploads with glFinish()" << std::endl;
+
+	while (true) {
+
+		std::pair<Job, Callback> job;
+		bool haveJob = false;
+
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+
+			while (_jobs.empty() && _fences.empty() && !_stop)
+				_jobAvailable.wait(lock);
+
+			if (_jobs.empty() && _fences.empty())
+				return;
+
+			if (!_jobs.empty()) {
+
+				job = _jobs.front();
+				_jobs.pop_front();
+				haveJob = true;
+			}
+		}
+
+		if (haveJob) {
+
+			try {
+
+				job.first();
+
+			} catch (...) {
+
+				boost::mutex::scoped_lock lock(_mutex);
+
+				if (!_exception)
+					_exception = boost::current_exception();
+			}
+
+			GLsync fence = 0;
+
+			if (useFences)
+				fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+			if (fence) {
+
+				_fences.push_back(std::make_pair(fence, job.second));
+
+				// make sure the fence gets to the GPU
+				glFlush();
+
+			} else {
+
+				// some drivers fail to create fences in secondary contexts,
+				// clear the error
+				if (useFences)
+					glGetError();
+
+				// the GPU passed all earlier fences as well
+				glFinish();
+
+				while (!_fences.empty()) {
+
+					glDeleteSync(_fences.front().first);
+
+					Callback callback = _fences.front().second;
+					_fences.pop_front();
+
+					finish(callback);
+				}
+
+				finish(job.second);
+			}
+		}
+
+		// call the callbacks of jobs the GPU is done with, wait a bit for
+		// the oldest one if there is nothing else to do
+		while (!_fences.empty()) {
+
+			GLenum result = glClientWaitSync(_fences.front().first, 0, haveJob ? 0 : FenceTimeout);
+
+			if (result == GL_TIMEOUT_EXPIRED)
+				break;
+
+			glDeleteSync(_fences.front().first);
+
+			Callback callback = _fences.front().second;
+			_fences.pop_front();
+
+			finish(callback);
+		}
+	}
+}
+
+void
+UploadService::finish(const Callback& callback) {
+
+	boost::exception_ptr exception;
+
+	if (callback) {
+
+		try {
+
+			callback();
+
+		} catch (...) {
+
+			exception = boost::current_exception();
+		}
+	}
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		if (exception && !_exception)
+			_exception = exception;
+
+		_pending--;
+	}
+
+	_jobsDone.notify_all();
+}
@@ -0,0 +1,86 @@
+#ifndef GUI_UPLOAD_SERVICE_H__
+#define GUI_UPLOAD_SERVICE_H__
+
+#include <deque>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <gui/OpenGl.h>
+
+/**
+ * A thread that transfers data to the GPU, such that threads that draw do 
+ * not have to wait for uploads.
+ *
+ * The thread has an OpenGl context of its own, shared with the global 
+ * context (see OpenGl::Guard), such that buffers and textures filled by its 
+ * jobs can be used in every other context. Jobs are processed in the order 
+ * they have been scheduled. After a job, a fence is put into the command 
+ * stream. As soon as the GPU passed it, the callback of the job is called 
+ * (on the upload thread, in the order of the jobs). Without fences (they 
+ * need GL_ARB_sync), or if a fence can not be created, the thread waits for 
+ * the GPU with glFinish() instead.
+ */
+class UploadService {
+
+public:
+
+	typedef boost::function<void()> Job;
+	typedef boost::function<void()> Callback;
+
+	/**
+	 * Get the upload service. The upload thread is started with the first 
+	 * call.
+	 */
+	static UploadService& getInstance();
+
+	/**
+	 * Waits for all scheduled jobs and stops the upload thread.
+	 */
+	~UploadService();
+
+	/**
+	 * Add a job to be processed by the upload thread. The given callback is 
+	 * called when the GPU executed all OpenGl commands of the job.
+	 */
+	void schedule(const Job& job, const Callback& callback = Callback());
+
+	/**
+	 * Block until all scheduled jobs have been processed and their callbacks 
+	 * have been called. If a job or callback threw an exception, the first 
+	 * one is rethrown here.
+	 */
+	void flush();
+
+private:
+
+	UploadService();
+
+	void work();
+
+	// call the callback of a finished job
+	void finish(const Callback& callback);
+
+	boost::thread _thread;
+
+	// the jobs that have not been started, yet
+	std::deque<std::pair<Job, Callback> > _jobs;
+
+	// the fences after jobs whose callbacks have not been called, yet (only 
+	// used by the upload thread)
+	std::deque<std::pair<GLsync, Callback> > _fences;
+
+	// the number of scheduled jobs whose callbacks have not been called, yet
+	unsigned int _pending;
+
+	// the first exception thrown by a job or callback
+	boost::exception_ptr _exception;
+
+	bool _stop;
+
+	boost::mutex              _mutex;
+	boost::condition_variable _jobAvailable;
+	boost::condition_variable _jobsDone;
+};
+
+#endif // GUI_UPLOAD_SERVICE_H__
+
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <boost/timer/timer.hpp>
+#include <util/Logger.h>
+#include "VertexCacheOptimizer.h"
+
+static logger::LogChannel vertexcacheoptimizerlog("vertexcacheoptimizerlog", "[VertexCacheOptimizer] ");
+
+namespace {
+
+// the parameters of the scoring function suggested by Forsyth
+const float CacheDecayPower   = 1.5f;
+const float LastTriangleScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+
+// the number of remaining triangles for which scores are precomputed
+const unsigned int MaxValence = 32;
+
+const unsigned int Invalid = std::numeric_limits<unsigned int>::max();
+
+// the j-th corner of a triangle is the same vertex as an earlier corner
+inline bool isRepeated(const unsigned int* corners, int j) {
+
+	return (j > 0 && corners[j] == corners[0]) || (j > 1 && corners[j] == corners[1]);
+}
+
+} // anonymous namespace
+
+VertexCacheOptimizer::VertexCacheOptimizer(unsigned int cacheSize) :
+	_cacheSize(std::max(cacheSize, 4u)),
+	_cacheScores(_cacheSize),
+	_valenceScores(MaxValence + 1) {
+
+	for (unsigned int i = 0; i < _cacheSize; i++) {
+
+		// the vertices of the last triangle get a lower, fixed score, 
+		// otherwise the next triangle would likely share an edge with it, 
+		// which leads to long thin strips
+		if (i < 3)
+			_cacheScores[i] = LastTriangleScore;
+		else
+			_cacheScores[i] = std::pow(1.0f - static_cast<float>(i - 3)/(_cacheSize - 3), CacheDecayPower);
+	}
+
+	for (unsigned int i = 1; i <= MaxValence; i++)
+		_valenceScores[i] = valenceScore(i);
+}
+
+void
+VertexCacheOptimizer::optimize(Mesh& mesh) const {
+
+	boost::timer::cpu_timer timer;
+
+	float acmrBefore = computeAcmr(mesh, _cacheSize);
+
+	reorderTriangles(mesh);
+	reorderVertices(mesh);
+
+	LOG_DEBUG(vertexcacheoptimizerlog)
+			<< "reordered " << mesh.getNumTriangles() << " triangles, ACMR "
+			<< acmrBefore << " -> " << computeAcmr(mesh, _cacheSize)
+			<< " for a cache of " << _cacheSize << " vertices:" << timer.format() << std::endl;
+}
+
+float
+VertexCacheOptimizer::computeAcmr(const Mesh& mesh, unsigned int cacheSize) {
+
+	if (mesh.getNumTriangles() == 0)
+		return 0;
+
+	// A vertex is in the cache, if less than cacheSize misses happened since
+	// it was loaded.
+	std::vector<unsigned int> loadedAt(mesh.getNumVertices(), Invalid);
+
+	unsigned int misses = 0;
+
+	const Triangle* triangles = mesh.getTriangles();
+
+	for (unsigned int i = 0; i < mesh.getNumTriangles(); i++) {
+
+		const unsigned int corners[3] = { triangles[i].v0, triangles[i].v1, triangles[i].v2 };
+
+		for (int j = 0; j < 3; j++)
+			if (loadedAt[corners[j]] == Invalid || misses - loadedAt[corners[j]] >= cacheSize) {
+
+				loadedAt[corners[j]] = misses;
+				misses++;
+			}
+	}
+
+	return static_cast<float>(misses)/mesh.getNumTriangles();
+}
+
+void
+VertexCacheOptimizer::reorderTriangles(Mesh& mesh) const {
+
+	unsigned int numVertices  = mesh.getNumVertices();
+	unsigned int numTriangles = mesh.getNumTriangles();
+
+	Triangle* triangles = mesh.getTriangles();
+
+	// the triangles around each vertex, the ones that have not been added
+	// come first
+
+	std::vector<unsigned int> offsets(numVertices + 1, 0);
+	std::vector<unsigned int> adjacency(3*numTriangles);
+
+	// degenerated triangles use a vertex more than once, they are listed
+	// once per distinct vertex
+	for (unsigned int i = 0; i < numTriangles; i++) {
+
+		const unsigned int corners[3] = { triangles[i].v0, triangles[i].v1, triangles[i].v2 };
+
+		for (int j = 0; j < 3; j++)
+			if (!isRepeated(corners, j))
+				offsets[corners[j] + 1]++;
+	}
+
+	for (unsigned int i = 0; i < numVertices; i++)
+		offsets[i + 1] += offsets[i];
+
+	// the number of triangles around each vertex that have not been added
+	std::vector<unsigned int> remaining(numVertices, 0);
+
+	for (unsigned int i = 0; i < numTriangles; i++) {
+
+		const unsigned int corners[3] = { triangles[i].v0, triangles[i].v1, triangles[i].v2 };
+
+		for (int j = 0; j < 3; j++) {
+
+			if (isRepeated(corners, j))
+				continue;
+
+			adjacency[offsets[corners[j]] + remaining[corners[j]]] = i;
+			remaining[corners[j]]++;
+		}
+	}
+
+	// the initial scores
+
+	std::vector<int>   cachePositions(numVertices, -1);
+	std::vector<float> vertexScores(numVertices);
+	std::vector<float> triangleScores(numTriangles);
+	std::vector<char>  added(numTriangles, 0);
+
+	for (unsigned int i = 0; i < numVertices; i++)
+		vertexScores[i] = vertexScore(-1, remaining[i]);
+
+	unsigned int best = Invalid;
+	float bestScore = -1;
+
+	for (unsigned int i = 0; i < numTriangles; i++) {
+
+		triangleScores[i] =
+				vertexScores[triangles[i].v0] +
+				vertexScores[triangles[i].v1] +
+				vertexScores[triangles[i].v2];
+
+		if (triangleScores[i] > bestScore) {
+
+			best = i;
+			bestScore = triangleScores[i];
+		}
+	}
+
+	// add the triangles one by one
+
+	std::vector<Triangle> ordered;
+	ordered.reserve(numTriangles);
+
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> nextCache;
+	cache.reserve(_cacheSize + 3);
+	nextCache.reserve(_cacheSize + 3);
+
+	// the first triangle that might not have been added
+	unsigned int nextCandidate = 0;
+
+	for (unsigned int n = 0; n < numTriangles; n++) {
+
+		// none of the triangles around the cache is left, take the next one
+		// in the original order
+		if (best == Invalid) {
+
+			while (added[nextCandidate])
+				nextCandidate++;
+
+			best = nextCandidate;
+		}
+
+		added[best] = 1;
+		ordered.push_back(triangles[best]);
+
+		const unsigned int corners[3] = { triangles[best].v0, triangles[best].v1, triangles[best].v2 };
+
+		// move the triangle behind the remaining triangles of its vertices
+		for (int j = 0; j < 3; j++) {
+
+			unsigned int v = corners[j];
+
+			if (isRepeated(corners, j))
+				continue;
+
+			unsigned int* begin = &adjacency[offsets[v]];
+			unsigned int* last  = begin + remaining[v] - 1;
+
+			for (unsigned int* i = begin; i <= last; i++)
+				if (*i == best) {
+
+					std::swap(*i, *last);
+					break;
+				}
+
+			remaining[v]--;
+		}
+
+		// the vertices of the triangle move to the front of the cache
+		nextCache.clear();
+		for (int j = 0; j < 3; j++)
+			if (std::find(nextCache.begin(), nextCache.end(), corners[j]) == nextCache.end())
+				nextCache.push_back(corners[j]);
+		for (unsigned int i = 0; i < cache.size(); i++)
+			if (cache[i] != corners[0] && cache[i] != corners[1] && cache[i] != corners[2])
+				nextCache.push_back(cache[i]);
+		cache.swap(nextCache);
+
+		// update the scores of the vertices in the cache and the ones that
+		// just fell out of it
+		for (unsigned int i = 0; i < cache.size(); i++) {
+
+			unsigned int v = cache[i];
+
+			cachePositions[v] = (i < _cacheSize ? static_cast<int>(i) : -1);
+			vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+		}
+
+		// update the scores of their triangles and find the best one
+		best = Invalid;
+		bestScore = -1;
+
+		for (unsigned int i = 0; i < cache.size(); i++) {
+
+			unsigned int v = cache[i];
+
+			for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+
+				unsigned int t = adjacency[j];
+
+				if (added[t])
+					continue;
+
+				triangleScores[t] =
+						vertexScores[triangles[t].v0] +
+						vertexScores[triangles[t].v1] +
+						vertexScores[triangles[t].v2];
+
+				if (triangleScores[t] > bestScore) {
+
+					best = t;
+					bestScore = triangleScores[t];
+				}
+			}
+		}
+
+		if (cache.size() > _cacheSize)
+			cache.resize(_cacheSize);
+	}
+
+	std::copy(ordered.begin(), ordered.end(), triangles);
+	mesh.setTrianglesChanged();
+}
+
+void
+VertexCacheOptimizer::reorderVertices(Mesh& mesh) const {
+
+	unsigned int numVertices  = mesh.getNumVertices();
+	unsigned int numTriangles = mesh.getNumTriangles();
+
+	Point3d*  vertices  = mesh.getVertices();
+	Vector3d* normals   = mesh.getNormals();
+	Triangle* triangles = mesh.getTriangles();
+
+	// number the vertices in the order they are used, unused ones last
+
+	std::vector<unsigned int> ids(numVertices, Invalid);
+
+	unsigned int nextId = 0;
+	for (unsigned int i = 0; i < numTriangles; i++) {
+
+		if (ids[triangles[i].v0] == Invalid) ids[triangles[i].v0] = nextId++;
+		if (ids[triangles[i].v1] == Invalid) ids[triangles[i].v1] = nextId++;
+		if (ids[triangles[i].v2] == Invalid) ids[triangles[i].v2] = nextId++;
+
+		triangles[i] = Triangle(ids[triangles[i].v0], ids[triangles[i].v1], ids[triangles[i].v2]);
+	}
+
+	for (unsigned int i = 0; i < numVertices; i++)
+		if (ids[i] == Invalid)
+			ids[i] = nextId++;
+
+	std::vector<Point3d>  orderedVertices(numVertices);
+	std::vector<Vector3d> orderedNormals(numVertices);
+
+	for (unsigned int i = 0; i < numVertices; i++) {
+
+		orderedVertices[ids[i]] = vertices[i];
+		orderedNormals[ids[i]]  = normals[i];
+	}
+
+	std::copy(orderedVertices.begin(), orderedVertices.end(), vertices);
+	std::copy(orderedNormals.begin(),  orderedNormals.end(),  normals);
+
+	mesh.setVerticesChanged();
+	mesh.setNormalsChanged();
+	mesh.setTrianglesChanged();
+}
+
+float
+VertexCacheOptimizer::vertexScore(int cachePosition, unsigned int remainingTriangles) const {
+
+	// vertices without triangles don't help anymore
+	if (remainingTriangles == 0)
+		return -1;
+
+	return
+			(cachePosition >= 0 ? _cacheScores[cachePosition] : 0) +
+			(remainingTriangles <= MaxValence ? _valenceScores[remainingTriangles] : valenceScore(remainingTriangles));
+}
+
+float
+VertexCacheOptimizer::valenceScore(unsigned int remainingTriangles) {
+
+	// favour vertices with few remaining triangles, to finish them off
+	return ValenceBoostScale*std::pow(static_cast<float>(remainingTriangles), -ValenceBoostPower);
+}
@@ -0,0 +1,63 @@
+#ifndef GUI_VERTEX_CACHE_OPTIMIZER_H__
+#define GUI_VERTEX_CACHE_OPTIMIZER_H__
+
+#include <vector>
+#include "Mesh.h"
+
+/**
+ * Reorders the triangles and vertices of a mesh for faster drawing.
+ *
+ * The triangles are reordered such that vertices are reused while they are
+ * still in the post-transform cache of the GPU, following "Linear-Speed
+ * Vertex Cache Optimisation" by Tom Forsyth. The vertices (and normals) are
+ * then renumbered in the order they are first used by the triangles, such
+ * that they are fetched from memory sequentially.
+ *
+ * The geometry of the mesh does not change.
+ */
+class VertexCacheOptimizer {
+
+public:
+
+	/**
+	 * Create an optimizer for a cache of the given number of vertices.
+	 */
+	VertexCacheOptimizer(unsigned int cacheSize = 32);
+
+	/**
+	 * Reorder the triangles and vertices of the given mesh.
+	 */
+	void optimize(Mesh& mesh) const;
+
+	/**
+	 * Get the average cache miss ratio (the number of vertex transformations
+	 * per triangle) of drawing the given mesh with a FIFO cache of the given
+	 * size. The ratio is between 0.5 (for very large, regular meshes) and 3.
+	 */
+	static float computeAcmr(const Mesh& mesh, unsigned int cacheSize);
+
+private:
+
+	// Reorder the triangles to make best use of the cache.
+	void reorderTriangles(Mesh& mesh) const;
+
+	// Renumber the vertices in the order they are used by the triangles.
+	void reorderVertices(Mesh& mesh) const;
+
+	// Score of a vertex at the given position in the cache (or -1, if not in
+	// the cache) and the given number of triangles that still use it.
+	float vertexScore(int cachePosition, unsigned int remainingTriangles) const;
+
+	// The part of the score that depends on the number of remaining 
+	// triangles.
+	static float valenceScore(unsigned int remainingTriangles);
+
+	unsigned int _cacheSize;
+
+	// precomputed parts of the vertex scores
+	std::vector<float> _cacheScores;
+	std::vector<float> _valenceScores;
+};
+
+#endif // GUI_VERTEX_CACHE_OPTIMIZER_H__
+
@@ -0,0 +1,291 @@
+#ifndef GUI_VOLUME_SAMPLER_H__
+#define GUI_VOLUME_SAMPLER_H__
+
+#include <algorithm>
+#include <vector>
+#include <boost/mpl/has_xxx.hpp>
+
+namespace detail {
+
+BOOST_MPL_HAS_XXX_TRAIT_DEF(dense_volume_tag)
+
+} // namespace detail
+
+/**
+ * Reads the values of a volume on a regular lattice, as needed by
+ * MarchingCubes. Lattice point i samples the volume at
+ *
+ *   min + (i-1)*cellSize
+ *
+ * in each dimension. Values of the lattice are accessed row by row:
+ *
+ *   typename VolumeSampler<Volume>::Row row = sampler.getRow(y, z);
+ *   value_type value = row[x];
+ *
+ * The generic implementation calls Volume::operator()(float, float, float)
+ * for each value. Volumes that provide dense voxel data (see
+ * VolumeSampler<Volume, true>) are read directly from memory.
+ */
+template <typename Volume, bool Dense = detail::has_dense_volume_tag<Volume>::value>
+class VolumeSampler {
+
+	typedef typename Volume::value_type value_type;
+
+public:
+
+	/**
+	 * A row of lattice values for fixed y and z.
+	 */
+	class Row {
+
+	public:
+
+		Row(const VolumeSampler& sampler, int y, int z) :
+			_sampler(sampler),
+			_y(sampler.getLatticeY(y)),
+			_z(sampler.getLatticeZ(z)) {}
+
+		inline value_type operator[](int x) const {
+
+			return _sampler._volume(_sampler.getLatticeX(x), _y, _z);
+		}
+
+		/**
+		 * Read the values of lattice points [begin, end) of this row.
+		 */
+		void read(int begin, int end, value_type* values) const {
+
+			for (int x = begin; x < end; x++)
+				*values++ = (*this)[x];
+		}
+
+	private:
+
+		const VolumeSampler& _sampler;
+
+		float _y, _z;
+	};
+
+	VolumeSampler(
+			const Volume& volume,
+			float minX, float minY, float minZ,
+			float cellSizeX, float cellSizeY, float cellSizeZ,
+			unsigned int, unsigned int, unsigned int) :
+		_volume(volume),
+		_minX(minX), _minY(minY), _minZ(minZ),
+		_cellSizeX(cellSizeX), _cellSizeY(cellSizeY), _cellSizeZ(cellSizeZ) {}
+
+	/**
+	 * Get the lattice values for fixed y and z.
+	 */
+	inline Row getRow(int y, int z) const { return Row(*this, y, z); }
+
+	/**
+	 * Get the value at lattice point (x, y, z).
+	 */
+	inline value_type operator()(int x, int y, int z) const { return getRow(y, z)[x]; }
+
+	/**
+	 * Get the value at an arbitrary point of the volume.
+	 */
+	inline value_type operator()(float x, float y, float z) const { return _volume(x, y, z); }
+
+	/**
+	 * Get the range of voxels covered by the lattice points [begin, end] 
+	 * along the given axis. Returns false, since the voxels of a generic 
+	 * volume are not known.
+	 */
+	bool getVoxelRange(int, int, int, unsigned int&, unsigned int&, bool&, bool&) const { return false; }
+
+private:
+
+	inline float getLatticeX(int x) const { return _minX + (x-1)*_cellSizeX; }
+	inline float getLatticeY(int y) const { return _minY + (y-1)*_cellSizeY; }
+	inline float getLatticeZ(int z) const { return _minZ + (z-1)*_cellSizeZ; }
+
+	const Volume& _volume;
+
+	float _minX, _minY, _minZ;
+	float _cellSizeX, _cellSizeY, _cellSizeZ;
+};
+
+/**
+ * Sampler for dense volumes, which are volumes that implement:
+ *
+ *   // marks the volume as dense
+ *   typedef ... Volume::dense_volume_tag
+ *
+ *   // the number of voxels in each dimension
+ *   unsigned int Volume::getVoxelsX()
+ *   unsigned int Volume::getVoxelsY()
+ *   unsigned int Volume::getVoxelsZ()
+ *
+ *   // pointer to the voxels of a section, row by row
+ *   const value_type* Volume::getSection(unsigned int z)
+ *
+ * Voxel (i, j, k) covers [min + i, min + i + 1) (and the same for j and k) of
+ * the volume's bounding box. Outside of the voxels, the volume is 0.
+ *
+ * For each lattice coordinate, the voxel index is computed once, such that
+ * accessing a lattice value is a table lookup and a memory read.
+ */
+template <typename Volume>
+class VolumeSampler<Volume, true> {
+
+	typedef typename Volume::value_type value_type;
+
+public:
+
+	class Row {
+
+	public:
+
+		Row(const VolumeSampler& sampler, int y, int z) :
+			_voxelsX(&sampler._voxelsX[0]),
+			_row(0) {
+
+			int vy = sampler._voxelsY[y];
+			int vz = sampler._voxelsZ[z];
+
+			if (vy >= 0 && vz >= 0)
+				_row = sampler._sections[vz] + vy*sampler._width;
+		}
+
+		inline value_type operator[](int x) const {
+
+			int vx = _voxelsX[x];
+
+			if (!_row || vx < 0)
+				return value_type(0);
+
+			return _row[vx];
+		}
+
+		void read(int begin, int end, value_type* values) const {
+
+			if (!_row) {
+
+				std::fill(values, values + (end - begin), value_type(0));
+				return;
+			}
+
+			for (int x = begin; x < end; x++) {
+
+				int vx = _voxelsX[x];
+				*values++ = (vx < 0 ? value_type(0) : _row[vx]);
+			}
+		}
+
+	private:
+
+		const int* _voxelsX;
+
+		const value_type* _row;
+	};
+
+	VolumeSampler(
+			const Volume& volume,
+			float minX, float minY, float minZ,
+			float cellSizeX, float cellSizeY, float cellSizeZ,
+			unsigned int latticeX, unsigned int latticeY, unsigned int latticeZ) :
+		_width(volume.getVoxelsX()),
+		_height(volume.getVoxelsY()),
+		_depth(volume.getVoxelsZ()),
+		_boundingBoxMinX(volume.getBoundingBox().getMinX()),
+		_boundingBoxMinY(volume.getBoundingBox().getMinY()),
+		_boundingBoxMinZ(volume.getBoundingBox().getMinZ()) {
+
+		_sections.resize(_depth);
+		for (unsigned int z = 0; z < _depth; z++)
+			_sections[z] = volume.getSection(z);
+
+		_voxelsX.resize(latticeX);
+		_voxelsY.resize(latticeY);
+		_voxelsZ.resize(latticeZ);
+
+		for (unsigned int i = 0; i < latticeX; i++)
+			_voxelsX[i] = getVoxel(minX + (static_cast<int>(i)-1)*cellSizeX, _boundingBoxMinX, _width);
+		for (unsigned int i = 0; i < latticeY; i++)
+			_voxelsY[i] = getVoxel(minY + (static_cast<int>(i)-1)*cellSizeY, _boundingBoxMinY, _height);
+		for (unsigned int i = 0; i < latticeZ; i++)
+			_voxelsZ[i] = getVoxel(minZ + (static_cast<int>(i)-1)*cellSizeZ, _boundingBoxMinZ, _depth);
+	}
+
+	inline Row getRow(int y, int z) const { return Row(*this, y, z); }
+
+	inline value_type operator()(int x, int y, int z) const { return getRow(y, z)[x]; }
+
+	inline value_type operator()(float x, float y, float z) const {
+
+		int vx = getVoxel(x, _boundingBoxMinX, _width);
+		int vy = getVoxel(y, _boundingBoxMinY, _height);
+		int vz = getVoxel(z, _boundingBoxMinZ, _depth);
+
+		if (vx < 0 || vy < 0 || vz < 0)
+			return value_type(0);
+
+		return _sections[vz][vy*_width + vx];
+	}
+
+	/**
+	 * Get the range of voxels [minVoxel, maxVoxel] covered by the lattice 
+	 * points [begin, end] along the given axis. outside is set, if some of 
+	 * the lattice points are outside of the volume, empty is set if all of 
+	 * them are.
+	 */
+	bool getVoxelRange(
+			int begin, int end, int axis,
+			unsigned int& minVoxel, unsigned int& maxVoxel,
+			bool& outside, bool& empty) const {
+
+		const std::vector<int>& voxels = (axis == 0 ? _voxelsX : (axis == 1 ? _voxelsY : _voxelsZ));
+
+		outside = false;
+		empty   = true;
+
+		for (int i = begin; i <= end; i++) {
+
+			if (voxels[i] < 0) {
+
+				outside = true;
+				continue;
+			}
+
+			if (empty) {
+
+				minVoxel = maxVoxel = voxels[i];
+				empty = false;
+
+			} else {
+
+				minVoxel = std::min(minVoxel, static_cast<unsigned int>(voxels[i]));
+				maxVoxel = std::max(maxVoxel, static_cast<unsigned int>(voxels[i]));
+			}
+		}
+
+		return true;
+	}
+
+private:
+
+	// the voxel containing the given coordinate, -1 if outside
+	static inline int getVoxel(float c, float min, unsigned int size) {
+
+		if (c < min || c >= min + size)
+			return -1;
+
+		return static_cast<unsigned int>(c - min);
+	}
+
+	unsigned int _width, _height, _depth;
+
+	float _boundingBoxMinX, _boundingBoxMinY, _boundingBoxMinZ;
+
+	std::vector<const value_type*> _sections;
+
+	// the voxel index for each lattice coordinate
+	std::vector<int> _voxelsX, _voxelsY, _voxelsZ;
+};
+
+#endif // GUI_VOLUME_SAMPLER_H__
+